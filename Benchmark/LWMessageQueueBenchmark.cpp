@@ -0,0 +1,446 @@
+#include <algorithm>
+#include <assert.h>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <thread>
+#include <vector>
+#include "LWMessageQueue.h"
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+// Measures throughput and latency of one consumer reading from a growing number of producers, for every combination
+// of channel engine, channel size, message size, thread pinning, push pattern and wake-up support. Every run is printed as one CSV
+// line or JSON object, so that results can be compared between releases.
+//
+// Usage: LWMessageQueueBenchmark [--format csv|json] [--messages total messages per run] [--quick]
+//
+// engine         "thread" for one channel per producer, "shared" for the shared multi-producer channel.
+// producers      Number of producer threads.
+// size           Slots per channel, SIZE.
+// message_bytes  Size of the MESSAGE union.
+// pinned         1 if the consumer and the producers are pinned to CPUs, round-robin. Pinned runs are skipped, with
+//                a note on stderr, where threads can not be pinned.
+// pattern        "steady" pushes one message at a time, "burst" stages burstLength messages, commits them and
+//                pauses for burstPause.
+// notify         "none" with the default traits, "wait" with enableBlockingWait, "eventfd" with enableEventFd (Linux
+//                only). The consumer never waits, so these rows measure the memory fence every push pays for the
+//                wake-up support while the consumer is busy.
+// msgs_per_sec   Messages received per second by the consumer.
+// p50_ns ...     Latency percentiles from push to receive, over every latencySampleInterval-th message.
+
+namespace {
+
+enum class BenchmarkMessageType {
+	BenchmarkMessage
+};
+
+/** Message of BYTES bytes. timestamp is only set on latency samples. */
+template<uint32_t BYTES>
+struct BenchmarkMessage {
+	static_assert(BYTES >= 16, "Benchmark messages carry a 16 byte header.");
+
+	uint64_t timestamp;
+	uint32_t producer;
+	uint32_t sequence;
+	uint8_t payload[BYTES - 16];
+};
+
+template<uint32_t BYTES>
+union BenchmarkMessageUnion {
+	BenchmarkMessage<BYTES> message;
+};
+
+template<uint32_t SIZE, bool BLOCKING_WAIT, bool EVENT_FD>
+struct BenchmarkTraits : LWMessageQueue::DefaultTraits {
+	static constexpr uint32_t sharedChannelSize = SIZE;
+	static constexpr bool enableBlockingWait = BLOCKING_WAIT;
+	static constexpr bool enableEventFd = EVENT_FD;
+};
+
+enum class Engine {
+	ThreadChannels,
+	SharedChannel
+};
+
+enum class Pattern {
+	Steady,
+	Burst
+};
+
+enum class Notify {
+	None,
+	BlockingWait,
+	EventFd
+};
+
+const uint32_t latencySampleInterval = 16;
+const uint32_t burstLength = 64;
+const std::chrono::microseconds burstPause(20);
+
+struct Configuration {
+	Engine engine;
+	uint32_t numProducers;
+	uint32_t channelSize;
+	uint32_t messageBytes;
+	bool pinned;
+	Pattern pattern;
+	Notify notify;
+	uint32_t numMessages;
+};
+
+struct Result {
+	bool pinFailed;
+	double seconds;
+	uint64_t p50;
+	uint64_t p99;
+	uint64_t p999;
+};
+
+inline uint64_t nowNanoseconds() {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/** Pin the calling thread to one CPU, round-robin by inIndex.
+	@return False if the thread could not be pinned, or pinning is not supported.
+*/
+bool pinThread(const uint32_t inIndex) {
+#if defined(__linux__)
+	const uint32_t numCpus = std::max(std::thread::hardware_concurrency(), 1u);
+	cpu_set_t cpuSet;
+	CPU_ZERO(&cpuSet);
+	CPU_SET(inIndex % numCpus, &cpuSet);
+	return pthread_setaffinity_np(pthread_self(), sizeof(cpuSet), &cpuSet) == 0;
+#else
+	(void)inIndex;
+	return false;
+#endif
+}
+
+/** Producers wait for the go signal, so that thread creation is not measured. */
+class StartSignal {
+public:
+	void wait() const {
+		while (!started.load(std::memory_order_acquire)) {
+			std::this_thread::yield();
+		}
+	}
+	void start() {
+		started.store(true, std::memory_order_release);
+	}
+private:
+	std::atomic<bool> started{false};
+};
+
+template<uint32_t SIZE, uint32_t BYTES, typename TRAITS>
+class Benchmark {
+public:
+	// Runtime sized, so that the thread channels only take memory for the producers of a run. The shared channel
+	// has SIZE slots.
+	using MessageQueue = LWMessageQueue::LWMessageQueue<LWMessageQueue::dynamicExtent, LWMessageQueue::dynamicExtent,
+		BenchmarkMessageUnion<BYTES>, BenchmarkMessageType, TRAITS>;
+	using Message = BenchmarkMessage<BYTES>;
+
+	static Result run(const Configuration& inConfiguration) {
+		std::unique_ptr<MessageQueue> messageQueue(new MessageQueue(SIZE, inConfiguration.numProducers));
+		const uint32_t numMessagesPerProducer = inConfiguration.numMessages / inConfiguration.numProducers;
+
+		StartSignal startSignal;
+		std::atomic<bool> pinFailed{false};
+		std::vector<std::thread> producers;
+		for (uint32_t producer = 0; producer < inConfiguration.numProducers; ++producer) {
+			producers.emplace_back([&, producer]() {
+				if (inConfiguration.pinned && !pinThread(producer + 1)) {
+					pinFailed.store(true, std::memory_order_relaxed);
+				}
+				startSignal.wait();
+				if (inConfiguration.engine == Engine::ThreadChannels) {
+					produce(messageQueue->getThreadChannelInput(producer), inConfiguration, producer,
+						numMessagesPerProducer);
+				} else {
+					produce(messageQueue->getSharedChannelInput(), inConfiguration, producer, numMessagesPerProducer);
+				}
+			});
+		}
+
+		// The consumer runs on its own thread, so that pinning it leaves the affinity of the main thread alone.
+		Result result;
+		std::thread consumer([&]() {
+			if (inConfiguration.pinned && !pinThread(0)) {
+				pinFailed.store(true, std::memory_order_relaxed);
+			}
+			consume(*messageQueue, inConfiguration, numMessagesPerProducer, startSignal, result);
+		});
+		consumer.join();
+		for (std::thread& producer : producers) {
+			producer.join();
+		}
+		result.pinFailed = pinFailed.load(std::memory_order_relaxed);
+		return result;
+	}
+
+private:
+	static void consume(
+		MessageQueue& inMessageQueue,
+		const Configuration& inConfiguration,
+		const uint32_t inNumMessagesPerProducer,
+		StartSignal& inStartSignal,
+		Result& outResult)
+	{
+		std::vector<uint64_t> latencies;
+		latencies.reserve(inConfiguration.numMessages / latencySampleInterval + inConfiguration.numProducers);
+		const uint32_t numTotal = inNumMessagesPerProducer * inConfiguration.numProducers;
+		uint32_t numReceived = 0;
+		auto receive = [&latencies](const typename MessageQueue::MessageContainer& inMessage) {
+			const Message& message = inMessage.template getMessage<Message>();
+			if (message.timestamp != 0) {
+				latencies.push_back(nowNanoseconds() - message.timestamp);
+			}
+		};
+
+		const auto startTime = std::chrono::steady_clock::now();
+		inStartSignal.start();
+		while (numReceived < numTotal) {
+			uint32_t numDrained = 0;
+			if (inConfiguration.engine == Engine::ThreadChannels) {
+				for (uint32_t channel = 0; channel < inConfiguration.numProducers; ++channel) {
+					numDrained += inMessageQueue.getThreadChannelOutput(channel).drain(receive, SIZE);
+				}
+			} else {
+				numDrained = inMessageQueue.getSharedChannelOutput().drain(receive, SIZE);
+			}
+			if (numDrained == 0) {
+				std::this_thread::yield();
+			}
+			numReceived += numDrained;
+		}
+		const auto endTime = std::chrono::steady_clock::now();
+
+		outResult.seconds = std::chrono::duration<double>(endTime - startTime).count();
+		std::sort(latencies.begin(), latencies.end());
+		outResult.p50 = percentile(latencies, 0.5);
+		outResult.p99 = percentile(latencies, 0.99);
+		outResult.p999 = percentile(latencies, 0.999);
+	}
+
+	static uint64_t percentile(const std::vector<uint64_t>& inSortedValues, const double inFraction) {
+		if (inSortedValues.empty()) {
+			return 0;
+		}
+		const size_t index = static_cast<size_t>(inFraction * (inSortedValues.size() - 1) + 0.5);
+		return inSortedValues[index];
+	}
+
+	template<typename INPUT>
+	static void push(INPUT& inInput, Message& ioMessage, const uint32_t inSequence) {
+		ioMessage.sequence = inSequence;
+		ioMessage.timestamp = (inSequence % latencySampleInterval == 0) ? nowNanoseconds() : 0;
+		while (!inInput.tryPushMessage(ioMessage, BenchmarkMessageType::BenchmarkMessage)) {
+			std::this_thread::yield();
+		}
+	}
+
+	static void stage(typename MessageQueue::ThreadChannelInput& inInput, Message& ioMessage, const uint32_t inSequence) {
+		ioMessage.sequence = inSequence;
+		ioMessage.timestamp = (inSequence % latencySampleInterval == 0) ? nowNanoseconds() : 0;
+		while (!inInput.stageMessage(ioMessage, BenchmarkMessageType::BenchmarkMessage)) {
+			std::this_thread::yield();
+		}
+	}
+
+	static void stage(typename MessageQueue::SharedChannelInput& inInput, Message& ioMessage, const uint32_t inSequence) {
+		push(inInput, ioMessage, inSequence);
+	}
+
+	static void commit(typename MessageQueue::ThreadChannelInput& inInput) {
+		inInput.commit();
+	}
+
+	static void commit(typename MessageQueue::SharedChannelInput&) {
+	}
+
+	template<typename INPUT>
+	static void produce(
+		INPUT inInput,
+		const Configuration& inConfiguration,
+		const uint32_t inProducer,
+		const uint32_t inNumMessages)
+	{
+		Message message;
+		memset(&message, 0, sizeof(message));
+		message.producer = inProducer;
+
+		if (inConfiguration.pattern == Pattern::Steady) {
+			for (uint32_t sequence = 0; sequence < inNumMessages; ++sequence) {
+				push(inInput, message, sequence);
+			}
+			return;
+		}
+
+		for (uint32_t sequence = 0; sequence < inNumMessages;) {
+			const uint32_t burstEnd = std::min(sequence + burstLength, inNumMessages);
+			for (; sequence < burstEnd; ++sequence) {
+				stage(inInput, message, sequence);
+			}
+			commit(inInput);
+
+			const auto pauseEnd = std::chrono::steady_clock::now() + burstPause;
+			while (std::chrono::steady_clock::now() < pauseEnd) {
+				std::this_thread::yield();
+			}
+		}
+	}
+};
+
+template<uint32_t SIZE, uint32_t BYTES>
+Result runNotify(const Configuration& inConfiguration) {
+	switch (inConfiguration.notify) {
+		case Notify::BlockingWait:
+			return Benchmark<SIZE, BYTES, BenchmarkTraits<SIZE, true, false>>::run(inConfiguration);
+#if defined(__linux__)
+		case Notify::EventFd:
+			return Benchmark<SIZE, BYTES, BenchmarkTraits<SIZE, false, true>>::run(inConfiguration);
+#endif
+		default:
+			return Benchmark<SIZE, BYTES, BenchmarkTraits<SIZE, false, false>>::run(inConfiguration);
+	}
+}
+
+template<uint32_t SIZE>
+Result runMessageBytes(const Configuration& inConfiguration) {
+	switch (inConfiguration.messageBytes) {
+		case 16:
+			return runNotify<SIZE, 16>(inConfiguration);
+		case 64:
+			return runNotify<SIZE, 64>(inConfiguration);
+		default:
+			return runNotify<SIZE, 256>(inConfiguration);
+	}
+}
+
+Result runBenchmark(const Configuration& inConfiguration) {
+	switch (inConfiguration.channelSize) {
+		case 64:
+			return runMessageBytes<64>(inConfiguration);
+		case 1024:
+			return runMessageBytes<1024>(inConfiguration);
+		default:
+			return runMessageBytes<4096>(inConfiguration);
+	}
+}
+
+const char* engineName(const Engine inEngine) {
+	return (inEngine == Engine::ThreadChannels) ? "thread" : "shared";
+}
+
+const char* patternName(const Pattern inPattern) {
+	return (inPattern == Pattern::Steady) ? "steady" : "burst";
+}
+
+const char* notifyName(const Notify inNotify) {
+	switch (inNotify) {
+		case Notify::BlockingWait:
+			return "wait";
+		case Notify::EventFd:
+			return "eventfd";
+		default:
+			return "none";
+	}
+}
+
+void printResult(const bool inJson, const bool inFirst, const Configuration& inConfiguration, const Result& inResult) {
+	const uint32_t numMessages = inConfiguration.numMessages / inConfiguration.numProducers * inConfiguration.numProducers;
+	const double messagesPerSecond = numMessages / inResult.seconds;
+	if (inJson) {
+		fprintf(stdout, "%s\n  {\"engine\": \"%s\", \"producers\": %u, \"size\": %u, \"message_bytes\": %u, "
+			"\"pinned\": %u, \"pattern\": \"%s\", \"notify\": \"%s\", \"messages\": %u, \"seconds\": %.6f, "
+			"\"msgs_per_sec\": %.0f, \"p50_ns\": %llu, \"p99_ns\": %llu, \"p999_ns\": %llu}",
+			inFirst ? "" : ",", engineName(inConfiguration.engine), inConfiguration.numProducers,
+			inConfiguration.channelSize, inConfiguration.messageBytes, inConfiguration.pinned ? 1 : 0,
+			patternName(inConfiguration.pattern), notifyName(inConfiguration.notify), numMessages, inResult.seconds, messagesPerSecond,
+			static_cast<unsigned long long>(inResult.p50), static_cast<unsigned long long>(inResult.p99),
+			static_cast<unsigned long long>(inResult.p999));
+	} else {
+		fprintf(stdout, "%s,%u,%u,%u,%u,%s,%s,%u,%.6f,%.0f,%llu,%llu,%llu\n",
+			engineName(inConfiguration.engine), inConfiguration.numProducers, inConfiguration.channelSize,
+			inConfiguration.messageBytes, inConfiguration.pinned ? 1 : 0, patternName(inConfiguration.pattern),
+			notifyName(inConfiguration.notify), numMessages, inResult.seconds, messagesPerSecond, static_cast<unsigned long long>(inResult.p50),
+			static_cast<unsigned long long>(inResult.p99), static_cast<unsigned long long>(inResult.p999));
+	}
+	fflush(stdout);
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+	bool json = false;
+	bool quick = false;
+	uint32_t numMessages = 1 << 18;
+	for (int arg = 1; arg < argc; ++arg) {
+		if (strcmp(argv[arg], "--format") == 0 && arg + 1 < argc) {
+			json = (strcmp(argv[++arg], "json") == 0);
+		} else if (strcmp(argv[arg], "--messages") == 0 && arg + 1 < argc) {
+			numMessages = static_cast<uint32_t>(strtoul(argv[++arg], nullptr, 10));
+		} else if (strcmp(argv[arg], "--quick") == 0) {
+			quick = true;
+		} else {
+			fprintf(stderr, "Usage: %s [--format csv|json] [--messages count] [--quick]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	const std::vector<uint32_t> producerCounts = quick ? std::vector<uint32_t>{1, 4} : std::vector<uint32_t>{1, 4, 16, 64};
+	const std::vector<uint32_t> channelSizes = quick ? std::vector<uint32_t>{1024} : std::vector<uint32_t>{64, 1024, 4096};
+	const std::vector<uint32_t> messageSizes = quick ? std::vector<uint32_t>{64} : std::vector<uint32_t>{16, 64, 256};
+#if defined(__linux__)
+	const std::vector<Notify> notifyModes = {Notify::None, Notify::BlockingWait, Notify::EventFd};
+#else
+	const std::vector<Notify> notifyModes = {Notify::None, Notify::BlockingWait};
+#endif
+
+	if (json) {
+		fprintf(stdout, "[");
+	} else {
+		fprintf(stdout, "engine,producers,size,message_bytes,pinned,pattern,notify,messages,seconds,msgs_per_sec,"
+			"p50_ns,p99_ns,p999_ns\n");
+	}
+
+	bool first = true;
+	for (const Engine engine : {Engine::ThreadChannels, Engine::SharedChannel}) {
+		for (const uint32_t numProducers : producerCounts) {
+			for (const uint32_t channelSize : channelSizes) {
+				for (const uint32_t messageBytes : messageSizes) {
+					for (const bool pinned : {false, true}) {
+						for (const Pattern pattern : {Pattern::Steady, Pattern::Burst}) {
+							for (const Notify notify : notifyModes) {
+								const Configuration configuration = {engine, numProducers, channelSize, messageBytes, 
+									pinned, pattern, notify, numMessages};
+								const Result result = runBenchmark(configuration);
+								if (result.pinFailed) {
+									fprintf(stderr, "Skipping pinned %s run with %u producers, threads could not be "
+										"pinned.\n", engineName(engine), numProducers);
+									continue;
+								}
+								printResult(json, first, configuration, result);
+								first = false;
+							}
+						}
+					}
+				}
+			}
+		}
+	}
+
+	if (json) {
+		fprintf(stdout, "\n]\n");
+	}
+	return 0;
+}
@@ -1,4 +1,5 @@
 #include <assert.h>
+#include <stdio.h>
 #include <thread>
 #include "LWMessageQueue.h"
 #include "Message.h"
@@ -94,24 +95,14 @@ void outputThreadRun(MessageQueue* messageQueue) {
 
 	while (receivedMessages < totalTestWantedMessages) {
 		// Channel 0
-		{
-			const uint32_t pendingMessages = channel0.getNumMessages();
-			for (uint32_t messageIndex = 0; messageIndex < pendingMessages; ++messageIndex) {
-				MessageQueue::MessageContainer messageContainer = channel0.popMessage();
-				++receivedMessages;
-				verifyMessage(0, messageContainer);
-			}
-		}
+		receivedMessages += channel0.drain([](const MessageQueue::MessageContainer& messageContainer) {
+			verifyMessage(0, messageContainer);
+		}, queueSize);
 
 		// Channel 1
-		{
-			const uint32_t pendingMessages = channel1.getNumMessages();
-			for (uint32_t messageIndex = 0; messageIndex < pendingMessages; ++messageIndex) {
-				MessageQueue::MessageContainer messageContainer = channel1.popMessage();
-				++receivedMessages;
-				verifyMessage(1, messageContainer);
-			}
-		}
+		receivedMessages += channel1.drain([](const MessageQueue::MessageContainer& messageContainer) {
+			verifyMessage(1, messageContainer);
+		}, queueSize);
 	}
 
 	fprintf(stdout, "Output thread done, received %u messages\n", receivedMessages);
@@ -0,0 +1,444 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 Marcus Spangenberg
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#pragma once
+
+#include "LWMessageQueue.h"
+
+namespace LWMessageQueue {
+
+/**
+	@brief
+		A static size broadcast channel, where every message pushed by a single input thread is read by each of 
+		CONSUMERS output threads.
+
+	@details
+		Messages are written once to a ring like the one of an LWMessageQueue channel, and read in place by all 
+		output threads. Each output thread has its own read cursor, on its own cache line, and the input thread 
+		may only reuse a slot once the slowest cursor has passed it. The input thread keeps a cached copy of the 
+		slowest cursor, and only looks at all cursors again when the cached value says the ring is full. Use it 
+		instead of one LWMessageQueue per subscriber, which copies every message once per subscriber.
+
+		Messages are pushed and read as in LWMessageQueue, with the same MESSAGE union and TYPES enum. A slow 
+		output thread holds back the input thread, so TRAITS::overflowPolicy may be OverflowPolicy::Reject or 
+		OverflowPolicy::Block. The ready bitmap, blocking wait, eventfd, shared channel, stats, latency tracing
+		and scheduled delivery of LWMessageQueue are not available, and enabling them in TRAITS does not compile.
+
+		Template parameters:
+		SIZE is the number of slots in the ring. Must be a power of two.
+		CONSUMERS is the number of output threads.
+		MESSAGE should be a union of all message structs.
+		TYPES should be a enum class with one entry per message type.
+		TRAITS is an optional configuration struct, see DefaultTraits.
+*/
+template<uint32_t SIZE, uint32_t CONSUMERS, typename MESSAGE, typename TYPES, typename TRAITS = DefaultTraits>
+class LWBroadcastQueue {
+public:
+	/** A message in the ring. When reading messages you get references to instances of this type. */
+	class MessageContainer {
+	public:
+		/** Get a reference to the message data, as the correct message type. */
+		template<typename T>
+		inline const T& getMessage() const noexcept;
+
+		/** Check if a message container contains a message of a specific type. */
+		inline TYPES getType() const noexcept;
+
+	private:
+		TYPES type;
+		MESSAGE message;
+		friend class LWBroadcastQueue<SIZE, CONSUMERS, MESSAGE, TYPES, TRAITS>;
+	};
+
+	/** The single input thread has one BroadcastInput instance. Use it to push messages to all output threads. */
+	class BroadcastInput {
+	public:
+		BroadcastInput(LWBroadcastQueue& inBroadcastQueue) noexcept;
+		BroadcastInput(const BroadcastInput& other) = default;
+		BroadcastInput& operator=(const BroadcastInput& other) = default;
+
+		/** Check if the ring is full, i.e. the slowest output thread has not read the oldest message. */
+		inline bool isFull() noexcept;
+
+		/** Push a message to all output threads. If the ring is full, TRAITS::overflowPolicy decides what happens, 
+			see OverflowPolicy. Only one thread may push messages.
+			@param inMessage Message data from the MESSAGE union.
+			@param inType Message type from the TYPES enum.
+		*/
+		template<typename T>
+		void pushMessage(const T& inMessage, const TYPES inType) noexcept;
+
+		/** Push a message if the ring is not full. Never waits.
+			@return True if the message was pushed.
+		*/
+		template<typename T>
+		bool tryPushMessage(const T& inMessage, const TYPES inType) noexcept;
+
+		/** Reserve a slot for a message of type T, and get a reference to its uninitialized message data in place.
+			The message becomes visible to the output threads on the next publish() or pushMessage(). A full ring 
+			is handled as in pushMessage(), except that with OverflowPolicy::Reject the user must make sure the 
+			ring is not full before calling.
+		*/
+		template<typename T>
+		T& reserve(const TYPES inType) noexcept;
+
+		/** Publish reserved messages to the output threads, with a single store. */
+		inline void publish() noexcept;
+
+	private:
+		LWBroadcastQueue& broadcastQueue;
+	};
+
+	/** Each output thread has one BroadcastOutput instance, with its own read cursor. Use it to read messages. */
+	class BroadcastOutput {
+	public:
+		BroadcastOutput(LWBroadcastQueue& inBroadcastQueue, const uint32_t inConsumer) noexcept;
+		BroadcastOutput(const BroadcastOutput& other) = default;
+		BroadcastOutput& operator=(const BroadcastOutput& other) = default;
+
+		/** Get number of messages this output thread has not read yet. */
+		inline uint32_t getNumMessages() noexcept;
+
+		/** Pop the next message, as a copy. The user must make sure that there are pending messages. */
+		inline MessageContainer popMessage() noexcept;
+
+		/** Get a reference to the next message without copying or removing it. The user must make sure that there
+			are pending messages. The reference is valid until the message is released.
+		*/
+		inline const MessageContainer& peek() noexcept;
+
+		/** Move this output thread's cursor past the next inNumMessages messages. The messages must have been seen
+			as pending, through getNumMessages() or peek(). The slot is reused once all output threads have 
+			released it.
+		*/
+		inline void release(const uint32_t inNumMessages) noexcept;
+
+		/** Call inFunction(const MessageContainer&) for up to inMaxMessages pending messages, in order. Messages 
+			are passed by reference to their slots in the ring, so the reference must not be kept after inFunction
+			returns. The cursor is published once, after the last call. It is safe to call with no pending 
+			messages.
+			@return Number of messages processed.
+		*/
+		template<typename F>
+		uint32_t drain(F&& inFunction, const uint32_t inMaxMessages);
+
+	private:
+		LWBroadcastQueue& broadcastQueue;
+		uint32_t consumer;
+	};
+
+	LWBroadcastQueue() noexcept;
+	~LWBroadcastQueue() = default;
+
+	LWBroadcastQueue(const LWBroadcastQueue&) = delete;
+	LWBroadcastQueue& operator=(const LWBroadcastQueue&) = delete;
+	LWBroadcastQueue(const LWBroadcastQueue&&) = delete;
+	LWBroadcastQueue& operator=(const LWBroadcastQueue&&) = delete;
+
+	/** Get the input for the input thread. */
+	BroadcastInput getInput() noexcept;
+
+	/** Get the output of output thread inConsumer. */
+	BroadcastOutput getOutput(const uint32_t inConsumer) noexcept;
+
+	/** Number of slots in the ring. */
+	static constexpr uint32_t getSize() noexcept { return SIZE; }
+
+	/** Number of output threads. */
+	static constexpr uint32_t getNumConsumers() noexcept { return CONSUMERS; }
+
+private:
+	/** Producer side. Messages are staged at stagedWriteIndex and become visible to the output threads when 
+		writeIndex is moved up to it by commitStaged().
+	*/
+	inline bool isFull() noexcept;
+	inline bool makeRoom(const bool inWait) noexcept;
+	inline MessageContainer& stageBack() noexcept;
+	inline void commitStaged() noexcept;
+
+	/** Consumer side. */
+	inline uint32_t size(const uint32_t inConsumer) noexcept;
+	inline const MessageContainer& element(const uint32_t inIndex) const noexcept;
+
+	template<typename T>
+	static inline T& getMessageData(MessageContainer& inMessageContainer, const TYPES inType) noexcept;
+
+	/** Written by the input thread only. cachedMinReadIndex is the slowest cursor when last checked. */
+	struct alignas(TRAITS::cacheLineSize) ProducerState {
+		std::atomic<uint32_t> writeIndex{0};
+		uint32_t stagedWriteIndex = 0;
+		uint32_t cachedMinReadIndex = 0;
+	};
+
+	/** Written by one output thread only. cachedWriteIndex is the write position when last checked. */
+	struct alignas(TRAITS::cacheLineSize) ConsumerCursor {
+		std::atomic<uint32_t> readIndex{0};
+		uint32_t cachedWriteIndex = 0;
+	};
+
+	static constexpr uint32_t indexMask = SIZE - 1;
+
+	ProducerState producer;
+	ConsumerCursor cursors[CONSUMERS];
+	Internal::ChannelRing<MessageContainer, SIZE, TRAITS::cacheLineSize> ring;
+};
+
+template<uint32_t SIZE, uint32_t CONSUMERS, typename MESSAGE, typename TYPES, typename TRAITS>
+template<typename T>
+inline const T& LWBroadcastQueue<SIZE, CONSUMERS, MESSAGE, TYPES, TRAITS>::MessageContainer::getMessage() const noexcept {
+	return *reinterpret_cast<const T*>(&message);
+}
+
+template<uint32_t SIZE, uint32_t CONSUMERS, typename MESSAGE, typename TYPES, typename TRAITS>
+inline TYPES LWBroadcastQueue<SIZE, CONSUMERS, MESSAGE, TYPES, TRAITS>::MessageContainer::getType() const noexcept {
+	return type;
+}
+
+template<uint32_t SIZE, uint32_t CONSUMERS, typename MESSAGE, typename TYPES, typename TRAITS>
+LWBroadcastQueue<SIZE, CONSUMERS, MESSAGE, TYPES, TRAITS>::BroadcastInput::BroadcastInput(
+	LWBroadcastQueue& inBroadcastQueue) noexcept
+	: broadcastQueue(inBroadcastQueue)
+{
+}
+
+template<uint32_t SIZE, uint32_t CONSUMERS, typename MESSAGE, typename TYPES, typename TRAITS>
+inline bool LWBroadcastQueue<SIZE, CONSUMERS, MESSAGE, TYPES, TRAITS>::BroadcastInput::isFull() noexcept {
+	return broadcastQueue.isFull();
+}
+
+template<uint32_t SIZE, uint32_t CONSUMERS, typename MESSAGE, typename TYPES, typename TRAITS>
+template<typename T>
+void LWBroadcastQueue<SIZE, CONSUMERS, MESSAGE, TYPES, TRAITS>::BroadcastInput::pushMessage(
+	const T& inMessage,
+	const TYPES type) noexcept
+{
+	if (!broadcastQueue.makeRoom(true)) {
+		assert(!"Pushing to a full broadcast queue.");
+		return;
+	}
+
+	getMessageData<T>(broadcastQueue.stageBack(), type) = inMessage;
+	broadcastQueue.commitStaged();
+}
+
+template<uint32_t SIZE, uint32_t CONSUMERS, typename MESSAGE, typename TYPES, typename TRAITS>
+template<typename T>
+bool LWBroadcastQueue<SIZE, CONSUMERS, MESSAGE, TYPES, TRAITS>::BroadcastInput::tryPushMessage(
+	const T& inMessage,
+	const TYPES type) noexcept
+{
+	if (!broadcastQueue.makeRoom(false)) {
+		return false;
+	}
+
+	getMessageData<T>(broadcastQueue.stageBack(), type) = inMessage;
+	broadcastQueue.commitStaged();
+	return true;
+}
+
+template<uint32_t SIZE, uint32_t CONSUMERS, typename MESSAGE, typename TYPES, typename TRAITS>
+template<typename T>
+T& LWBroadcastQueue<SIZE, CONSUMERS, MESSAGE, TYPES, TRAITS>::BroadcastInput::reserve(const TYPES type) noexcept {
+	const bool hasRoom = broadcastQueue.makeRoom(true);
+	assert(hasRoom);
+	(void)hasRoom;
+
+	return getMessageData<T>(broadcastQueue.stageBack(), type);
+}
+
+template<uint32_t SIZE, uint32_t CONSUMERS, typename MESSAGE, typename TYPES, typename TRAITS>
+inline void LWBroadcastQueue<SIZE, CONSUMERS, MESSAGE, TYPES, TRAITS>::BroadcastInput::publish() noexcept {
+	broadcastQueue.commitStaged();
+}
+
+template<uint32_t SIZE, uint32_t CONSUMERS, typename MESSAGE, typename TYPES, typename TRAITS>
+LWBroadcastQueue<SIZE, CONSUMERS, MESSAGE, TYPES, TRAITS>::BroadcastOutput::BroadcastOutput(
+	LWBroadcastQueue& inBroadcastQueue,
+	const uint32_t inConsumer) noexcept
+	: broadcastQueue(inBroadcastQueue)
+	, consumer(inConsumer)
+{
+	assert(inConsumer < CONSUMERS);
+}
+
+template<uint32_t SIZE, uint32_t CONSUMERS, typename MESSAGE, typename TYPES, typename TRAITS>
+inline uint32_t LWBroadcastQueue<SIZE, CONSUMERS, MESSAGE, TYPES, TRAITS>::BroadcastOutput::getNumMessages() noexcept {
+	return broadcastQueue.size(consumer);
+}
+
+template<uint32_t SIZE, uint32_t CONSUMERS, typename MESSAGE, typename TYPES, typename TRAITS>
+inline typename LWBroadcastQueue<SIZE, CONSUMERS, MESSAGE, TYPES, TRAITS>::MessageContainer 
+LWBroadcastQueue<SIZE, CONSUMERS, MESSAGE, TYPES, TRAITS>::BroadcastOutput::popMessage() noexcept {
+	const MessageContainer returnElement = peek();
+	release(1);
+	return returnElement;
+}
+
+template<uint32_t SIZE, uint32_t CONSUMERS, typename MESSAGE, typename TYPES, typename TRAITS>
+inline const typename LWBroadcastQueue<SIZE, CONSUMERS, MESSAGE, TYPES, TRAITS>::MessageContainer& 
+LWBroadcastQueue<SIZE, CONSUMERS, MESSAGE, TYPES, TRAITS>::BroadcastOutput::peek() noexcept {
+	const uint32_t readIndex = broadcastQueue.cursors[consumer].readIndex.load(std::memory_order_relaxed);
+	assert(broadcastQueue.size(consumer) != 0);
+
+	return broadcastQueue.element(readIndex);
+}
+
+template<uint32_t SIZE, uint32_t CONSUMERS, typename MESSAGE, typename TYPES, typename TRAITS>
+inline void LWBroadcastQueue<SIZE, CONSUMERS, MESSAGE, TYPES, TRAITS>::BroadcastOutput::release(
+	const uint32_t inNumMessages) noexcept
+{
+	ConsumerCursor& cursor = broadcastQueue.cursors[consumer];
+	const uint32_t readIndex = cursor.readIndex.load(std::memory_order_relaxed);
+	assert(cursor.cachedWriteIndex - readIndex >= inNumMessages);
+
+	cursor.readIndex.store(readIndex + inNumMessages, std::memory_order_release);
+}
+
+template<uint32_t SIZE, uint32_t CONSUMERS, typename MESSAGE, typename TYPES, typename TRAITS>
+template<typename F>
+uint32_t LWBroadcastQueue<SIZE, CONSUMERS, MESSAGE, TYPES, TRAITS>::BroadcastOutput::drain(
+	F&& inFunction,
+	const uint32_t inMaxMessages)
+{
+	const uint32_t numMessages = std::min(broadcastQueue.size(consumer), inMaxMessages);
+	if (numMessages == 0) {
+		return 0;
+	}
+
+	ConsumerCursor& cursor = broadcastQueue.cursors[consumer];
+	const uint32_t readIndex = cursor.readIndex.load(std::memory_order_relaxed);
+	for (uint32_t index = 0; index < numMessages; ++index) {
+		inFunction(broadcastQueue.element(readIndex + index));
+	}
+	cursor.readIndex.store(readIndex + numMessages, std::memory_order_release);
+	return numMessages;
+}
+
+template<uint32_t SIZE, uint32_t CONSUMERS, typename MESSAGE, typename TYPES, typename TRAITS>
+LWBroadcastQueue<SIZE, CONSUMERS, MESSAGE, TYPES, TRAITS>::LWBroadcastQueue() noexcept {
+	static_assert(Internal::isPowerOfTwo(SIZE), "Template parameter SIZE must be a power of two.");
+	static_assert(SIZE <= 0x80000000u, "Template parameter SIZE must fit the free running 32 bit indices.");
+	static_assert(CONSUMERS > 0, "Template parameter CONSUMERS must be at least 1.");
+	static_assert(Internal::isPowerOfTwo(TRAITS::cacheLineSize), "TRAITS::cacheLineSize must be a power of two.");
+	static_assert(TRAITS::overflowPolicy != OverflowPolicy::OverwriteOldest,
+		"LWBroadcastQueue does not support OverflowPolicy::OverwriteOldest.");
+	static_assert(!TRAITS::enableReadyBitmap && !TRAITS::enableBlockingWait,
+		"LWBroadcastQueue does not support the ready bitmap or blocking wait.");
+	static_assert(!TRAITS::enableStats && TRAITS::traceSampleInterval == 0 && !TRAITS::enableEventFd && 
+		TRAITS::sharedChannelSize == 0 && TRAITS::scheduledMessageCapacity == 0, "LWBroadcastQueue does not support stats, "
+		"latency tracing, the eventfd, the shared channel or scheduled delivery.");
+	assert(producer.writeIndex.is_lock_free());
+}
+
+template<uint32_t SIZE, uint32_t CONSUMERS, typename MESSAGE, typename TYPES, typename TRAITS>
+typename LWBroadcastQueue<SIZE, CONSUMERS, MESSAGE, TYPES, TRAITS>::BroadcastInput 
+LWBroadcastQueue<SIZE, CONSUMERS, MESSAGE, TYPES, TRAITS>::getInput() noexcept {
+	return BroadcastInput(*this);
+}
+
+template<uint32_t SIZE, uint32_t CONSUMERS, typename MESSAGE, typename TYPES, typename TRAITS>
+typename LWBroadcastQueue<SIZE, CONSUMERS, MESSAGE, TYPES, TRAITS>::BroadcastOutput 
+LWBroadcastQueue<SIZE, CONSUMERS, MESSAGE, TYPES, TRAITS>::getOutput(const uint32_t inConsumer) noexcept {
+	return BroadcastOutput(*this, inConsumer);
+}
+
+template<uint32_t SIZE, uint32_t CONSUMERS, typename MESSAGE, typename TYPES, typename TRAITS>
+inline bool LWBroadcastQueue<SIZE, CONSUMERS, MESSAGE, TYPES, TRAITS>::isFull() noexcept {
+	if (producer.stagedWriteIndex - producer.cachedMinReadIndex != SIZE) {
+		return false;
+	}
+
+	// The slowest cursor is the one furthest behind the write position.
+	uint32_t maxDistance = 0;
+	for (uint32_t consumer = 0; consumer < CONSUMERS; ++consumer) {
+		const uint32_t distance = producer.stagedWriteIndex - cursors[consumer].readIndex.load(std::memory_order_acquire);
+		maxDistance = std::max(maxDistance, distance);
+	}
+	producer.cachedMinReadIndex = producer.stagedWriteIndex - maxDistance;
+	return maxDistance == SIZE;
+}
+
+template<uint32_t SIZE, uint32_t CONSUMERS, typename MESSAGE, typename TYPES, typename TRAITS>
+inline bool LWBroadcastQueue<SIZE, CONSUMERS, MESSAGE, TYPES, TRAITS>::makeRoom(const bool inWait) noexcept {
+	if (!isFull()) {
+		return true;
+	}
+	commitStaged();
+
+	if constexpr (TRAITS::overflowPolicy == OverflowPolicy::Block) {
+		if (!inWait) {
+			return false;
+		}
+		for (uint32_t spin = 0; isFull(); ++spin) {
+			Internal::backoff(spin);
+		}
+		return true;
+	} else {
+		(void)inWait;
+		return false;
+	}
+}
+
+template<uint32_t SIZE, uint32_t CONSUMERS, typename MESSAGE, typename TYPES, typename TRAITS>
+inline typename LWBroadcastQueue<SIZE, CONSUMERS, MESSAGE, TYPES, TRAITS>::MessageContainer& 
+LWBroadcastQueue<SIZE, CONSUMERS, MESSAGE, TYPES, TRAITS>::stageBack() noexcept {
+	assert(producer.stagedWriteIndex - producer.cachedMinReadIndex < SIZE);
+	return ring.elements[producer.stagedWriteIndex++ & indexMask];
+}
+
+template<uint32_t SIZE, uint32_t CONSUMERS, typename MESSAGE, typename TYPES, typename TRAITS>
+inline void LWBroadcastQueue<SIZE, CONSUMERS, MESSAGE, TYPES, TRAITS>::commitStaged() noexcept {
+	if (producer.writeIndex.load(std::memory_order_relaxed) != producer.stagedWriteIndex) {
+		producer.writeIndex.store(producer.stagedWriteIndex, std::memory_order_release);
+	}
+}
+
+template<uint32_t SIZE, uint32_t CONSUMERS, typename MESSAGE, typename TYPES, typename TRAITS>
+inline uint32_t LWBroadcastQueue<SIZE, CONSUMERS, MESSAGE, TYPES, TRAITS>::size(const uint32_t inConsumer) noexcept {
+	ConsumerCursor& cursor = cursors[inConsumer];
+	cursor.cachedWriteIndex = producer.writeIndex.load(std::memory_order_acquire);
+	return cursor.cachedWriteIndex - cursor.readIndex.load(std::memory_order_relaxed);
+}
+
+template<uint32_t SIZE, uint32_t CONSUMERS, typename MESSAGE, typename TYPES, typename TRAITS>
+inline const typename LWBroadcastQueue<SIZE, CONSUMERS, MESSAGE, TYPES, TRAITS>::MessageContainer& 
+LWBroadcastQueue<SIZE, CONSUMERS, MESSAGE, TYPES, TRAITS>::element(const uint32_t inIndex) const noexcept {
+	return ring.elements[inIndex & indexMask];
+}
+
+template<uint32_t SIZE, uint32_t CONSUMERS, typename MESSAGE, typename TYPES, typename TRAITS>
+template<typename T>
+inline T& LWBroadcastQueue<SIZE, CONSUMERS, MESSAGE, TYPES, TRAITS>::getMessageData(
+	MessageContainer& inMessageContainer,
+	const TYPES type) noexcept
+{
+	static_assert(sizeof(T) <= sizeof(MESSAGE), "Type T might not be part of union MESSAGE. Size mismatch.");
+	static_assert(alignof(MESSAGE) % alignof(T) == 0, "Type T might not be part of union MESSAGE. Alignment mismatch.");
+	inMessageContainer.type = type;
+
+	return *reinterpret_cast<T*>(&inMessageContainer.message);
+}
+
+} // namespace LWMessageQueue
@@ -0,0 +1,540 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 Marcus Spangenberg
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#pragma once
+
+#include <functional>
+#include <type_traits>
+#include "LWMessageQueue.h"
+
+namespace LWMessageQueue {
+
+/**
+	@brief
+		A static size message queue with the same threading model as LWMessageQueue, where every message carries a 
+		key and a new message replaces the pending message with the same key instead of being queued behind it.
+
+	@details
+		Each channel has SIZE slots, one per distinct key, found through a fixed size open addressed index owned by
+		the input thread. Pushing to a key whose slot is still pending overwrites the message in place. Otherwise 
+		the slot is marked pending and its index is appended to a ring of pending slots, which can never overflow
+		since a slot is pending at most once. The output thread therefore sees keys in the order they first became
+		pending, each with its latest message, and at most once per drain(). Memory is bounded by SIZE, and the 
+		work of the output thread grows with the number of distinct keys updated, not with the update rate. Use it
+		for state and price updates where only the latest value per key matters.
+
+		A slot is overwritten while the output thread may be copying it, so each slot has a version number that is
+		odd while the input thread is writing, and the output thread copies the message again if it changed during
+		the copy. MESSAGE must therefore be trivially copyable. TRAITS::overflowPolicy must be left at 
+		OverflowPolicy::Reject, since pushes handle a full channel as described below. The ready bitmap, blocking
+		wait, eventfd, shared channel, stats, latency tracing and scheduled delivery of LWMessageQueue are not 
+		available, and enabling them in TRAITS does not compile.
+
+		Keys are recycled. When the output thread has read the latest message of a key and no newer one arrived
+		meanwhile, it hands the slot back on a free ring. Once all SIZE slots have been used, a push to a new key 
+		takes a slot off the free ring and removes its old key from the index by backward shift deletion, so 
+		probe sequences stay as short as if the old key had never been there. Any number of distinct keys can 
+		therefore go through a channel over time, as long as no more than SIZE have a message pending at once. A 
+		push to a new key while all SIZE keys are pending waits in pushMessage(), and fails in tryPushMessage(). 
+		The hand back costs the output thread a compare and swap and a sequentially consistent load per message.
+
+		Template parameters:
+		SIZE is the number of distinct keys per channel. Must be a power of two.
+		CHANNELS is the number of channels, i.e. the number of input/producer threads.
+		MESSAGE should be a union of all message structs.
+		TYPES should be a enum class with one entry per message type.
+		KEY is the key type. Must be equality comparable and hashable with std::hash.
+		TRAITS is an optional configuration struct, see DefaultTraits.
+*/
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename KEY = uint64_t, 
+	typename TRAITS = DefaultTraits>
+class LWConflatingQueue {
+public:
+	/** The latest message of a key. When reading messages you get references to instances of this type. */
+	class MessageContainer {
+	public:
+		/** Get a reference to the message data, as the correct message type. */
+		template<typename T>
+		inline const T& getMessage() const noexcept;
+
+		/** Check if a message container contains a message of a specific type. */
+		inline TYPES getType() const noexcept;
+
+		/** The key the message was pushed with. */
+		inline const KEY& getKey() const noexcept;
+
+	private:
+		KEY key;
+		TYPES type;
+		MESSAGE message;
+		friend class LWConflatingQueue<SIZE, CHANNELS, MESSAGE, TYPES, KEY, TRAITS>;
+	};
+
+	/** Each input thread has one ConflatingInput instance. Use it to push keyed messages. */
+	class ConflatingInput {
+	public:
+		ConflatingInput(LWConflatingQueue& inConflatingQueue, const uint32_t inChannel) noexcept;
+		ConflatingInput(const ConflatingInput& other) = default;
+		ConflatingInput& operator=(const ConflatingInput& other) = default;
+
+		/** Push a message for a key, replacing the message of that key if it has not been read yet. If the key is
+			new and the messages of all SIZE keys in use are still pending, waits until the output thread has read
+			one. Only one thread may push messages to a channel.
+			@param inKey Key of the message.
+			@param inMessage Message data from the MESSAGE union.
+			@param inType Message type from the TYPES enum.
+		*/
+		template<typename T>
+		void pushMessage(const KEY& inKey, const T& inMessage, const TYPES inType) noexcept;
+
+		/** Push a message for a key, unless it is a new key and the messages of all SIZE keys in use are still 
+			pending. Never waits.
+			@return True if the message was pushed.
+		*/
+		template<typename T>
+		bool tryPushMessage(const KEY& inKey, const T& inMessage, const TYPES inType) noexcept;
+
+		/** Get number of keys with a slot in the channel. Keys that have been read keep their slot until a new key
+			needs it.
+		*/
+		inline uint32_t getNumKeys() const noexcept;
+
+	private:
+		LWConflatingQueue& conflatingQueue;
+		uint32_t channel;
+	};
+
+	/** The output thread has one ConflatingOutput instance per channel. Use it to read the latest messages. */
+	class ConflatingOutput {
+	public:
+		ConflatingOutput(LWConflatingQueue& inConflatingQueue, const uint32_t inChannel) noexcept;
+		ConflatingOutput(const ConflatingOutput& other) = default;
+		ConflatingOutput& operator=(const ConflatingOutput& other) = default;
+
+		/** Get number of keys with a message that has not been read yet. */
+		inline uint32_t getNumMessages() noexcept;
+
+		/** Call inFunction(const MessageContainer&) with the latest message of up to inMaxMessages pending keys, in
+			the order the keys became pending. Each key is passed at most once per call, and a key pushed again 
+			during the call is passed by the next call, unless this call already copied that message. The message
+			is a copy, so pushes to the same key do not change it while inFunction runs, but the reference must 
+			not be kept after inFunction returns. It is safe to call with no pending keys.
+			@return Number of messages processed, which may be less than the pending keys counted before.
+		*/
+		template<typename F>
+		uint32_t drain(F&& inFunction, const uint32_t inMaxMessages);
+
+	private:
+		LWConflatingQueue& conflatingQueue;
+		uint32_t channel;
+	};
+
+	LWConflatingQueue() noexcept;
+	~LWConflatingQueue() = default;
+
+	LWConflatingQueue(const LWConflatingQueue&) = delete;
+	LWConflatingQueue& operator=(const LWConflatingQueue&) = delete;
+	LWConflatingQueue(const LWConflatingQueue&&) = delete;
+	LWConflatingQueue& operator=(const LWConflatingQueue&&) = delete;
+
+	/** Get the input of a channel, for its input thread. */
+	ConflatingInput getInput(const uint32_t inChannel) noexcept;
+
+	/** Get the output of a channel, for the output thread. */
+	ConflatingOutput getOutput(const uint32_t inChannel) noexcept;
+
+	/** Number of distinct keys per channel. */
+	static constexpr uint32_t getSize() noexcept { return SIZE; }
+
+	/** Number of channels. */
+	static constexpr uint32_t getNumChannels() noexcept { return CHANNELS; }
+
+private:
+	static constexpr uint32_t none = 0xffffffff;
+	static constexpr uint32_t indexMask = SIZE - 1;
+
+	/** Twice as many buckets as slots, so that probe sequences stay short when all keys are in use. */
+	static constexpr uint32_t numBuckets = SIZE * 2;
+	static constexpr uint32_t bucketMask = numBuckets - 1;
+
+	/** States of a slot. A slot is pending from the push that appended it to the pending ring until the output 
+		thread takes it off, then being read until the output thread has copied the message. A push during the 
+		read makes it pending again, and appends it again.
+	*/
+	static constexpr uint32_t slotIdle = 0;
+	static constexpr uint32_t slotPending = 1;
+	static constexpr uint32_t slotReading = 2;
+
+	/** The message of one key. version is odd while the input thread writes message. isFree is set by the output
+		thread when it appends the slot to the free ring, and cleared by the input thread when it takes it off, 
+		so that a slot is on the free ring at most once. passedVersion is the version of the message the output
+		thread passed last, and is only used by the output thread.
+	*/
+	struct Slot {
+		std::atomic<uint32_t> version{0};
+		std::atomic<uint32_t> state{slotIdle};
+		std::atomic<uint32_t> isFree{0};
+		uint32_t passedVersion = 0;
+		MessageContainer container;
+	};
+
+	/** Written by the input thread only. buckets maps keys to slots. numKeys keys are in the index, and the first
+		numSlots slots have been handed out.
+	*/
+	struct alignas(TRAITS::cacheLineSize) ProducerState {
+		std::atomic<uint32_t> writeIndex{0};
+		uint32_t numKeys = 0;
+		uint32_t numSlots = 0;
+		uint32_t freeReadIndex = 0;
+	};
+
+	/** Written by the output thread only. */
+	struct alignas(TRAITS::cacheLineSize) ConsumerState {
+		uint32_t readIndex = 0;
+		std::atomic<uint32_t> freeWriteIndex{0};
+	};
+
+	struct Channel {
+		ProducerState producer;
+		ConsumerState consumer;
+		uint32_t buckets[numBuckets];
+		Internal::ChannelRing<uint32_t, SIZE, TRAITS::cacheLineSize> pendingRing;
+		/** Slots whose key has been read, from the output thread to the input thread. */
+		Internal::ChannelRing<uint32_t, SIZE, TRAITS::cacheLineSize> freeRing;
+		alignas(TRAITS::cacheLineSize) Slot slots[SIZE];
+	};
+
+	/** Producer side. @return The slot of inKey, or none if inKey is new and no slot is free. */
+	inline uint32_t findSlot(Channel& ioChannel, const KEY& inKey) noexcept;
+
+	/** Producer side. Take a slot off the free ring whose key has no pending message, and remove its key from 
+		the index. @return The slot, or none if there is no such slot.
+	*/
+	inline uint32_t reclaimSlot(Channel& ioChannel) noexcept;
+	template<typename T>
+	inline void writeSlot(Channel& ioChannel, const uint32_t inSlot, const T& inMessage, const TYPES inType) noexcept;
+
+	/** Consumer side. Copy the message of a slot, retrying while the input thread overwrites it.
+		@return The version of the copied message.
+	*/
+	static inline uint32_t readSlot(const Slot& inSlot, MessageContainer& outContainer) noexcept;
+
+	static inline uint32_t bucketOf(const KEY& inKey) noexcept;
+
+	template<typename T>
+	static inline T& getMessageData(MessageContainer& inMessageContainer, const TYPES inType) noexcept;
+
+	Internal::ChannelArray<Channel, CHANNELS> channels;
+};
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename KEY, typename TRAITS>
+template<typename T>
+inline const T& LWConflatingQueue<SIZE, CHANNELS, MESSAGE, TYPES, KEY, TRAITS>::MessageContainer::getMessage() const noexcept {
+	return *reinterpret_cast<const T*>(&message);
+}
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename KEY, typename TRAITS>
+inline TYPES LWConflatingQueue<SIZE, CHANNELS, MESSAGE, TYPES, KEY, TRAITS>::MessageContainer::getType() const noexcept {
+	return type;
+}
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename KEY, typename TRAITS>
+inline const KEY& LWConflatingQueue<SIZE, CHANNELS, MESSAGE, TYPES, KEY, TRAITS>::MessageContainer::getKey() const noexcept {
+	return key;
+}
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename KEY, typename TRAITS>
+LWConflatingQueue<SIZE, CHANNELS, MESSAGE, TYPES, KEY, TRAITS>::ConflatingInput::ConflatingInput(
+	LWConflatingQueue& inConflatingQueue,
+	const uint32_t inChannel) noexcept
+	: conflatingQueue(inConflatingQueue)
+	, channel(inChannel)
+{
+	assert(inChannel < CHANNELS);
+}
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename KEY, typename TRAITS>
+template<typename T>
+void LWConflatingQueue<SIZE, CHANNELS, MESSAGE, TYPES, KEY, TRAITS>::ConflatingInput::pushMessage(
+	const KEY& inKey,
+	const T& inMessage,
+	const TYPES type) noexcept
+{
+	for (uint32_t spin = 0; !tryPushMessage(inKey, inMessage, type); ++spin) {
+		Internal::backoff(spin);
+	}
+}
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename KEY, typename TRAITS>
+template<typename T>
+bool LWConflatingQueue<SIZE, CHANNELS, MESSAGE, TYPES, KEY, TRAITS>::ConflatingInput::tryPushMessage(
+	const KEY& inKey,
+	const T& inMessage,
+	const TYPES type) noexcept
+{
+	Channel& conflatingChannel = conflatingQueue.channels[channel];
+	const uint32_t slot = conflatingQueue.findSlot(conflatingChannel, inKey);
+	if (slot == none) {
+		return false;
+	}
+
+	conflatingQueue.writeSlot(conflatingChannel, slot, inMessage, type);
+	return true;
+}
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename KEY, typename TRAITS>
+inline uint32_t LWConflatingQueue<SIZE, CHANNELS, MESSAGE, TYPES, KEY, TRAITS>::ConflatingInput::getNumKeys() const noexcept {
+	return conflatingQueue.channels[channel].producer.numKeys;
+}
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename KEY, typename TRAITS>
+LWConflatingQueue<SIZE, CHANNELS, MESSAGE, TYPES, KEY, TRAITS>::ConflatingOutput::ConflatingOutput(
+	LWConflatingQueue& inConflatingQueue,
+	const uint32_t inChannel) noexcept
+	: conflatingQueue(inConflatingQueue)
+	, channel(inChannel)
+{
+	assert(inChannel < CHANNELS);
+}
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename KEY, typename TRAITS>
+inline uint32_t LWConflatingQueue<SIZE, CHANNELS, MESSAGE, TYPES, KEY, TRAITS>::ConflatingOutput::getNumMessages() noexcept {
+	const Channel& conflatingChannel = conflatingQueue.channels[channel];
+	return conflatingChannel.producer.writeIndex.load(std::memory_order_acquire) - conflatingChannel.consumer.readIndex;
+}
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename KEY, typename TRAITS>
+template<typename F>
+uint32_t LWConflatingQueue<SIZE, CHANNELS, MESSAGE, TYPES, KEY, TRAITS>::ConflatingOutput::drain(
+	F&& inFunction,
+	const uint32_t inMaxMessages)
+{
+	// Keys pushed again during the drain are appended after this snapshot, so each key is passed at most once.
+	const uint32_t numMessages = std::min(getNumMessages(), inMaxMessages);
+	Channel& conflatingChannel = conflatingQueue.channels[channel];
+	const uint32_t readIndex = conflatingChannel.consumer.readIndex;
+
+	MessageContainer container;
+	uint32_t numPassed = 0;
+	for (uint32_t index = 0; index < numMessages; ++index) {
+		const uint32_t slotIndex = conflatingChannel.pendingRing.elements[(readIndex + index) & indexMask];
+		Slot& slot = conflatingChannel.slots[slotIndex];
+
+		// Once the slot is no longer pending, the next push to the key appends the slot again, and may reuse this 
+		// ring entry. The exchange synchronizes with the exchange of the last push that found the slot pending, so
+		// the copy below sees its message or a newer one.
+		slot.state.exchange(slotReading, std::memory_order_acq_rel);
+		const uint32_t version = readSlot(slot, container);
+
+		// If no push came in during the copy, the key has nothing left to deliver, and its slot can be reused. 
+		// The compare and swap and the load of isFree pair with the store and the load in reclaimSlot(), so that
+		// either the input thread sees the slot idle, or the slot is appended again here.
+		uint32_t state = slotReading;
+		if (slot.state.compare_exchange_strong(state, slotIdle, std::memory_order_seq_cst) && 
+			slot.isFree.load(std::memory_order_seq_cst) == 0) 
+		{
+			slot.isFree.store(1, std::memory_order_relaxed);
+			const uint32_t freeWriteIndex = conflatingChannel.consumer.freeWriteIndex.load(std::memory_order_relaxed);
+			conflatingChannel.freeRing.elements[freeWriteIndex & indexMask] = slotIndex;
+			conflatingChannel.consumer.freeWriteIndex.store(freeWriteIndex + 1, std::memory_order_release);
+		}
+
+		// A push during an earlier copy appended the slot again, but that copy may already have had its message.
+		if (version != slot.passedVersion) {
+			slot.passedVersion = version;
+			inFunction(static_cast<const MessageContainer&>(container));
+			++numPassed;
+		}
+	}
+	conflatingChannel.consumer.readIndex = readIndex + numMessages;
+	return numPassed;
+}
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename KEY, typename TRAITS>
+LWConflatingQueue<SIZE, CHANNELS, MESSAGE, TYPES, KEY, TRAITS>::LWConflatingQueue() noexcept {
+	static_assert(Internal::isPowerOfTwo(SIZE), "Template parameter SIZE must be a power of two.");
+	static_assert(SIZE <= 0x40000000u, "Template parameter SIZE must leave room for twice as many buckets.");
+	static_assert(CHANNELS > 0, "Template parameter CHANNELS must be at least 1.");
+	static_assert(Internal::isPowerOfTwo(TRAITS::cacheLineSize), "TRAITS::cacheLineSize must be a power of two.");
+	static_assert(!TRAITS::enableReadyBitmap && !TRAITS::enableBlockingWait,
+		"LWConflatingQueue does not support the ready bitmap or blocking wait.");
+	static_assert(!TRAITS::enableStats && TRAITS::traceSampleInterval == 0 && !TRAITS::enableEventFd && 
+		TRAITS::sharedChannelSize == 0 && TRAITS::scheduledMessageCapacity == 0, "LWConflatingQueue does not support stats, "
+		"latency tracing, the eventfd, the shared channel or scheduled delivery.");
+	static_assert(TRAITS::overflowPolicy == OverflowPolicy::Reject, "LWConflatingQueue does not use "
+		"TRAITS::overflowPolicy, pushMessage() waits and tryPushMessage() fails when all keys are pending.");
+	static_assert(std::is_trivially_copyable<MESSAGE>::value && std::is_trivially_copyable<KEY>::value,
+		"LWConflatingQueue copies messages that may be overwritten during the copy, so MESSAGE and KEY must be "
+		"trivially copyable.");
+
+	for (uint32_t channel = 0; channel < CHANNELS; ++channel) {
+		std::fill(std::begin(channels[channel].buckets), std::end(channels[channel].buckets), none);
+	}
+	assert(channels[0].producer.writeIndex.is_lock_free());
+}
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename KEY, typename TRAITS>
+typename LWConflatingQueue<SIZE, CHANNELS, MESSAGE, TYPES, KEY, TRAITS>::ConflatingInput 
+LWConflatingQueue<SIZE, CHANNELS, MESSAGE, TYPES, KEY, TRAITS>::getInput(const uint32_t inChannel) noexcept {
+	return ConflatingInput(*this, inChannel);
+}
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename KEY, typename TRAITS>
+typename LWConflatingQueue<SIZE, CHANNELS, MESSAGE, TYPES, KEY, TRAITS>::ConflatingOutput 
+LWConflatingQueue<SIZE, CHANNELS, MESSAGE, TYPES, KEY, TRAITS>::getOutput(const uint32_t inChannel) noexcept {
+	return ConflatingOutput(*this, inChannel);
+}
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename KEY, typename TRAITS>
+inline uint32_t LWConflatingQueue<SIZE, CHANNELS, MESSAGE, TYPES, KEY, TRAITS>::findSlot(
+	Channel& ioChannel,
+	const KEY& inKey) noexcept
+{
+	// Linear probing. Keys are removed by backward shift deletion, so the first empty bucket ends the search.
+	uint32_t bucket = bucketOf(inKey);
+	for (; ioChannel.buckets[bucket] != none; bucket = (bucket + 1) & bucketMask) {
+		const uint32_t slot = ioChannel.buckets[bucket];
+		if (ioChannel.slots[slot].container.key == inKey) {
+			return slot;
+		}
+	}
+
+	uint32_t newSlot;
+	if (ioChannel.producer.numSlots < SIZE) {
+		newSlot = ioChannel.producer.numSlots++;
+	} else {
+		newSlot = reclaimSlot(ioChannel);
+		if (newSlot == none) {
+			return none;
+		}
+		// Removing the old key may have shifted the buckets after it, so look for the empty bucket again.
+		for (bucket = bucketOf(inKey); ioChannel.buckets[bucket] != none; bucket = (bucket + 1) & bucketMask) {
+		}
+	}
+	++ioChannel.producer.numKeys;
+	ioChannel.slots[newSlot].container.key = inKey;
+	ioChannel.buckets[bucket] = newSlot;
+	return newSlot;
+}
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename KEY, typename TRAITS>
+inline uint32_t LWConflatingQueue<SIZE, CHANNELS, MESSAGE, TYPES, KEY, TRAITS>::reclaimSlot(Channel& ioChannel) noexcept {
+	const uint32_t freeWriteIndex = ioChannel.consumer.freeWriteIndex.load(std::memory_order_acquire);
+	while (ioChannel.producer.freeReadIndex != freeWriteIndex) {
+		const uint32_t slot = ioChannel.freeRing.elements[ioChannel.producer.freeReadIndex++ & indexMask];
+
+		// The key may have been pushed again since the slot was appended. Then the output thread appends it 
+		// again once it has read that message.
+		Slot& freeSlot = ioChannel.slots[slot];
+		freeSlot.isFree.store(0, std::memory_order_seq_cst);
+		if (freeSlot.state.load(std::memory_order_seq_cst) != slotIdle) {
+			continue;
+		}
+
+		// Backward shift deletion. Move each following key of the probe run into the hole, unless the hole lies 
+		// before its home bucket, until an empty bucket ends the run.
+		uint32_t hole = bucketOf(freeSlot.container.key);
+		while (ioChannel.buckets[hole] != slot) {
+			hole = (hole + 1) & bucketMask;
+		}
+		for (uint32_t bucket = (hole + 1) & bucketMask; ioChannel.buckets[bucket] != none; 
+			bucket = (bucket + 1) & bucketMask) 
+		{
+			const uint32_t home = bucketOf(ioChannel.slots[ioChannel.buckets[bucket]].container.key);
+			if (((bucket - home) & bucketMask) >= ((bucket - hole) & bucketMask)) {
+				ioChannel.buckets[hole] = ioChannel.buckets[bucket];
+				hole = bucket;
+			}
+		}
+		ioChannel.buckets[hole] = none;
+		--ioChannel.producer.numKeys;
+		return slot;
+	}
+	return none;
+}
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename KEY, typename TRAITS>
+template<typename T>
+inline void LWConflatingQueue<SIZE, CHANNELS, MESSAGE, TYPES, KEY, TRAITS>::writeSlot(
+	Channel& ioChannel,
+	const uint32_t inSlot,
+	const T& inMessage,
+	const TYPES type) noexcept
+{
+	Slot& slot = ioChannel.slots[inSlot];
+	const uint32_t version = slot.version.load(std::memory_order_relaxed);
+	slot.version.store(version + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	getMessageData<T>(slot.container, type) = inMessage;
+	slot.version.store(version + 2, std::memory_order_release);
+
+	// If the slot was still pending, the output thread has not taken it off the ring yet, and will read the new
+	// message when it does. Otherwise append it, also when the output thread is reading the previous message.
+	if (slot.state.exchange(slotPending, std::memory_order_acq_rel) != slotPending) {
+		const uint32_t writeIndex = ioChannel.producer.writeIndex.load(std::memory_order_relaxed);
+		ioChannel.pendingRing.elements[writeIndex & indexMask] = inSlot;
+		ioChannel.producer.writeIndex.store(writeIndex + 1, std::memory_order_release);
+	}
+}
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename KEY, typename TRAITS>
+inline uint32_t LWConflatingQueue<SIZE, CHANNELS, MESSAGE, TYPES, KEY, TRAITS>::readSlot(
+	const Slot& inSlot,
+	MessageContainer& outContainer) noexcept
+{
+	for (uint32_t spin = 0; ; ++spin) {
+		const uint32_t version = inSlot.version.load(std::memory_order_acquire);
+		if ((version & 1) == 0) {
+			outContainer = inSlot.container;
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if (inSlot.version.load(std::memory_order_relaxed) == version) {
+				return version;
+			}
+		}
+		Internal::backoff(spin);
+	}
+}
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename KEY, typename TRAITS>
+inline uint32_t LWConflatingQueue<SIZE, CHANNELS, MESSAGE, TYPES, KEY, TRAITS>::bucketOf(const KEY& inKey) noexcept {
+	// std::hash of integers is often the identity, so spread the bits with a Fibonacci multiply.
+	const uint64_t hash = static_cast<uint64_t>(std::hash<KEY>()(inKey)) * 0x9e3779b97f4a7c15ull;
+	return static_cast<uint32_t>(hash >> 32) & bucketMask;
+}
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename KEY, typename TRAITS>
+template<typename T>
+inline T& LWConflatingQueue<SIZE, CHANNELS, MESSAGE, TYPES, KEY, TRAITS>::getMessageData(
+	MessageContainer& inMessageContainer,
+	const TYPES type) noexcept
+{
+	static_assert(sizeof(T) <= sizeof(MESSAGE), "Type T might not be part of union MESSAGE. Size mismatch.");
+	static_assert(alignof(MESSAGE) % alignof(T) == 0, "Type T might not be part of union MESSAGE. Alignment mismatch.");
+	inMessageContainer.type = type;
+
+	return *reinterpret_cast<T*>(&inMessageContainer.message);
+}
+
+} // namespace LWMessageQueue
@@ -24,285 +24,3893 @@ SOFTWARE.
 
 #pragma once
 
+#include <algorithm>
 #include <assert.h>
 #include <atomic>
+#include <chrono>
+#include <iterator>
+#include <new>
+#include <ostream>
+#include <stdexcept>
+#include <stddef.h>
 #include <stdint.h>
+#include <system_error>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+#if defined(__linux__)
+#include <errno.h>
+#include <linux/futex.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#else
+#include <condition_variable>
+#include <mutex>
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+// Keep the min and max macros of windows.h away from std::min and std::max.
+#if !defined(NOMINMAX)
+#define NOMINMAX
+#endif
+#if !defined(WIN32_LEAN_AND_MEAN)
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#endif
 
 namespace LWMessageQueue {
 
-/**
-	@brief
-		A static size message queue used to send messages from many input threads to a single output thread. Input 
-		and output operations are thread safe and wait-free as long as there is exactly one thread consuming messages. 
-		Messages are user defined POD type structs.
+/** A list of message types, passed as the MESSAGE template parameter instead of a union. The queue then derives 
+	the storage size and alignment from the types, and TYPES defaults to the smallest unsigned integer that can 
+	index the list. Messages are pushed with pushMessage(message) without a type argument, and read with 
+	MessageContainer::visit() or ThreadChannelOutput::dispatch().
+*/
+template<typename... MESSAGES>
+struct Messages {
+};
+
+/** Builds a visitor from a set of lambdas, one per message type, e.g. Overloaded{[](const Message1&) {}, ...}. */
+template<typename... FUNCTIONS>
+struct Overloaded : FUNCTIONS... {
+	using FUNCTIONS::operator()...;
+};
+
+template<typename... FUNCTIONS>
+Overloaded(FUNCTIONS...) -> Overloaded<FUNCTIONS...>;
+
+namespace Internal {
+
+constexpr bool isPowerOfTwo(const uint32_t value) {
+	return (value != 0) && ((value & (value - 1)) == 0);
+}
+
+inline uint32_t countTrailingZeros(const uint64_t value) noexcept {
+	assert(value != 0);
+#if defined(_MSC_VER)
+	unsigned long index;
+	_BitScanForward64(&index, value);
+	return static_cast<uint32_t>(index);
+#else
+	return static_cast<uint32_t>(__builtin_ctzll(value));
+#endif
+}
+
+inline uint32_t countLeadingZeros(const uint64_t value) noexcept {
+	assert(value != 0);
+#if defined(_MSC_VER)
+	unsigned long index;
+	_BitScanReverse64(&index, value);
+	return 63 - static_cast<uint32_t>(index);
+#else
+	return static_cast<uint32_t>(__builtin_clzll(value));
+#endif
+}
+
+/** One bit per channel, set by producers when a channel becomes non-empty and taken by the consumer. */
+template<uint32_t CHANNELS, uint32_t CACHE_LINE_SIZE, bool ENABLED>
+class ReadyBitmap {
+public:
+	static constexpr uint32_t numWords = (CHANNELS + 63) / 64;
+
+	/** Producer side, called after publishing messages to inChannel and issuing a seq_cst fence. The fence orders
+		the publish of the messages before the read of the bit. It pairs with the fence in takeReady(), so that 
+		either the consumer sees the new messages or this producer sees the bit cleared and sets it.
+		@return True if the bit was set by this call.
+	*/
+	inline bool setReady(const uint32_t inChannel) noexcept {
+		std::atomic<uint64_t>& word = words[inChannel / 64];
+		const uint64_t bit = uint64_t(1) << (inChannel % 64);
+
+		if ((word.load(std::memory_order_relaxed) & bit) != 0) {
+			return false;
+		}
+		word.fetch_or(bit, std::memory_order_release);
+		return true;
+	}
+
+	/** Consumer side. Take and clear all ready bits of one word. */
+	inline uint64_t takeReady(const uint32_t inWord) noexcept {
+		if (words[inWord].load(std::memory_order_relaxed) == 0) {
+			return 0;
+		}
+		const uint64_t bits = words[inWord].exchange(0, std::memory_order_seq_cst);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		return bits;
+	}
+
+	/** Consumer side. Take and clear the ready bit of one channel. */
+	inline void takeReady(const uint32_t inWord, const uint64_t inBit) noexcept {
+		words[inWord].fetch_and(~inBit, std::memory_order_seq_cst);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+	}
+
+	/** Consumer side. Set the bit again for a channel that still has pending messages after being serviced. */
+	inline void restoreReady(const uint32_t inChannel) noexcept {
+		words[inChannel / 64].fetch_or(uint64_t(1) << (inChannel % 64), std::memory_order_relaxed);
+	}
+
+	inline uint64_t peekReady(const uint32_t inWord) const noexcept {
+		return words[inWord].load(std::memory_order_acquire);
+	}
+
+	inline bool isAnyReady() const noexcept {
+		for (uint32_t word = 0; word < numWords; ++word) {
+			if (words[word].load(std::memory_order_acquire) != 0) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	/** Consumer owned. Channel returned by the last nextReadyChannel() call, or CHANNELS. */
+	alignas(CACHE_LINE_SIZE) uint32_t lastReadyChannel = CHANNELS;
+
+private:
+	alignas(CACHE_LINE_SIZE) std::atomic<uint64_t> words[numWords] = {};
+};
+
+template<uint32_t CHANNELS, uint32_t CACHE_LINE_SIZE>
+class ReadyBitmap<CHANNELS, CACHE_LINE_SIZE, false> {
+};
+
+/** Hint to the CPU that the calling thread is spin waiting. */
+inline void cpuRelax() noexcept {
+#if defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+	_mm_pause();
+#elif defined(_MSC_VER) && defined(_M_ARM64)
+	__yield();
+#elif defined(__i386__) || defined(__x86_64__)
+	__builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+	asm volatile("yield");
+#endif
+}
+
+/** Number of steps of a spin wait that backoff() spends relaxing the CPU before it starts yielding the thread. */
+constexpr uint32_t backoffSpinLimit = 1024;
+
+/** Wait for step inSpin of a spin wait, counted from 0. */
+inline void backoff(const uint32_t inSpin) noexcept {
+	if (inSpin < backoffSpinLimit) {
+		cpuRelax();
+	} else {
+		std::this_thread::yield();
+	}
+}
+
+/** Lets the output thread sleep until an input thread publishes messages. The consumer spins, then yields, and 
+	finally parks on a futex (or a condition variable on platforms without futexes). The number of spins adapts 
+	to how often spinning was enough to see new messages. Input threads only make a system call when the 
+	consumer is actually parked.
+*/
+template<uint32_t CACHE_LINE_SIZE, bool ENABLED>
+class ConsumerParker {
+public:
+	/** Producer side, called after publishing messages and issuing a seq_cst fence. Pairs with the fence in 
+		wait(), so that either the consumer sees the new messages before parking or this producer sees it parked.
+	*/
+	inline void notify() noexcept {
+		if (parked.load(std::memory_order_relaxed) != 0) {
+			wake();
+		}
+	}
+
+	/** Consumer side. Wait until inHasMessages() returns true or inTimeout has passed.
+		@return Result of the last inHasMessages() call.
+	*/
+	template<typename F>
+	bool wait(F&& inHasMessages, const std::chrono::nanoseconds inTimeout) {
+		for (uint32_t spin = 0; spin < spinLimit; ++spin) {
+			if (inHasMessages()) {
+				spinLimit = std::min(spinLimit * 2, maxSpinLimit);
+				return true;
+			}
+			cpuRelax();
+		}
+		spinLimit = std::max(spinLimit / 2, minSpinLimit);
+
+		const std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + inTimeout;
+		for (uint32_t yield = 0; yield < yieldLimit; ++yield) {
+			if (inHasMessages()) {
+				return true;
+			}
+			if (std::chrono::steady_clock::now() >= deadline) {
+				return false;
+			}
+			std::this_thread::yield();
+		}
+
+		while (true) {
+			parked.store(1, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			if (inHasMessages()) {
+				parked.store(0, std::memory_order_relaxed);
+				return true;
+			}
+
+			const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+			if (now >= deadline) {
+				parked.store(0, std::memory_order_relaxed);
+				return false;
+			}
+			sleep(deadline - now);
+			parked.store(0, std::memory_order_relaxed);
+
+			if (inHasMessages()) {
+				return true;
+			}
+		}
+	}
+
+private:
+	static constexpr uint32_t minSpinLimit = 64;
+	static constexpr uint32_t maxSpinLimit = 16384;
+	static constexpr uint32_t yieldLimit = 16;
+
+#if defined(__linux__)
+	inline void wake() noexcept {
+		if (parked.exchange(0, std::memory_order_relaxed) != 0) {
+			syscall(SYS_futex, reinterpret_cast<uint32_t*>(&parked), FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+		}
+	}
+
+	inline void sleep(const std::chrono::steady_clock::duration inTimeout) noexcept {
+		const std::chrono::nanoseconds timeout = std::chrono::duration_cast<std::chrono::nanoseconds>(inTimeout);
+		struct timespec timeSpec;
+		timeSpec.tv_sec = static_cast<time_t>(timeout.count() / 1000000000);
+		timeSpec.tv_nsec = static_cast<long>(timeout.count() % 1000000000);
+		syscall(SYS_futex, reinterpret_cast<uint32_t*>(&parked), FUTEX_WAIT_PRIVATE, 1, &timeSpec, nullptr, 0);
+	}
+#else
+	inline void wake() noexcept {
+		if (parked.exchange(0, std::memory_order_relaxed) != 0) {
+			std::lock_guard<std::mutex> lock(mutex);
+			condition.notify_one();
+		}
+	}
+
+	inline void sleep(const std::chrono::steady_clock::duration inTimeout) {
+		std::unique_lock<std::mutex> lock(mutex);
+		condition.wait_for(lock, inTimeout, [this]() { return parked.load(std::memory_order_relaxed) == 0; });
+	}
+
+	std::mutex mutex;
+	std::condition_variable condition;
+#endif
+
+	/** Futex word. 1 while the consumer is parked, or about to park. */
+	alignas(CACHE_LINE_SIZE) std::atomic<uint32_t> parked{0};
+
+	/** Consumer owned. */
+	alignas(CACHE_LINE_SIZE) uint32_t spinLimit = minSpinLimit;
+};
+
+template<uint32_t CACHE_LINE_SIZE>
+class ConsumerParker<CACHE_LINE_SIZE, false> {
+};
+
+/** Makes an eventfd readable when an input thread publishes messages while the output thread is armed, so that 
+	the output thread can wait for messages and file descriptors in one epoll_wait(). Arming is a flag that the 
+	first input thread to see it takes, so only that input thread makes a system call until the output thread 
+	arms again.
+*/
+template<uint32_t CACHE_LINE_SIZE, bool ENABLED>
+class EventNotifier;
+
+#if defined(__linux__)
+template<uint32_t CACHE_LINE_SIZE>
+class EventNotifier<CACHE_LINE_SIZE, true> {
+public:
+	/** @throws std::system_error If the eventfd can not be created, e.g. when the process is out of descriptors. */
+	EventNotifier()
+		: fileDescriptor(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC))
+	{
+		if (fileDescriptor < 0) {
+			throw std::system_error(errno, std::generic_category(), "eventfd");
+		}
+	}
+
+	~EventNotifier() {
+		if (fileDescriptor >= 0) {
+			close(fileDescriptor);
+		}
+	}
+
+	EventNotifier(const EventNotifier&) = delete;
+	EventNotifier& operator=(const EventNotifier&) = delete;
+
+	inline int getFileDescriptor() const noexcept { return fileDescriptor; }
+
+	/** Producer side, called after publishing messages and issuing a seq_cst fence. Pairs with the fence in 
+		arm(), so that either the consumer sees the new messages while arming or this producer sees it armed.
+	*/
+	inline void notify() noexcept {
+		if (armed.load(std::memory_order_relaxed) != 0 && armed.exchange(0, std::memory_order_relaxed) != 0) {
+			const uint64_t increment = 1;
+			const ssize_t result = write(fileDescriptor, &increment, sizeof(increment));
+			(void)result;
+		}
+	}
+
+	/** Consumer side. Arm unless inHasMessages() returns true.
+		@return True if armed.
+	*/
+	template<typename F>
+	bool arm(F&& inHasMessages) noexcept {
+		// A producer may have signaled since the last arm(). Reset the counter so that the descriptor only stays 
+		// readable for signals from now on. A signal that is written after this read only causes a spurious wake.
+		if (mayBeSignaled) {
+			uint64_t count;
+			const ssize_t result = read(fileDescriptor, &count, sizeof(count));
+			(void)result;
+		}
+
+		armed.store(1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (inHasMessages()) {
+			// If a producer took the flag first, its signal is still on the way.
+			mayBeSignaled = (armed.exchange(0, std::memory_order_relaxed) == 0);
+			return false;
+		}
+		mayBeSignaled = true;
+		return true;
+	}
+
+private:
+	/** 1 while the consumer is armed. Taken by the first producer that publishes messages. */
+	alignas(CACHE_LINE_SIZE) std::atomic<uint32_t> armed{0};
+
+	/** Consumer owned. Never written after construction, so producers read it without bouncing the line. */
+	alignas(CACHE_LINE_SIZE) int fileDescriptor;
+	bool mayBeSignaled = false;
+};
+#endif
+
+template<uint32_t CACHE_LINE_SIZE>
+class EventNotifier<CACHE_LINE_SIZE, false> {
+};
+
+/** Message ring of one channel. SIZE elements stored inline. */
+template<typename T, uint32_t SIZE, uint32_t CACHE_LINE_SIZE>
+struct ChannelRing {
+	static constexpr uint32_t capacity() noexcept { return SIZE; }
+
+	alignas(CACHE_LINE_SIZE) T elements[SIZE];
+};
+
+/** Message ring of one channel of a runtime sized queue. The elements are allocated by the queue. The pointer and
+	the capacity are never written after construction, so the cache line is shared by the input and output threads 
+	without bouncing.
+*/
+template<typename T, uint32_t CACHE_LINE_SIZE>
+struct ChannelRing<T, 0, CACHE_LINE_SIZE> {
+	inline uint32_t capacity() const noexcept { return size; }
+
+	alignas(CACHE_LINE_SIZE) T* elements = nullptr;
+	uint32_t size = 0;
+};
+
+/** The channels of a queue, stored inline. */
+template<typename T, uint32_t CHANNELS>
+struct ChannelArray {
+	static constexpr uint32_t size() noexcept { return CHANNELS; }
+	inline T& operator[](const uint32_t inIndex) noexcept { return channels[inIndex]; }
+	inline const T& operator[](const uint32_t inIndex) const noexcept { return channels[inIndex]; }
+
+	T channels[CHANNELS];
+};
+
+/** The channels of a runtime sized queue, placed at the start of storage allocated by the queue. */
+template<typename T>
+struct ChannelArray<T, 0> {
+	inline uint32_t size() const noexcept { return count; }
+	inline T& operator[](const uint32_t inIndex) noexcept { return channels[inIndex]; }
+	inline const T& operator[](const uint32_t inIndex) const noexcept { return channels[inIndex]; }
+
+	T* channels = nullptr;
+	uint32_t count = 0;
+	void* storage = nullptr;
+	size_t storageSize = 0;
+};
+
+/** Storage and tags of the MESSAGE template parameter. A MESSAGE union is stored as is, with a user supplied TYPES
+	enum. A Messages<> list is stored in a byte array with the size and alignment of its largest members, tagged
+	with the index of the message type in the list.
+*/
+template<typename MESSAGE>
+struct MessageList {
+	static constexpr bool isTyped = false;
+	using Storage = MESSAGE;
+	using Tag = void;
+};
+
+template<typename... MESSAGES>
+struct MessageList<Messages<MESSAGES...>> {
+	static_assert(sizeof...(MESSAGES) > 0, "Messages<> must list at least one message type.");
+	static_assert((std::is_trivially_copyable<MESSAGES>::value && ...), "Message types must be trivially copyable.");
+
+	static constexpr bool isTyped = true;
+	static constexpr uint32_t count = sizeof...(MESSAGES);
+	using Tag = std::conditional_t<(count <= 0x100), uint8_t, uint16_t>;
+
+	struct alignas(std::max({alignof(MESSAGES)...})) Storage {
+		unsigned char bytes[std::max({sizeof(MESSAGES)...})];
+	};
+
+	template<typename T>
+	static constexpr bool contains = (std::is_same<T, MESSAGES>::value || ...);
+
+	template<typename T>
+	static constexpr Tag tagOf() noexcept {
+		constexpr bool matches[] = {std::is_same<T, MESSAGES>::value...};
+		Tag tag = 0;
+		while (!matches[tag]) {
+			++tag;
+		}
+		return tag;
+	}
+
+	/** Call inVisitor(const T&) with the message stored in inStorage, through a table with one entry per type. */
+	template<typename V>
+	static inline void visit(const Storage& inStorage, const Tag inTag, V& inVisitor) {
+		using Function = void (*)(const Storage&, V&);
+		static constexpr Function functions[] = {&callVisitor<MESSAGES, V>...};
+		assert(inTag < count);
+		functions[inTag](inStorage, inVisitor);
+	}
+
+	template<typename T, typename V>
+	static void callVisitor(const Storage& inStorage, V& inVisitor) {
+		inVisitor(*reinterpret_cast<const T*>(&inStorage));
+	}
+};
+
+/** Member used in place of an optional feature that is disabled. */
+struct Disabled {
+};
+
+/** Add to a counter that only one thread writes. A plain load and store, but other threads may read it. */
+inline void incrementCounter(std::atomic<uint64_t>& ioCounter, const uint64_t inValue = 1) noexcept {
+	ioCounter.store(ioCounter.load(std::memory_order_relaxed) + inValue, std::memory_order_relaxed);
+}
+
+/** Counters of the input thread of a channel, in the producer cache line. Empty unless ENABLED. */
+template<bool ENABLED>
+struct ProducerStats {
+	inline void onPush() noexcept { incrementCounter(numPushes); }
+	inline void onFullPush() noexcept { incrementCounter(numFullPushes); }
+
+	std::atomic<uint64_t> numPushes{0};
+	std::atomic<uint64_t> numFullPushes{0};
+};
+
+template<>
+struct ProducerStats<false> {
+	inline void onPush() noexcept {}
+	inline void onFullPush() noexcept {}
+};
+
+/** Counters of the output thread of a channel, in the consumer cache line. Empty unless ENABLED. */
+template<bool ENABLED>
+struct ConsumerStats {
+	/** A read that saw inNumPending pending messages out of inCapacity. */
+	inline void onRead(const uint32_t inNumPending, const uint32_t inCapacity) noexcept {
+		if (inNumPending == 0) {
+			incrementCounter(numStalls);
+			return;
+		}
+		if (inNumPending >= inCapacity - inCapacity / 4) {
+			incrementCounter(numNearFull);
+		}
+		if (inNumPending > highWaterMark.load(std::memory_order_relaxed)) {
+			highWaterMark.store(inNumPending, std::memory_order_relaxed);
+		}
+	}
+	inline void onPop(const uint32_t inNumElements) noexcept { incrementCounter(numPops, inNumElements); }
+
+	std::atomic<uint64_t> numPops{0};
+	std::atomic<uint64_t> numNearFull{0};
+	std::atomic<uint64_t> numStalls{0};
+	std::atomic<uint32_t> highWaterMark{0};
+};
+
+template<>
+struct ConsumerStats<false> {
+	inline void onRead(const uint32_t, const uint32_t) noexcept {}
+	inline void onPop(const uint32_t) noexcept {}
+};
+
+/** Timestamp of latency tracing, in nanoseconds. Never zero, which marks a message that was not sampled. */
+inline uint64_t traceTime() noexcept {
+	return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count()) | 1;
+}
+
+/** Push time of a message container, zero if not sampled. Empty, as a base class, unless ENABLED. */
+template<bool ENABLED>
+struct TraceStamp {
+	uint64_t pushTime;
+};
+
+template<>
+struct TraceStamp<false> {
+};
+
+/** Picks one message in INTERVAL on the input thread of a channel, starting with the first. */
+template<uint32_t INTERVAL>
+struct TraceSampler {
+	inline uint64_t sample() noexcept {
+		if (countdown != 0) {
+			--countdown;
+			return 0;
+		}
+		countdown = INTERVAL - 1;
+		return traceTime();
+	}
+
+	uint32_t countdown = 0;
+};
+
+template<>
+struct TraceSampler<0> {
+	inline uint64_t sample() noexcept { return 0; }
+};
+
+/** Log bucketed histogram of nanosecond delays, in the style of HDR histograms. Values below subBuckets have a 
+	bucket each, and every power of two above is split in subBuckets buckets, so a value is known to within 12.5%.
+	Written by one thread, readable by any thread. Empty unless ENABLED.
+*/
+template<uint32_t CACHE_LINE_SIZE, bool ENABLED>
+class LatencyHistogram {
+public:
+	static constexpr uint32_t subBucketBits = 3;
+	static constexpr uint32_t subBuckets = 1 << subBucketBits;
+	static constexpr uint32_t numBuckets = (64 - subBucketBits + 1) * subBuckets;
+
+	static inline uint32_t bucketOf(const uint64_t inValue) noexcept {
+		if (inValue < subBuckets) {
+			return static_cast<uint32_t>(inValue);
+		}
+		const uint32_t magnitude = 63 - countLeadingZeros(inValue);
+		const uint32_t shift = magnitude - subBucketBits;
+		return (shift + 1) * subBuckets + static_cast<uint32_t>((inValue >> shift) - subBuckets);
+	}
+
+	/** Highest value counted in inBucket. */
+	static inline uint64_t bucketMax(const uint32_t inBucket) noexcept {
+		if (inBucket < subBuckets) {
+			return inBucket;
+		}
+		const uint32_t shift = inBucket / subBuckets - 1;
+		const uint64_t lowest = static_cast<uint64_t>(subBuckets + inBucket % subBuckets) << shift;
+		return lowest + ((uint64_t(1) << shift) - 1);
+	}
+
+	inline void record(const uint64_t inValue) noexcept { incrementCounter(counts[bucketOf(inValue)]); }
+	inline uint64_t count(const uint32_t inBucket) const noexcept { 
+		return counts[inBucket].load(std::memory_order_relaxed); 
+	}
+
+private:
+	alignas(CACHE_LINE_SIZE) std::atomic<uint64_t> counts[numBuckets] = {};
+};
+
+template<uint32_t CACHE_LINE_SIZE>
+class LatencyHistogram<CACHE_LINE_SIZE, false> {
+public:
+	inline void record(const uint64_t) noexcept {}
+};
+
+/** Delivery time of a message container, zero for immediate delivery. Empty, as a base class, unless ENABLED. */
+template<bool ENABLED>
+struct ScheduleStamp {
+	uint64_t deliveryTime;
+};
+
+template<>
+struct ScheduleStamp<false> {
+};
+
+/** Hierarchical timing wheel holding up to CAPACITY elements of type T until they are due, each for one of 
+	CHANNELS channels. Level 0 has a slot per tick, and every level above a slot per rotation of the level below.
+	An element is placed on the lowest level where its deadline is in the current rotation, and moved down a 
+	level when its slot comes up, so inserting and expiring take constant time. Elements live in a fixed pool 
+	linked by index, and due elements are kept in a list per channel, in the order they became due. Not thread 
+	safe, used by the output thread only.
+*/
+template<typename T, uint32_t CAPACITY, uint32_t CHANNELS>
+class TimerWheel {
+public:
+	/** Ticks are 1024 nanoseconds. Deadlines are rounded up to a whole tick, so elements are never due early. */
+	static constexpr uint32_t tickShift = 10;
+	static constexpr uint32_t levelBits = 6;
+	static constexpr uint32_t numLevels = 5;
+	static constexpr uint32_t slotsPerLevel = 1 << levelBits;
+
+	TimerWheel() noexcept;
+
+	TimerWheel(const TimerWheel&) = delete;
+	TimerWheel& operator=(const TimerWheel&) = delete;
+
+	/** Hold inElement for inChannel until inDeadline, in nanoseconds.
+		@return False if all CAPACITY elements are in use.
+	*/
+	inline bool insert(const uint32_t inChannel, const uint64_t inDeadline, const T& inElement) noexcept;
+
+	/** Move every element with a deadline at or before inNow, in nanoseconds, to the due list of its channel. */
+	void advance(const uint64_t inNow) noexcept;
+
+	/** True if no element is waiting for its deadline. Due elements are not counted. */
+	inline bool isIdle() const noexcept { return numWaiting == 0; }
+
+	/** Number of elements of inChannel, waiting or due. */
+	inline uint32_t getNumHeld(const uint32_t inChannel) const noexcept { return numHeld[inChannel]; }
+
+	/** Due list of inChannel. */
+	inline uint32_t getNumDue(const uint32_t inChannel) const noexcept { return dueLists[inChannel].size; }
+	inline const T& frontDue(const uint32_t inChannel) const noexcept;
+	inline void popDue(const uint32_t inChannel) noexcept;
+
+private:
+	static constexpr uint32_t none = 0xffffffff;
+
+	struct Node {
+		T element;
+		uint64_t deadlineTick;
+		uint32_t channel;
+		uint32_t next;
+	};
+
+	struct List {
+		uint32_t head = none;
+		uint32_t tail = none;
+		uint32_t size = 0;
+	};
+
+	inline void append(List& ioList, const uint32_t inNode) noexcept;
+
+	/** Place inNode on the wheel relative to currentTick, or on its due list if due. */
+	inline void place(const uint32_t inNode) noexcept;
+
+	/** Place again every node of ioList, in order, and empty it. */
+	inline void replace(List& ioList) noexcept;
+
+	/** First tick after currentTick at which a slot with elements comes up, or the overflow list is due. */
+	inline uint64_t nextEventTick() const noexcept;
+
+	Node nodes[CAPACITY];
+	uint32_t freeList = 0;
+	uint32_t numWaiting = 0;
+	uint64_t currentTick = 0;
+	uint64_t occupied[numLevels] = {};
+	List slots[numLevels][slotsPerLevel];
+	/** Elements beyond the top level, placed again each time the top level completes a rotation. */
+	List overflow;
+	List dueLists[CHANNELS];
+	uint32_t numHeld[CHANNELS] = {};
+};
+
+template<typename T, uint32_t CAPACITY, uint32_t CHANNELS>
+TimerWheel<T, CAPACITY, CHANNELS>::TimerWheel() noexcept {
+	for (uint32_t node = 0; node < CAPACITY; ++node) {
+		nodes[node].next = (node + 1 < CAPACITY) ? node + 1 : none;
+	}
+}
+
+template<typename T, uint32_t CAPACITY, uint32_t CHANNELS>
+inline bool TimerWheel<T, CAPACITY, CHANNELS>::insert(
+	const uint32_t inChannel,
+	const uint64_t inDeadline,
+	const T& inElement) noexcept
+{
+	if (freeList == none) {
+		return false;
+	}
+	const uint32_t node = freeList;
+	freeList = nodes[node].next;
+
+	nodes[node].element = inElement;
+	nodes[node].deadlineTick = (inDeadline + (uint64_t(1) << tickShift) - 1) >> tickShift;
+	nodes[node].channel = inChannel;
+	++numHeld[inChannel];
+	place(node);
+	return true;
+}
+
+template<typename T, uint32_t CAPACITY, uint32_t CHANNELS>
+void TimerWheel<T, CAPACITY, CHANNELS>::advance(const uint64_t inNow) noexcept {
+	const uint64_t nowTick = inNow >> tickShift;
+	while (numWaiting != 0 && currentTick < nowTick) {
+		const uint64_t eventTick = nextEventTick();
+		if (eventTick > nowTick) {
+			break;
+		}
+		currentTick = eventTick;
+
+		// Move elements down from the top, so that the slots below are complete before they are expired.
+		if ((currentTick & ((uint64_t(1) << (levelBits * numLevels)) - 1)) == 0) {
+			replace(overflow);
+		}
+		for (uint32_t level = numLevels - 1; level > 0; --level) {
+			const uint32_t shift = levelBits * level;
+			if ((currentTick & ((uint64_t(1) << shift) - 1)) == 0) {
+				const uint32_t slot = static_cast<uint32_t>(currentTick >> shift) & (slotsPerLevel - 1);
+				occupied[level] &= ~(uint64_t(1) << slot);
+				replace(slots[level][slot]);
+			}
+		}
+		const uint32_t slot = static_cast<uint32_t>(currentTick) & (slotsPerLevel - 1);
+		occupied[0] &= ~(uint64_t(1) << slot);
+		replace(slots[0][slot]);
+	}
+	// Nothing is due before nowTick, so the wheel may skip ahead.
+	currentTick = std::max(currentTick, nowTick);
+}
+
+template<typename T, uint32_t CAPACITY, uint32_t CHANNELS>
+inline const T& TimerWheel<T, CAPACITY, CHANNELS>::frontDue(const uint32_t inChannel) const noexcept {
+	assert(dueLists[inChannel].size != 0);
+	return nodes[dueLists[inChannel].head].element;
+}
+
+template<typename T, uint32_t CAPACITY, uint32_t CHANNELS>
+inline void TimerWheel<T, CAPACITY, CHANNELS>::popDue(const uint32_t inChannel) noexcept {
+	List& dueList = dueLists[inChannel];
+	assert(dueList.size != 0);
+
+	const uint32_t node = dueList.head;
+	dueList.head = nodes[node].next;
+	if (--dueList.size == 0) {
+		dueList.tail = none;
+	}
+	--numHeld[inChannel];
+	nodes[node].next = freeList;
+	freeList = node;
+}
+
+template<typename T, uint32_t CAPACITY, uint32_t CHANNELS>
+inline void TimerWheel<T, CAPACITY, CHANNELS>::append(List& ioList, const uint32_t inNode) noexcept {
+	nodes[inNode].next = none;
+	if (ioList.tail == none) {
+		ioList.head = inNode;
+	} else {
+		nodes[ioList.tail].next = inNode;
+	}
+	ioList.tail = inNode;
+	++ioList.size;
+}
+
+template<typename T, uint32_t CAPACITY, uint32_t CHANNELS>
+inline void TimerWheel<T, CAPACITY, CHANNELS>::place(const uint32_t inNode) noexcept {
+	const uint64_t deadlineTick = nodes[inNode].deadlineTick;
+	if (deadlineTick <= currentTick) {
+		append(dueLists[nodes[inNode].channel], inNode);
+		return;
+	}
+
+	++numWaiting;
+	const uint64_t differentBits = deadlineTick ^ currentTick;
+	if ((differentBits >> (levelBits * numLevels)) != 0) {
+		append(overflow, inNode);
+		return;
+	}
+	// The highest bit that differs from currentTick selects the level. The slot is then after the current one.
+	const uint32_t level = (63 - countLeadingZeros(differentBits)) / levelBits;
+	const uint32_t slot = static_cast<uint32_t>(deadlineTick >> (levelBits * level)) & (slotsPerLevel - 1);
+	append(slots[level][slot], inNode);
+	occupied[level] |= uint64_t(1) << slot;
+}
+
+template<typename T, uint32_t CAPACITY, uint32_t CHANNELS>
+inline void TimerWheel<T, CAPACITY, CHANNELS>::replace(List& ioList) noexcept {
+	uint32_t node = ioList.head;
+	numWaiting -= ioList.size;
+	ioList = List();
+	while (node != none) {
+		const uint32_t next = nodes[node].next;
+		place(node);
+		node = next;
+	}
+}
+
+template<typename T, uint32_t CAPACITY, uint32_t CHANNELS>
+inline uint64_t TimerWheel<T, CAPACITY, CHANNELS>::nextEventTick() const noexcept {
+	// A lower level comes up before any slot of the level above it, so the lowest pending level has the first.
+	for (uint32_t level = 0; level < numLevels; ++level) {
+		const uint32_t shift = levelBits * level;
+		const uint32_t slot = static_cast<uint32_t>(currentTick >> shift) & (slotsPerLevel - 1);
+		const uint64_t pending = (slot + 1 < slotsPerLevel) ? occupied[level] & (~uint64_t(0) << (slot + 1)) : 0;
+		if (pending != 0) {
+			const uint64_t rotation = (currentTick >> (shift + levelBits)) << (shift + levelBits);
+			return rotation + (uint64_t(countTrailingZeros(pending)) << shift);
+		}
+	}
+	const uint32_t wheelBits = levelBits * numLevels;
+	return ((currentTick >> wheelBits) + 1) << wheelBits;
+}
+
+/** Write to every page of a memory range, so that it is backed by physical memory. */
+inline void prefault(void* inMemory, const size_t inSize) noexcept {
+	volatile uint8_t* bytes = static_cast<volatile uint8_t*>(inMemory);
+	for (size_t offset = 0; offset < inSize; offset += 4096) {
+		bytes[offset] = 0;
+	}
+}
+
+} // namespace Internal
+
+/** The TYPES tag derived from a Messages<> list, for passing TRAITS to a queue with a Messages<> list. */
+template<typename MESSAGE>
+using MessageTag = typename Internal::MessageList<MESSAGE>::Tag;
+
+/** Pass as both SIZE and CHANNELS to give an LWMessageQueue its channel size and number of channels at 
+	construction instead of at compile time.
+*/
+constexpr uint32_t dynamicExtent = 0;
+
+/** Default allocator for the storage of runtime sized queues. On Linux, storage of at least one huge page is 
+	mapped with MAP_HUGETLB if huge pages are reserved, and otherwise mapped in huge page multiples and advised to 
+	use transparent huge pages. Fewer pages means fewer TLB misses when the output thread walks many channels. 
+	Smaller storage, and storage on other platforms, is page aligned.
+
+	A custom allocator is a struct with the same two static functions, set as TRAITS::Allocator. Memory must be 
+	aligned to at least TRAITS::cacheLineSize.
+*/
+struct HugePageAllocator {
+	static constexpr size_t hugePageSize = 2 * 1024 * 1024;
+
+	/** @return Memory of at least inSize bytes, or nullptr. */
+	static inline void* allocate(const size_t inSize) noexcept;
+	static inline void deallocate(void* inMemory, const size_t inSize) noexcept;
+
+private:
+	static inline size_t roundedSize(const size_t inSize) noexcept;
+};
+
+inline void* HugePageAllocator::allocate(const size_t inSize) noexcept {
+	const size_t size = roundedSize(inSize);
+#if defined(__linux__)
+	if (size >= hugePageSize) {
+		void* memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+		if (memory != MAP_FAILED) {
+			return memory;
+		}
+	}
+	void* memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (memory == MAP_FAILED) {
+		return nullptr;
+	}
+	if (size >= hugePageSize) {
+		madvise(memory, size, MADV_HUGEPAGE);
+	}
+	return memory;
+#elif defined(_MSC_VER)
+	return VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+#else
+	return ::operator new(size, std::align_val_t(4096), std::nothrow);
+#endif
+}
+
+inline void HugePageAllocator::deallocate(void* inMemory, const size_t inSize) noexcept {
+#if defined(__linux__)
+	munmap(inMemory, roundedSize(inSize));
+#elif defined(_MSC_VER)
+	(void)inSize;
+	VirtualFree(inMemory, 0, MEM_RELEASE);
+#else
+	(void)inSize;
+	::operator delete(inMemory, std::align_val_t(4096));
+#endif
+}
+
+inline size_t HugePageAllocator::roundedSize(const size_t inSize) noexcept {
+	const size_t pageSize = (inSize >= hugePageSize) ? hugePageSize : 4096;
+	return (inSize + pageSize - 1) & ~(pageSize - 1);
+}
+
+/** What a channel does when a message is pushed while it is full. */
+enum class OverflowPolicy {
+	/** The push fails. tryPushMessage(), stageMessage() and LWMessageQueue::pushMessage() return false, and 
+		ThreadChannelInput::pushMessage() asserts in debug builds and drops the new message in release builds.
+	*/
+	Reject,
+
+	/** The oldest pending message is dropped to make room, turning the channel into a lossy ring, e.g. for 
+		telemetry. Consumers can not access messages in place with peek() or getReadableMessages() in this mode, 
+		since the input thread may overwrite them. drain() hands out copies instead.
+	*/
+	OverwriteOldest,
+
+	/** pushMessage(), reserve() and emplace() spin, then yield, until the output thread has made room. 
+		tryPushMessage() and stageMessage() fail instead of waiting.
+	*/
+	Block
+};
+
+/** Default configuration of an LWMessageQueue, passed as the optional TRAITS template parameter. To change a
+	setting, inherit from DefaultTraits and override the static members that should differ.
+*/
+struct DefaultTraits {
+	/** Destructive interference size. Data written by the producer, data written by the consumer and the message
+		ring of each channel start on separate blocks of this size, and every channel is padded to a multiple of it.
+		64 bytes matches most x86 and ARM cores.
+	*/
+	static constexpr uint32_t cacheLineSize = 64;
+
+	/** Maintain a queue level bitmap of channels that have become non-empty, so that the output thread can find 
+		ready channels with LWMessageQueue::forEachReadyChannel() and LWMessageQueue::nextReadyChannel() instead of 
+		polling every channel. Every pushMessage(), and every commit() of staged messages, then issues a full 
+		memory fence before reading the ready bit (mfence on x86, dmb on ARM, some tens of cycles), and an atomic
+		or when the output thread has taken the bit. Staging bursts with stageMessage() pays the fence once per 
+		commit.
+	*/
+	static constexpr bool enableReadyBitmap = false;
+
+	/** Let the output thread sleep in LWMessageQueue::waitForMessages() when all channels are empty. The input 
+		threads pay for it on every pushMessage(), and every commit() of staged messages, whether the output thread
+		is parked or not: a full memory fence (mfence on x86, dmb on ARM), so that the push can not miss an output 
+		thread that is about to park, then a load of the parked flag. Only a push that finds the output thread 
+		parked also makes the wake-up system call. With the ready bitmap, the fence is only repeated when the 
+		push sets the ready bit.
+	*/
+	static constexpr bool enableBlockingWait = false;
+
+	/** What pushing to a full channel does. See OverflowPolicy. */
+	static constexpr OverflowPolicy overflowPolicy = OverflowPolicy::Reject;
+
+	/** Allocates the storage of runtime sized queues, see dynamicExtent and HugePageAllocator. */
+	using Allocator = HugePageAllocator;
+
+	/** Number of slots in the queue's shared channel, a power of two of at least 2, or 0 for no shared channel. 
+		Any number of threads may push to the shared channel, see LWMessageQueue::getSharedChannelInput(). With 
+		enableBlockingWait or enableEventFd, every shared channel push issues a full memory fence after publishing
+		its slot, on top of the atomic increment that claims it, since the shared channel has no ready bit that 
+		would let a push skip the check for a waiting output thread.
+	*/
+	static constexpr uint32_t sharedChannelSize = 0;
+
+	/** Count pushes, pops, full pushes, near full and empty reads, and the most pending messages of every channel,
+		see LWMessageQueue::snapshotStats(). The counters are written by the thread owning the cache line they are
+		on, so they add no shared writes, and take no space or code when disabled.
+	*/
+	static constexpr bool enableStats = false;
+
+	/** Stamp one message in traceSampleInterval pushed to each channel with its push time, and record the time it
+		waited in the channel in a histogram per channel when popped, see LWMessageQueue::getLatencyPercentiles().
+		Sampled messages carry the timestamp in the message container, so enabling tracing grows every container 
+		by 8 bytes. Zero disables tracing.
+	*/
+	static constexpr uint32_t traceSampleInterval = 0;
+
+	/** Number of messages pushed with pushMessageAt() or pushMessageAfter() that the output thread can hold in a
+		timing wheel inside the queue until they are due. Zero disables scheduled delivery. Scheduled delivery 
+		grows every message container by 8 bytes, and needs a static size queue read by a single output thread
+		through ThreadChannelOutput or drain(), without the ready bitmap, the blocking wait or 
+		OverflowPolicy::OverwriteOldest.
+	*/
+	static constexpr uint32_t scheduledMessageCapacity = 0;
+
+	/** Create an eventfd that becomes readable when messages are published while the output thread is armed, see 
+		LWMessageQueue::armEventFd(). The output thread can then wait for messages and sockets in one epoll_wait().
+		Every pushMessage(), and every commit() of staged messages, then issues a full memory fence and reads the 
+		armed flag, also while the output thread is busy and never arms. The fence is what keeps a push from 
+		missing an output thread that arms at the same time, and Benchmark/ measures its cost in the "eventfd"
+		rows. The first push after an arm also makes one write() system call. Linux only.
+	*/
+	static constexpr bool enableEventFd = false;
+};
+
+/** Traits for cores that prefetch cache lines in pairs, or have 128 byte cache lines (e.g. Apple M-series, and
+	recent Intel cores with the adjacent line prefetcher enabled).
+*/
+struct CacheLine128Traits : DefaultTraits {
+	static constexpr uint32_t cacheLineSize = 128;
+};
+
+/**
+	@brief
+		A static size message queue used to send messages from many input threads to a single output thread. Input 
+		and output operations are thread safe and wait-free as long as there is exactly one thread consuming messages. 
+		Messages are user defined POD type structs.
+
+	@details
+		Messages are passed through ThreadChannels. Each thread producing messages (input thread) gets one 
+		ThreadChannelInput instance each, and the single consumer (output) thread gets one ThreadChannelOutput instance
+		per input thread. A good design pattern could be to let the consumer thread own the LWMessageQueue instance, 
+		and only pass ThreadChannelInput instances to the producer threads. If you need more consumers, simply create 
+		an LWMessageQueue instance per consumer thread, or let several output threads share the queue through 
+		ConsumerGroupOutput.
+
+		By default it is up to the user to make sure not to push messages to a full channel. The channel (SIZE) 
+		must be dimensioned so that it never overflows. In debug builds, an assert will be hit if the channel is full
+		when pushing new messages, and in release builds the message is dropped. ThreadChannelInput::tryPushMessage()
+		returns false instead. TRAITS::overflowPolicy can also make full channels drop their oldest message, or make
+		the input thread wait for room, see OverflowPolicy.
+
+		It is also up to the user to never pop messages from an empty channel. This should be done by first 
+		getting the number of pending messages from the output channel and then popping exactly that many messages. 
+		This also makes sure the output thread will finish popping messages. In debug builds, an assert will be hit 
+		if the channel is empty when popping a message. Alternatively, ThreadChannelOutput::popMessages() and 
+		ThreadChannelOutput::drain() consume up to a given number of pending messages in one batch, and may be 
+		called on an empty channel. Batches are cheaper, since the read position is published once per batch.
+
+		Instead of handing out channel indices, input threads can claim a free channel with acquireInput(), which
+		hands it back when destroyed, or push through the queue with pushMessage(), which acquires a channel per 
+		thread on first use. The output thread visits claimed channels with forEachAcquiredChannel(), and channels
+		are reused once drained. This suits thread pools where threads come and go.
+
+		For many short lived producers that each send a few messages, set TRAITS::sharedChannelSize to add a shared
+		channel that any number of threads can push to, see getSharedChannelInput(). It is slower per message than
+		the per thread channels under contention, but needs no channel per producer.
+
+		Channels can be given a priority lane and a weight with setChannelPriority(), and drained by the queue level
+		drain(), which serves lanes in strict priority order and the channels within a lane by weighted deficit 
+		round-robin, up to a message budget per call.
+
+		With many channels, set TRAITS::enableReadyBitmap and let the output thread find non-empty channels with 
+		forEachReadyChannel() or nextReadyChannel(), instead of polling getNumMessages() on every channel.
+
+		A producer emitting bursts of messages can stage them with ThreadChannelInput::stageMessage() and publish 
+		them all at once with ThreadChannelInput::commit(), or use a PushBatch that commits when going out of scope.
+
+		Messages are defined as POD type structs, and a union of those structs is passed as a template parameter 
+		(MESSAGE) to LWMessageQueue. Push and pop operations copy the message data, so structs should be small enuough
+		so that this still is a cheap operation. To avoid the copy on push, ThreadChannelInput::reserve() returns a 
+		reference to the message data in the channel, and ThreadChannelInput::emplace() constructs the message in 
+		place. On the output side, ThreadChannelOutput::peek() and ThreadChannelOutput::getReadableMessages() give 
+		access to pending messages in place, and ThreadChannelOutput::release() removes them when done.
+
+		Messages of any type (from the MESSAGE union) can be pushed to an input channel. When popping messages you get 
+		an LWMessageQueue<>::MessageContainer instance. To get the actual message from the container, first call 
+		messageContainer.getType() to determine the type, comparing it with the supplied TYPES enum values, and then 
+		call messageContainer.getMessage<TYPE>() to get the message data cast to the correct POD type struct.
+
+		Instead of a union and an enum, MESSAGE can be a Messages<Message1, Message2, ...> list. TYPES then defaults 
+		to a one byte tag for up to 256 types, and is set from the message type by pushMessage(message), so a 
+		message can not be pushed with the wrong type. Messages are read with MessageContainer::visit() or 
+		ThreadChannelOutput::dispatch(), which call the overload of a visitor matching the message type through a 
+		constexpr table of functions. To pass TRAITS, give TYPES as MessageTag<MESSAGE>.
+
+		When SIZE and CHANNELS are both dynamicExtent, they are passed to the constructor instead. The channels and 
+		their rings are then allocated in one block by TRAITS::Allocator, huge page backed by default, and can be 
+		pre-faulted at construction. The ready bitmap is not available on runtime sized queues.
+
+		See the Example/Message.h and Example/example.cpp for more details on how to use LWMessageQueue and how to 
+		define messages.
+
+		Template parameters:
+		SIZE is the number of allowed pending messages in one channel, a power of two, or dynamicExtent.
+		CHANNELS is the number of channels, i.e. the number of input/producer threads, or dynamicExtent.
+		MESSAGE should be a union of all available Message types, or a Messages<> list of them. Message types are POD 
+		type structs with message specific data fields. See example message definitions and usage in 
+		Example/Message.h and Example/example.cpp.
+		TYPES should be a enum class with one entry per message type. See Example/Message.h and Example/example.cpp for
+		types definition. Optional when MESSAGE is a Messages<> list.
+		TRAITS is an optional configuration struct, see DefaultTraits.
+*/
+template<
+	uint32_t SIZE, 
+	uint32_t CHANNELS, 
+	typename MESSAGE, 
+	typename TYPES = typename Internal::MessageList<MESSAGE>::Tag, 
+	typename TRAITS = DefaultTraits>
+class LWMessageQueue {
+private:
+	class ThreadChannel;
+	using MessageList = Internal::MessageList<MESSAGE>;
+	using MessageStorage = typename MessageList::Storage;
+
+	static_assert(!std::is_void<TYPES>::value, "Template parameter TYPES is required when MESSAGE is a union.");
+public:
+	struct ChannelLayout;
+
+	/** Used for message storage in the queue. When you pop a message from an output channel, you get instances
+		of this type.
+	*/
+	class MessageContainer : private Internal::TraceStamp<(TRAITS::traceSampleInterval != 0)>, 
+		private Internal::ScheduleStamp<(TRAITS::scheduledMessageCapacity != 0)> 
+	{
+	public:
+		/** Get a reference to the message data, as the correct message type. */
+		template<typename T>
+		inline const T& getMessage() const noexcept;
+
+		/** Check if a message container contains a message of a specific type. */
+		inline TYPES getType() const noexcept;
+
+		/** Call inVisitor(const T&) with the message, as its own type T. Only available when MESSAGE is a 
+			Messages<> list, and the visitor must accept every type in the list, see Overloaded.
+		*/
+		template<typename V>
+		inline void visit(V&& inVisitor) const;
+
+	private:
+		TYPES type;
+		MessageStorage message;
+		friend class LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>;
+	};
+
+	/** A view of the messages that were pending in a channel when the view was created, in order. The messages are 
+		not copied, and stay valid until they are released with ThreadChannelOutput::release().
+	*/
+	class MessageRange {
+	public:
+		class Iterator {
+		public:
+			using iterator_category = std::forward_iterator_tag;
+			using value_type = MessageContainer;
+			using difference_type = ptrdiff_t;
+			using pointer = const MessageContainer*;
+			using reference = const MessageContainer&;
+
+			inline const MessageContainer& operator*() const noexcept;
+			inline const MessageContainer* operator->() const noexcept;
+			inline Iterator& operator++() noexcept;
+			inline bool operator==(const Iterator& other) const noexcept;
+			inline bool operator!=(const Iterator& other) const noexcept;
+
+		private:
+			Iterator(const MessageContainer* inElements, const uint32_t inIndexMask, const uint32_t inIndex) noexcept;
+
+			const MessageContainer* elements;
+			uint32_t indexMask;
+			uint32_t index;
+			friend class MessageRange;
+		};
+
+		inline Iterator begin() const noexcept;
+		inline Iterator end() const noexcept;
+		inline uint32_t size() const noexcept;
+		inline bool empty() const noexcept;
+		inline const MessageContainer& operator[](const uint32_t inIndex) const noexcept;
+
+	private:
+		MessageRange(
+			const MessageContainer* inElements, 
+			const uint32_t inIndexMask, 
+			const uint32_t inBeginIndex, 
+			const uint32_t inEndIndex) noexcept;
+
+		const MessageContainer* elements;
+		uint32_t indexMask;
+		uint32_t beginIndex;
+		uint32_t endIndex;
+		friend class LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>;
+	};
+
+	/** Each input thread has its own ThreadChannelInput instance. Use it to push messages to the queue. */
+	class ThreadChannelInput {
+	public:
+		ThreadChannelInput(LWMessageQueue& inMessageQueue, const uint32_t inChannel) noexcept;
+		ThreadChannelInput(const ThreadChannelInput& other) = default;
+		ThreadChannelInput& operator=(const ThreadChannelInput& other) = default;
+
+		/** Check if the channel is full. No more messages can be pushed without applying the overflow policy.
+		*/
+		inline bool isFull() const noexcept;
+
+		/** Push a message to the channel. If the channel is full, TRAITS::overflowPolicy decides what happens, see 
+			OverflowPolicy. With the default policy the user must make sure the channel is not full before calling.
+			Only one thread may push messages to a single channel.
+			@param inMessage Message data from the MESSAGE union.
+			@param inType Message type from the TYPES enum.
+		*/
+		template<typename T>
+		void pushMessage(const T& inMessage, const TYPES inType) noexcept;
+
+		/** Push a message to the channel if there is room for it. Never waits. With OverflowPolicy::OverwriteOldest
+			the oldest pending message is dropped to make room, and the push always succeeds.
+			@param inMessage Message data from the MESSAGE union.
+			@param inType Message type from the TYPES enum.
+			@return True if the message was pushed.
+		*/
+		template<typename T>
+		bool tryPushMessage(const T& inMessage, const TYPES inType) noexcept;
+
+		/** Write a message to the channel without making it visible to the output thread. Staged messages are 
+			published together by the next call to commit() or pushMessage(). If the channel has no free slot, 
+			the messages staged so far are committed, so that the output thread can make progress, and false is 
+			returned. The message is then not staged, and may be retried later.
+			@param inMessage Message data from the MESSAGE union.
+			@param inType Message type from the TYPES enum.
+			@return True if the message was staged.
+		*/
+		template<typename T>
+		bool stageMessage(const T& inMessage, const TYPES inType) noexcept;
+
+		/** Publish all staged messages to the output thread, with a single store. */
+		inline void commit() noexcept;
+
+		/** Reserve the next slot in the channel for a message of type T, and get a reference to its message data 
+			in place. Only sizeof(T) bytes are written when the caller fills in the message. The message becomes 
+			visible to the output thread on the next publish(), commit() or pushMessage(). A full channel is 
+			handled as in pushMessage(), except that with OverflowPolicy::Reject the user must make sure the channel 
+			is not full before calling.
+			@param inType Message type from the TYPES enum.
+			@return Reference to uninitialized message data in the channel.
+		*/
+		template<typename T>
+		T& reserve(const TYPES inType) noexcept;
+
+		/** Publish reserved and staged messages. Same as commit(). */
+		inline void publish() noexcept;
+
+		/** Construct a message of type T directly in the next slot of the channel from inArgs, and publish it. 
+			A full channel is handled as in pushMessage().
+			@param inType Message type from the TYPES enum.
+			@param inArgs Arguments used to initialize T, e.g. the field values of a POD struct.
+		*/
+		template<typename T, typename... Args>
+		void emplace(const TYPES inType, Args&&... inArgs) noexcept;
+
+		/** Same as the functions above, with the type set from T. Only available when MESSAGE is a Messages<> 
+			list, which in turn rejects the functions above at compile time, so that a tag can not mismatch T.
+		*/
+		template<typename T>
+		void pushMessage(const T& inMessage) noexcept;
+		template<typename T>
+		bool tryPushMessage(const T& inMessage) noexcept;
+		template<typename T>
+		bool stageMessage(const T& inMessage) noexcept;
+		template<typename T>
+		T& reserve() noexcept;
+
+		/** Push a copy of a message popped from a queue of the same type, keeping its type. Use it to forward or
+			replay messages. A full channel is handled as in tryPushMessage().
+			@return True if the message was pushed.
+		*/
+		inline bool tryForwardMessage(const MessageContainer& inMessage) noexcept;
+
+		/** Push a message that the output thread receives at inDeliveryTime or later, or after inDelay. Until then
+			the output thread holds it in the timing wheel of the queue, and delivers it through collectScheduled(),
+			popMessage(), popMessages() and drain() of the channel along with the immediate messages. A full channel is handled as 
+			in pushMessage(). Only available when TRAITS::scheduledMessageCapacity is set.
+			@param inMessage Message data from the MESSAGE union.
+			@param inType Message type from the TYPES enum.
+		*/
+		template<typename T>
+		void pushMessageAt(const T& inMessage, const TYPES inType, 
+			const std::chrono::steady_clock::time_point inDeliveryTime) noexcept;
+		template<typename T, typename REP, typename PERIOD>
+		void pushMessageAfter(const T& inMessage, const TYPES inType, 
+			const std::chrono::duration<REP, PERIOD> inDelay) noexcept;
+
+	private:
+		inline void commitStaged() noexcept;
+
+		/** Stage inMessage in the next slot of the channel if makeRoom(inWait) finds room for it.
+			@return True if the message was staged.
+		*/
+		template<typename T>
+		inline bool writeMessage(const T& inMessage, const TYPES inType, const bool inWait) noexcept;
+
+		/** Stage the next slot of the channel for a message of type T, see reserve(). */
+		template<typename T>
+		inline T& reserveMessage(const TYPES inType) noexcept;
+
+		/** Apply the overflow policy if the channel is full. Staged messages are committed first, so that the 
+			output thread can see them.
+			@param inWait Wait for room with OverflowPolicy::Block.
+			@return True if there is room for one more message.
+		*/
+		inline bool makeRoom(const bool inWait) noexcept;
+
+		LWMessageQueue& messageQueue;
+		ThreadChannel& threadChannel;
+		uint32_t channel;
+	};
+
+	/** Stages messages on a ThreadChannelInput and commits them when going out of scope. Use it to publish a 
+		burst of messages with one synchronization instead of one per message.
+	*/
+	class PushBatch {
+	public:
+		explicit PushBatch(ThreadChannelInput& inThreadChannelInput) noexcept;
+		~PushBatch();
+
+		PushBatch(const PushBatch&) = delete;
+		PushBatch& operator=(const PushBatch&) = delete;
+
+		/** See ThreadChannelInput::stageMessage(). */
+		template<typename T>
+		bool stageMessage(const T& inMessage, const TYPES inType) noexcept;
+		template<typename T>
+		bool stageMessage(const T& inMessage) noexcept;
+
+		/** Publish the messages staged so far. */
+		inline void commit() noexcept;
+
+	private:
+		ThreadChannelInput& threadChannelInput;
+	};
+
+	/** The single output thread has one ThreadChannelOutput instance per input thread. Use them to pop messages
+		from the queue. 
+	*/
+	class ThreadChannelOutput {
+	public:
+		ThreadChannelOutput(LWMessageQueue& inMessageQueue, const uint32_t inChannel) noexcept;
+		ThreadChannelOutput(const ThreadChannelOutput& other) = default;
+		ThreadChannelOutput& operator=(const ThreadChannelOutput& other) = default;
+
+		/** Get number of pending messages in the channel. The output thread should get this number and then pop
+			exactly that many messages from the channel. This way it is guaranteed that an empty channel is not 
+			popped and that the output thread receive loop finishes. With scheduled delivery, only the messages 
+			made poppable by the last collectScheduled() are counted.
+		*/
+		inline uint32_t getNumMessages() const noexcept;
+
+		/** Scheduled delivery only. Deliver due scheduled messages to the channel, and move the messages of the 
+			channel that are not due yet to the timing wheel of the queue. Call before getNumMessages() and 
+			popMessage(). popMessages() and drain() collect by themselves.
+			@return Number of messages that can be popped.
+		*/
+		inline uint32_t collectScheduled() noexcept;
+
+		/** Pop the next message from the channel. The user must make sure that the channel is not empty before 
+			calling. Only one thread may pop messages from all channels.
+
+			@return A MessageContainer. Check type by calling messageContainer.getType(); 
+			Then get the message data with correct type by calling messageContainer.getMessage<MESSAGE_TYPE>();
+		*/
+		inline MessageContainer popMessage() noexcept;
+
+		/** Pop up to inMaxMessages messages from the channel into an array. Cheaper than calling popMessage 
+			repeatedly, since the read position is published to the producer once for the whole batch. It is safe 
+			to call on an empty channel.
+			@param outMessages Array with room for at least inMaxMessages containers.
+			@param inMaxMessages Maximum number of messages to pop.
+			@return Number of messages popped.
+		*/
+		inline uint32_t popMessages(MessageContainer* outMessages, const uint32_t inMaxMessages) noexcept;
+
+		/** Call inFunction(const MessageContainer&) for up to inMaxMessages pending messages, in order. Messages 
+			are passed by reference to their slots in the channel and are not copied, so the reference must not be 
+			kept after inFunction returns. The read position is published once, after the last call. It is safe to 
+			call on an empty channel.
+			@return Number of messages processed.
+		*/
+		template<typename F>
+		uint32_t drain(F&& inFunction, const uint32_t inMaxMessages);
+
+		/** Like drain(), but call inVisitor(const T&) with each message as its own type T, see 
+			MessageContainer::visit(). Only available when MESSAGE is a Messages<> list.
+			@return Number of messages processed.
+		*/
+		template<typename V>
+		uint32_t dispatch(V&& inVisitor, const uint32_t inMaxMessages);
+
+		/** Get a reference to the next message in the channel without copying or removing it. The user must make 
+			sure that the channel is not empty before calling. The reference is valid until the message is 
+			released.
+		*/
+		inline const MessageContainer& peek() noexcept;
+
+		/** Get a view of all currently pending messages, without copying or removing them. Release the messages 
+			with release() when done with them.
+		*/
+		inline MessageRange getReadableMessages() noexcept;
+
+		/** Remove the next inNumMessages messages from the channel, handing their slots back to the input thread.
+			The messages must have been seen as pending, through getNumMessages(), peek() or getReadableMessages().
+		*/
+		inline void release(const uint32_t inNumMessages) noexcept;
+
+	private:
+		/** Call inFunction(const MessageContainer&) for up to inMaxMessages due scheduled messages. */
+		template<typename F>
+		uint32_t drainDue(F& inFunction, const uint32_t inMaxMessages);
+
+		LWMessageQueue& messageQueue;
+		ThreadChannel& threadChannel;
+		uint32_t channel;
+	};
+
+	/** Output of one of several output threads sharing the queue. The channels are split between the consumers,
+		channel % inNumConsumers, and a consumer that finds its own channels empty steals the most backlogged
+		channel of the others. A channel is read by at most one consumer at a time, guarded by its ownership 
+		token, so messages from one channel are still processed in order. The ThreadChannelOutput, ready channel
+		and waitForMessages() functions are for a single output thread and must not be mixed with this class. The 
+		shared channel is not part of the group.
+	*/
+	class ConsumerGroupOutput {
+	public:
+		ConsumerGroupOutput(LWMessageQueue& inMessageQueue, const uint32_t inConsumer, const uint32_t inNumConsumers) noexcept;
+		ConsumerGroupOutput(const ConsumerGroupOutput& other) = default;
+		ConsumerGroupOutput& operator=(const ConsumerGroupOutput& other) = default;
+
+		/** Call inFunction(const MessageContainer&) for up to inMaxMessagesPerChannel pending messages of each 
+			channel of this consumer that is not currently being read by another consumer. If none of them had 
+			pending messages, drain the channel of another consumer with the largest backlog instead. See 
+			ThreadChannelOutput::drain().
+			@return Number of messages processed.
+		*/
+		template<typename F>
+		uint32_t drain(F&& inFunction, const uint32_t inMaxMessagesPerChannel);
+
+		/** Index of this consumer in the group. */
+		inline uint32_t getConsumer() const noexcept;
+
+	private:
+		template<typename F>
+		uint32_t drainChannel(const uint32_t inChannel, F& inFunction, const uint32_t inMaxMessages);
+
+		LWMessageQueue* messageQueue;
+		uint32_t consumer;
+		uint32_t numConsumers;
+	};
+
+	/** Input of the shared channel. Unlike ThreadChannelInput, one instance may be used by any number of threads 
+		concurrently. Only available when TRAITS::sharedChannelSize is set.
+	*/
+	class SharedChannelInput {
+	public:
+		SharedChannelInput(LWMessageQueue& inMessageQueue) noexcept;
+		SharedChannelInput(const SharedChannelInput& other) = default;
+		SharedChannelInput& operator=(const SharedChannelInput& other) = default;
+
+		/** Push a message to the shared channel. The slot is claimed with a single fetch_add. If the channel is 
+			full, the claimed slot is still in use, and the calling thread waits for the output thread to free it.
+			@param inMessage Message data from the MESSAGE union.
+			@param inType Message type from the TYPES enum.
+		*/
+		template<typename T>
+		void pushMessage(const T& inMessage, const TYPES inType) noexcept;
+
+		/** Push a message to the shared channel if there is a free slot. Claims the slot with a compare and swap,
+			and never waits.
+			@return True if the message was pushed.
+		*/
+		template<typename T>
+		bool tryPushMessage(const T& inMessage, const TYPES inType) noexcept;
+
+		/** Same as the functions above, with the type set from T. Only available when MESSAGE is a Messages<> 
+			list, which in turn rejects the functions above at compile time.
+		*/
+		template<typename T>
+		void pushMessage(const T& inMessage) noexcept;
+		template<typename T>
+		bool tryPushMessage(const T& inMessage) noexcept;
+
+	private:
+		/** Claim a slot, waiting for it if inWait is set, and publish inMessage in it.
+			@return True if the message was pushed.
+		*/
+		template<typename T>
+		inline bool writeMessage(const T& inMessage, const TYPES inType, const bool inWait) noexcept;
+
+		LWMessageQueue& messageQueue;
+	};
+
+	/** Output of the shared channel, used by the output thread alongside the ThreadChannelOutput instances. */
+	class SharedChannelOutput {
+	public:
+		SharedChannelOutput(LWMessageQueue& inMessageQueue) noexcept;
+		SharedChannelOutput(const SharedChannelOutput& other) = default;
+		SharedChannelOutput& operator=(const SharedChannelOutput& other) = default;
+
+		/** Get number of messages that can be popped, in order. A message whose producer has claimed its slot but
+			not finished writing it is not counted, nor are messages after it. Walks the slots, so prefer drain() 
+			when the exact number is not needed.
+		*/
+		inline uint32_t getNumMessages() noexcept;
+
+		/** Pop the next message. The user must make sure that the channel is not empty before calling. */
+		inline MessageContainer popMessage() noexcept;
+
+		/** See ThreadChannelOutput::popMessages(). */
+		inline uint32_t popMessages(MessageContainer* outMessages, const uint32_t inMaxMessages) noexcept;
+
+		/** See ThreadChannelOutput::drain(). Each slot is handed back to the producers after its call. */
+		template<typename F>
+		uint32_t drain(F&& inFunction, const uint32_t inMaxMessages);
+
+	private:
+		LWMessageQueue& messageQueue;
+	};
+
+	/** A channel claimed from the queue's channel registry with acquireInput(). Owned by one input thread at a 
+		time, and moveable between threads. The channel is handed back when the AcquiredInput is destroyed or 
+		released, and becomes free for the next acquireInput() once the output thread has drained it.
+	*/
+	class AcquiredInput {
+	public:
+		/** An AcquiredInput without a channel. */
+		AcquiredInput() noexcept;
+		AcquiredInput(AcquiredInput&& other) noexcept;
+		AcquiredInput& operator=(AcquiredInput&& other) noexcept;
+		~AcquiredInput();
+
+		AcquiredInput(const AcquiredInput&) = delete;
+		AcquiredInput& operator=(const AcquiredInput&) = delete;
+
+		/** False if no channel was free when acquiring, or if the channel has been released. */
+		inline bool isValid() const noexcept;
+
+		/** Index of the acquired channel. */
+		inline uint32_t getChannel() const noexcept;
+
+		/** Get the input of the acquired channel. Must not be used after the channel is released. */
+		inline ThreadChannelInput getInput() const noexcept;
+
+		/** Commit staged messages and hand the channel back to the registry. */
+		void release() noexcept;
+
+	private:
+		AcquiredInput(LWMessageQueue& inMessageQueue, const uint32_t inChannel) noexcept;
+
+		LWMessageQueue* messageQueue;
+		uint32_t channel;
+		friend class LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>;
+	};
+
+	/** Construct a queue with compile time SIZE and CHANNELS.
+		@throws std::system_error If TRAITS::enableEventFd is set and the eventfd can not be created.
+	*/
+	LWMessageQueue() noexcept(!TRAITS::enableEventFd);
+
+	/** Construct a runtime sized queue. Only available when SIZE and CHANNELS are dynamicExtent.
+		@param inSize Number of allowed pending messages in one channel. Must be a power of two.
+		@param inChannels Number of channels, i.e. the number of input/producer threads.
+		@param inPrefault Touch all storage at construction, so that input threads do not take page faults on 
+			their first pushes.
+		@throws std::invalid_argument If inSize is not a power of two or inChannels is zero.
+		@throws std::bad_alloc If the storage can not be allocated.
+		@throws std::system_error If TRAITS::enableEventFd is set and the eventfd can not be created.
+	*/
+	LWMessageQueue(const uint32_t inSize, const uint32_t inChannels, const bool inPrefault = true);
+
+	~LWMessageQueue();
+
+	LWMessageQueue(const LWMessageQueue&) = delete;
+	LWMessageQueue& operator=(const LWMessageQueue&) = delete;
+	LWMessageQueue(const LWMessageQueue&&) = delete;
+	LWMessageQueue& operator=(const LWMessageQueue&&) = delete;
+
+	/** Get a thread channel input for an input thread. */
+	ThreadChannelInput getThreadChannelInput(const uint32_t inChannel) noexcept;
+
+	/** Get a thread channel output for the output thread. */
+	ThreadChannelOutput getThreadChannelOutput(const uint32_t inChannel) noexcept;
+
+	/** Get the output of consumer inConsumer of inNumConsumers output threads sharing the queue. */
+	ConsumerGroupOutput getConsumerGroupOutput(const uint32_t inConsumer, const uint32_t inNumConsumers) noexcept;
+
+	/** Get the input of the shared channel, for any number of input threads. */
+	SharedChannelInput getSharedChannelInput() noexcept;
+
+	/** Get the output of the shared channel, for the output thread. */
+	SharedChannelOutput getSharedChannelOutput() noexcept;
+
+	/** Claim a free channel from the registry, lock-free. Channels claimed this way must not also be bound by 
+		index with getThreadChannelInput().
+		@return The acquired channel, or an invalid AcquiredInput if all channels are in use.
+	*/
+	AcquiredInput acquireInput() noexcept;
+
+	/** Number of queues of this type that one thread can push to with pushMessage() while keeping a channel in 
+		each. Pushing to one more queue releases the channel cached for the queue pushed to first.
+	*/
+	static constexpr uint32_t threadInputCacheSize = 4;
+
+	/** Push a message from any thread, through a channel acquired for the calling thread on its first push and 
+		cached in a thread_local, per queue. The channel is released when the thread exits. Threads using this 
+		function must exit, or call releaseThreadInput(), before the queue is destroyed. A full channel is 
+		handled by TRAITS::overflowPolicy: Block waits, OverwriteOldest drops the oldest message, and Reject 
+		fails.
+		@param inMessage Message data from the MESSAGE union.
+		@param inType Message type from the TYPES enum.
+		@return False if no channel was free for the calling thread, or if the channel was full under 
+			OverflowPolicy::Reject. The message is then not pushed.
+	*/
+	template<typename T>
+	bool pushMessage(const T& inMessage, const TYPES inType) noexcept;
+
+	/** Same as above, with the type set from T. Only available when MESSAGE is a Messages<> list, which in turn
+		rejects the function above at compile time.
+	*/
+	template<typename T>
+	bool pushMessage(const T& inMessage) noexcept;
+
+	/** The tag of message type T, when MESSAGE is a Messages<> list. Compare with MessageContainer::getType(). */
+	template<typename T>
+	static constexpr TYPES getMessageType() noexcept;
+
+	/** Fingerprint of the layout of the queue and its message containers. Stored with data that outlives one 
+		build, such as a shared memory segment or a recording, and compared before the data is used as this type.
+	*/
+	static constexpr uint64_t layoutFingerprint() noexcept;
+
+	/** Release the channel cached for the calling thread by pushMessage(), if any. */
+	void releaseThreadInput() noexcept;
+
+	/** Call inFunction(uint32_t channel) for every channel acquired with acquireInput(), including released 
+		channels that still have pending messages. Released channels that have been drained when inFunction 
+		returns are handed back to the registry. Only the output thread may call it.
+		@return Number of channels visited.
+	*/
+	template<typename F>
+	uint32_t forEachAcquiredChannel(F&& inFunction);
+
+	/** Number of priority lanes of drain(). Lane 0 has the highest priority. */
+	static constexpr uint32_t numPriorityLanes = 8;
+
+	/** Messages a channel may send per round of drain() unless set with setChannelPriority(). */
+	static constexpr uint32_t defaultChannelWeight = 16;
+
+	/** Put a channel in a priority lane of drain(), with a weight. All channels start in lane 0 with 
+		defaultChannelWeight. Only the output thread may call it.
+		@param inLane Priority lane, below numPriorityLanes. Lane 0 has the highest priority.
+		@param inWeight Number of messages the channel may send per round, relative to other channels in the lane.
+	*/
+	void setChannelPriority(
+		const uint32_t inChannel, 
+		const uint32_t inLane, 
+		const uint32_t inWeight = defaultChannelWeight) noexcept;
+
+	/** Call inFunction(const MessageContainer&) for up to inBudget pending messages of all channels. A lane is only
+		served while all higher priority lanes are empty, and they are checked again after every round. Within a 
+		lane, the channels take turns in deficit round-robin, each sending up to its weight per round, so a 
+		backlogged channel can not starve the others. A round cut short by the budget is resumed by the next call.
+		Only the output thread may call it.
+		@return Number of messages processed.
+	*/
+	template<typename F>
+	uint32_t drain(F&& inFunction, const uint32_t inBudget);
+
+	/** Counters of one channel, see TRAITS::enableStats. */
+	struct ChannelStats {
+		/** Messages pushed, staged or reserved by the input thread. */
+		uint64_t numPushes = 0;
+		/** Messages removed by the output thread. */
+		uint64_t numPops = 0;
+		/** Pushes that found the channel full, before the overflow policy was applied. */
+		uint64_t numFullPushes = 0;
+		/** Reads by the output thread that found the channel at least three quarters full. */
+		uint64_t numNearFull = 0;
+		/** Reads by the output thread that found the channel empty. */
+		uint64_t numConsumerStalls = 0;
+		/** Most pending messages seen by the output thread in one read. */
+		uint32_t highWaterMark = 0;
+	};
+
+	/** Copy the counters of the first inMaxChannels channels. May be called from any thread, while the queue is in
+		use. Each counter is read atomically, but counters are not read at the same instant. Only available when 
+		TRAITS::enableStats is set.
+		@return Number of channels copied.
+	*/
+	uint32_t snapshotStats(ChannelStats* outStats, const uint32_t inMaxChannels) const noexcept;
+
+	/** Time sampled messages waited in one channel, from push to pop, in nanoseconds. Each percentile is the 
+		highest value of the histogram bucket it falls in, see TRAITS::traceSampleInterval.
+	*/
+	struct LatencyPercentiles {
+		uint64_t numSamples = 0;
+		uint64_t p50 = 0;
+		uint64_t p90 = 0;
+		uint64_t p99 = 0;
+		uint64_t p999 = 0;
+		uint64_t max = 0;
+	};
+
+	/** Latency percentiles of inChannel. May be called from any thread, while the queue is in use. Only available
+		when TRAITS::traceSampleInterval is set.
+	*/
+	LatencyPercentiles getLatencyPercentiles(const uint32_t inChannel) const noexcept;
+
+	/** Write the latency percentiles of every channel with samples as CSV, one line per channel, after a 
+		"channel,samples,p50_ns,p90_ns,p99_ns,p999_ns,max_ns" header line.
+	*/
+	void dumpLatencyPercentiles(std::ostream& outStream) const;
+
+	/** Number of allowed pending messages in one channel. */
+	inline uint32_t getChannelSize() const noexcept;
+
+	/** Number of channels. */
+	inline uint32_t getNumChannels() const noexcept;
+
+	/** Call inFunction(uint32_t channel) for every channel that has become non-empty since it was last visited. 
+		Channels are visited in index order. A channel that still has pending messages when inFunction returns 
+		is visited again by the next call. Only available when TRAITS::enableReadyBitmap is set, and only the 
+		output thread may call it.
+		@return Number of channels visited.
+	*/
+	template<typename F>
+	uint32_t forEachReadyChannel(F&& inFunction);
+
+	/** Take the next channel that has become non-empty. If the channel returned by the previous call still has 
+		pending messages, it is made ready again. Only available when TRAITS::enableReadyBitmap is set, and only 
+		the output thread may call it.
+		@param outChannel Set to the ready channel index.
+		@return False if no channel is ready.
+	*/
+	bool nextReadyChannel(uint32_t& outChannel) noexcept;
+
+	/** Block the output thread until a channel has pending messages, or inTimeout has passed. Spins for a short 
+		while, then yields, and then sleeps until an input thread publishes messages. Only available when 
+		TRAITS::enableBlockingWait is set, and only the output thread may call it. With TRAITS::enableReadyBitmap
+		also set, channels count as pending until taken with forEachReadyChannel() or nextReadyChannel().
+		@return True if a channel has pending messages, false on timeout.
+	*/
+	template<typename REP, typename PERIOD>
+	bool waitForMessages(const std::chrono::duration<REP, PERIOD>& inTimeout);
+
+	/** Get the eventfd to add to an epoll set, for EPOLLIN. Only available when TRAITS::enableEventFd is set. */
+	int getEventFd() const noexcept;
+
+	/** Arm the eventfd before waiting on it, so that the next input thread to publish messages makes it readable.
+		Only the output thread may call it. Readiness is reset by arming again, so call it before every wait, 
+		after draining the channels. With TRAITS::enableReadyBitmap also set, channels count as pending until 
+		taken with forEachReadyChannel() or nextReadyChannel(). Only available when TRAITS::enableEventFd is set.
+		@return True if armed. False if a channel has pending messages, which should be drained before arming 
+		again.
+	*/
+	bool armEventFd() noexcept;
+
+private:
+	/** Per channel state of drain(). deficit is the number of messages the channel may still send in the current
+		round, and is only non-zero between calls when a round was cut short by the budget.
+	*/
+	struct DrainSchedule {
+		uint32_t lane = 0;
+		uint32_t weight = defaultChannelWeight;
+		uint32_t deficit = 0;
+	};
+
+	/** Single producer, single consumer ring buffer. writeIndex and readIndex are free running counters, masked
+		when indexing elements. The producer and the consumer own one index each, kept on separate cache lines, and
+		each side keeps a cached copy of the other side's index that is only refreshed when the cached value
+		says the channel is full (producer) or empty (consumer).
+	*/
+	class alignas(TRAITS::cacheLineSize) ThreadChannel {
+	public:
+		ThreadChannel() noexcept;
+
+		/** Channel of a runtime sized queue, using inSize elements allocated by the queue. */
+		ThreadChannel(MessageContainer* inElements, const uint32_t inSize) noexcept;
+		~ThreadChannel() = default;
+
+		ThreadChannel(const ThreadChannel&) = delete;
+		const ThreadChannel& operator=(const ThreadChannel&) = delete;
+		ThreadChannel(const ThreadChannel&&) = delete;
+		const ThreadChannel& operator=(const ThreadChannel&&) = delete;
+
+		/** Producer side. Elements are staged at stagedWriteIndex and become visible to the consumer when 
+			writeIndex is moved up to it by commit(). isFull() loads the read position and leaves the producer's 
+			cached copy alone, refreshIsFull() only loads it when the cached copy says full, and keeps it.
+		*/
+		inline bool isFull() const noexcept;
+		inline bool refreshIsFull() noexcept;
+		inline MessageContainer& stageBack() noexcept;
+		inline bool commit() noexcept;
+		inline void dropFront() noexcept;
+
+		/** Registry. Free channels are claimed by an input thread, released by it, and made free again by the
+			consumer once drained.
+		*/
+		inline bool tryAcquire() noexcept;
+		inline void releaseAcquired() noexcept;
+		inline bool isAcquired() const noexcept;
+		inline void reclaimIfDrained() noexcept;
+
+		/** Consumer group. The consumer side may only be used by the consumer holding the ownership token. 
+			backlog() may be called by any thread, and is approximate.
+		*/
+		inline bool tryClaimOwnership(const uint32_t inConsumer) noexcept;
+		inline void releaseOwnership() noexcept;
+		inline uint32_t backlog() const noexcept;
+
+		/** Counters, see TRAITS::enableStats. onFullPush() is called by the input thread. */
+		inline void onFullPush() noexcept { producer.stats.onFullPush(); }
+		inline void snapshotStats(ChannelStats& outStats) const noexcept;
+		inline LatencyPercentiles getLatencyPercentiles() const noexcept;
+
+		/** Priority lane, weight and deficit of the channel in drain(). Output thread only. */
+		inline DrainSchedule& getSchedule() noexcept { return consumer.schedule; }
+
+		/** Consumer side. size() is for internal probes and leaves the counters alone, countedSize() counts the read
+			in the stats and is used by the public read paths.
+		*/
+		inline uint32_t size() noexcept;
+		inline uint32_t countedSize() noexcept;
+		MessageContainer popFront() noexcept;
+
+		inline const MessageContainer& front() noexcept;
+		inline MessageRange readableElements() noexcept;
+		inline void popFront(const uint32_t inNumElements) noexcept;
+
+		/** Call inFunction(MessageContainer* inRun, uint32_t inRunLength) for the contiguous runs of up to 
+			inMaxElements pending elements, then publish the new read position once. 
+		*/
+		template<typename F>
+		uint32_t consumeRuns(F&& inFunction, const uint32_t inMaxElements);
+
+		/** consumeRuns() with scheduled delivery. Only swept elements are pending, and the runs end at removed
+			ones.
+		*/
+		template<typename F>
+		uint32_t consumeSwept(F& inFunction, const uint32_t inReadIndex, const uint32_t inMaxElements);
+
+		/** What a sweepScheduled() callback does with a scheduled message. */
+		enum class SweepAction {
+			Keep,
+			Remove,
+			Stop
+		};
+
+		/** Call inSchedule(const MessageContainer&) for every pending message with a delivery time that was not
+			swept before, in order. Removed messages are marked and left in place, so a sweep only touches the
+			messages that arrived since the previous one. The read paths skip them, and their slots go back to 
+			the producer once the read position passes them. Stop leaves the message and those after it for the 
+			next sweep, and they are not counted or popped until then.
+			@return Number of swept messages that can be popped.
+		*/
+		template<typename F>
+		uint32_t sweepScheduled(F&& inSchedule);
+
+		/** Number of swept messages that can be popped, as of the last sweepScheduled(). */
+		inline uint32_t sweptSize() const noexcept;
+
+		inline uint32_t capacity() const noexcept { return ring.capacity(); }
+		inline uint32_t indexMask() const noexcept { return ring.capacity() - 1; }
+
+		static constexpr size_t producerOffset() noexcept { return offsetof(ThreadChannel, producer); }
+		static constexpr size_t consumerOffset() noexcept { return offsetof(ThreadChannel, consumer); }
+		static constexpr size_t elementsOffset() noexcept { return offsetof(ThreadChannel, ring); }
+
+	private:
+		/** Written by the input thread only. */
+		struct alignas(TRAITS::cacheLineSize) ProducerState {
+			std::atomic<uint32_t> writeIndex{0};
+			uint32_t stagedWriteIndex = 0;
+			uint32_t cachedReadIndex = 0;
+			Internal::ProducerStats<TRAITS::enableStats> stats;
+			Internal::TraceSampler<TRAITS::traceSampleInterval> traceSampler;
+		};
+
+		/** Written by the output thread, by input threads when acquiring and releasing the channel, and by 
+			the output threads of a consumer group when taking turns reading the channel.
+		*/
+		struct alignas(TRAITS::cacheLineSize) ConsumerState {
+			std::atomic<uint32_t> readIndex{0};
+			uint32_t cachedWriteIndex = 0;
+			std::atomic<uint32_t> registration{registrationFree};
+			std::atomic<uint32_t> owner{noOwner};
+			DrainSchedule schedule;
+			Internal::LatencyHistogram<TRAITS::cacheLineSize, (TRAITS::traceSampleInterval != 0)> latency;
+			/** Scheduled delivery. Messages before sweptIndex have been swept, and numRemoved of them are 
+				marked removed. readIndex is never left on a removed message.
+			*/
+			std::conditional_t<(TRAITS::scheduledMessageCapacity != 0), uint32_t, Internal::Disabled> sweptIndex{};
+			std::conditional_t<(TRAITS::scheduledMessageCapacity != 0), uint32_t, Internal::Disabled> numRemoved{};
+			Internal::ConsumerStats<TRAITS::enableStats> stats;
+		};
+
+		/** Record the delay of inElement in the latency histogram, if it was sampled. Output thread only. */
+		inline void traceLatency(const MessageContainer& inElement) noexcept;
+
+		/** First index from inIndex that is not a removed message, at most sweptIndex. The removed messages 
+			passed are no longer counted. Output thread only.
+		*/
+		inline uint32_t skipRemoved(uint32_t inIndex) noexcept;
+
+		static constexpr uint32_t registrationFree = 0;
+		static constexpr uint32_t registrationAcquired = 1;
+		static constexpr uint32_t registrationReleased = 2;
+
+		static constexpr uint32_t noOwner = 0xffffffff;
+
+		ProducerState producer;
+		ConsumerState consumer;
+		Internal::ChannelRing<MessageContainer, SIZE, TRAITS::cacheLineSize> ring;
+
+		friend struct ChannelLayout;
+	};
+
+	/** Bounded multi producer, single consumer ring. Producers claim a slot by incrementing writeIndex, and every 
+		slot has a sequence number telling whose turn it is: index when free for the producer of index, index + 1
+		when holding the message of index, and index + SIZE once the consumer has freed it for the next lap. 
+		Producers therefore never read the consumer's position, and the consumer never reads writeIndex.
+	*/
+	class alignas(TRAITS::cacheLineSize) SharedChannel {
+	public:
+		SharedChannel() noexcept;
+
+		SharedChannel(const SharedChannel&) = delete;
+		const SharedChannel& operator=(const SharedChannel&) = delete;
+
+		/** Producer side. claim() waits until the claimed slot is free, tryClaim() returns nullptr if the channel 
+			is full. The message must be written to the slot before publish().
+		*/
+		inline MessageContainer& claim(uint32_t& outIndex) noexcept;
+		inline MessageContainer* tryClaim(uint32_t& outIndex) noexcept;
+		inline void publish(const uint32_t inIndex) noexcept;
+
+		/** Consumer side. */
+		inline const MessageContainer* front() noexcept;
+		inline void popFront() noexcept;
+		inline uint32_t size() noexcept;
+
+	private:
+		static constexpr uint32_t sharedSize = TRAITS::sharedChannelSize;
+
+		struct Slot {
+			std::atomic<uint32_t> sequence;
+			MessageContainer element;
+		};
+
+		/** Written by the input threads. */
+		alignas(TRAITS::cacheLineSize) std::atomic<uint32_t> writeIndex{0};
+
+		/** Written by the output thread only. */
+		alignas(TRAITS::cacheLineSize) uint32_t readIndex = 0;
+
+		alignas(TRAITS::cacheLineSize) Slot slots[sharedSize];
+	};
+
+	template<typename T>
+	static inline T& getMessageData(MessageContainer& inMessageContainer, const TYPES inType) noexcept;
+
+	inline void onMessagesPublished(const uint32_t inChannel) noexcept;
+	inline void onSharedMessagePublished() noexcept;
+
+	/** The channel acquired by the calling thread for pushMessage() to one queue. */
+	struct ThreadInput {
+		LWMessageQueue* messageQueue = nullptr;
+		AcquiredInput acquiredInput;
+	};
+
+	/** The channels acquired by the calling thread, for up to threadInputCacheSize queues. When all are in use, 
+		the next one to evict is nextEvicted.
+	*/
+	struct ThreadInputCache {
+		ThreadInput threadInputs[threadInputCacheSize];
+		uint32_t nextEvicted = 0;
+	};
+
+	static inline ThreadInputCache& getThreadInputCache() noexcept;
+
+	/** The cached channel of the calling thread for this queue, or nullptr if it has none. */
+	inline ThreadInput* findThreadInput() noexcept;
+
+	/** The channel cached for the calling thread by pushMessage(), acquired on first use, or nullptr if no 
+		channel is free.
+	*/
+	inline AcquiredInput* getCachedInput() noexcept;
+
+	/** Run one deficit round-robin round over the channels of inLane, starting where the previous round stopped. */
+	template<typename F>
+	uint32_t drainLane(const uint32_t inLane, F& inFunction, const uint32_t inBudget);
+
+	/** Hand the released channel inChannel back to the registry once it is drained, including the scheduled 
+		messages of the channel still in the timing wheel. Output thread only.
+	*/
+	inline void reclaimIfDrained(const uint32_t inChannel) noexcept;
+
+	/** Written by the output thread only. usedLanes has a bit for every lane that may have channels. */
+	struct alignas(TRAITS::cacheLineSize) DrainScheduler {
+		uint32_t usedLanes = 1;
+		uint32_t nextChannel[numPriorityLanes] = {};
+	};
+
+	Internal::ChannelArray<ThreadChannel, CHANNELS> threadChannels;
+	inline bool hasMessages() noexcept;
+
+	/** Set when any thread caches a channel with pushMessage(), so that the destructor only looks at the 
+		thread_local cache of a thread that may have used it.
+	*/
+	std::atomic<bool> hasThreadInputs{false};
+
+	Internal::ReadyBitmap<CHANNELS, TRAITS::cacheLineSize, TRAITS::enableReadyBitmap> readyBitmap;
+	Internal::ConsumerParker<TRAITS::cacheLineSize, TRAITS::enableBlockingWait> consumerParker;
+	Internal::EventNotifier<TRAITS::cacheLineSize, TRAITS::enableEventFd> eventNotifier;
+	DrainScheduler drainScheduler;
+
+	static constexpr bool hasSharedChannel = (TRAITS::sharedChannelSize != 0);
+	std::conditional_t<hasSharedChannel, SharedChannel, Internal::Disabled> sharedChannel;
+
+	static constexpr bool isDynamic = (SIZE == dynamicExtent);
+	static_assert(isDynamic == (CHANNELS == dynamicExtent), "SIZE and CHANNELS must both be dynamicExtent, or neither.");
+	static_assert(!isDynamic || !TRAITS::enableReadyBitmap, "Runtime sized queues do not support the ready bitmap.");
+	static constexpr bool overwriteOldest = (TRAITS::overflowPolicy == OverflowPolicy::OverwriteOldest);
+	static constexpr bool tracing = (TRAITS::traceSampleInterval != 0);
+	static constexpr bool scheduling = (TRAITS::scheduledMessageCapacity != 0);
+	static_assert(!scheduling || (!isDynamic && !TRAITS::enableReadyBitmap && !TRAITS::enableBlockingWait && 
+		!TRAITS::enableEventFd && !overwriteOldest), "Scheduled delivery needs a static size queue without the ready "
+		"bitmap, the blocking wait, the eventfd or OverflowPolicy::OverwriteOldest.");
+#if !defined(__linux__)
+	static_assert(!TRAITS::enableEventFd, "TRAITS::enableEventFd is only supported on Linux.");
+#endif
+
+	/** Messages of every channel that are not due yet. Written by the output thread only. */
+	using TimerWheel = Internal::TimerWheel<MessageContainer, TRAITS::scheduledMessageCapacity, CHANNELS>;
+	std::conditional_t<scheduling, TimerWheel, Internal::Disabled> timerWheel;
+
+	/** Delivery times of scheduled messages are never zero, which means immediate, or removedMark. */
+	static constexpr uint64_t removedMark = ~uint64_t(0);
+
+public:
+	/** Compile time description of the memory layout of one channel. Offsets are relative to the start of the 
+		channel, and the channels of a queue are laid out back to back with a stride of channelSize. Producer 
+		state, consumer state and the message ring each start on a cache line boundary.
+	*/
+	struct ChannelLayout {
+		static constexpr size_t cacheLineSize = TRAITS::cacheLineSize;
+		static constexpr size_t channelAlignment = alignof(ThreadChannel);
+		static constexpr size_t channelSize = sizeof(ThreadChannel);
+		static constexpr size_t producerOffset = ThreadChannel::producerOffset();
+		static constexpr size_t producerSize = sizeof(typename ThreadChannel::ProducerState);
+		static constexpr size_t consumerOffset = ThreadChannel::consumerOffset();
+		static constexpr size_t consumerSize = sizeof(typename ThreadChannel::ConsumerState);
+		static constexpr size_t elementsOffset = ThreadChannel::elementsOffset();
+		/** Zero for runtime sized queues, whose rings are allocated separately. */
+		static constexpr size_t elementsSize = sizeof(MessageContainer) * SIZE;
+	};
+};
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+template<typename T>
+inline const T& LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::MessageContainer::getMessage() const noexcept {
+	if constexpr (MessageList::isTyped) {
+		assert(type == getMessageType<T>());
+	}
+	return *(reinterpret_cast<const T*>(&message));
+}
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+inline TYPES LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::MessageContainer::getType() const noexcept {
+	return type;
+}
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+template<typename V>
+inline void LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::MessageContainer::visit(V&& inVisitor) const {
+	static_assert(MessageList::isTyped, "visit() requires MESSAGE to be a Messages<> list.");
+	MessageList::visit(message, type, inVisitor);
+}
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::MessageRange::Iterator::Iterator(
+	const MessageContainer* inElements,
+	const uint32_t inIndexMask,
+	const uint32_t inIndex) noexcept
+	: elements(inElements),
+	indexMask(inIndexMask),
+	index(inIndex)
+{
+}
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+inline const typename LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::MessageContainer& 
+LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::MessageRange::Iterator::operator*() const noexcept {
+	return elements[index & indexMask];
+}
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+inline const typename LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::MessageContainer* 
+LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::MessageRange::Iterator::operator->() const noexcept {
+	return &elements[index & indexMask];
+}
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+inline typename LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::MessageRange::Iterator& 
+LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::MessageRange::Iterator::operator++() noexcept {
+	++index;
+	return *this;
+}
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+inline bool LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::MessageRange::Iterator::operator==(
+	const Iterator& other) const noexcept
+{
+	return index == other.index;
+}
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+inline bool LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::MessageRange::Iterator::operator!=(
+	const Iterator& other) const noexcept
+{
+	return index != other.index;
+}
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::MessageRange::MessageRange(
+	const MessageContainer* inElements,
+	const uint32_t inIndexMask,
+	const uint32_t inBeginIndex,
+	const uint32_t inEndIndex) noexcept
+	: elements(inElements),
+	indexMask(inIndexMask),
+	beginIndex(inBeginIndex),
+	endIndex(inEndIndex)
+{
+}
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+inline typename LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::MessageRange::Iterator 
+LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::MessageRange::begin() const noexcept {
+	return Iterator(elements, indexMask, beginIndex);
+}
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+inline typename LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::MessageRange::Iterator 
+LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::MessageRange::end() const noexcept {
+	return Iterator(elements, indexMask, endIndex);
+}
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+inline uint32_t LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::MessageRange::size() const noexcept {
+	return endIndex - beginIndex;
+}
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+inline bool LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::MessageRange::empty() const noexcept {
+	return endIndex == beginIndex;
+}
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+inline const typename LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::MessageContainer& 
+LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::MessageRange::operator[](const uint32_t inIndex) const noexcept {
+	assert(inIndex < size());
+	return elements[(beginIndex + inIndex) & indexMask];
+}
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::ThreadChannelInput::ThreadChannelInput(
+	LWMessageQueue& inMessageQueue,
+	const uint32_t inChannel) noexcept
+	: messageQueue(inMessageQueue),
+	threadChannel(inMessageQueue.threadChannels[inChannel]),
+	channel(inChannel)
+{
+}
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+inline bool LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::ThreadChannelInput::isFull() const noexcept {
+	return threadChannel.isFull();
+}
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+template<typename T>
+void LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::ThreadChannelInput::pushMessage(
+	const T& inMessage,
+	const TYPES type) noexcept
+{
+	static_assert(!MessageList::isTyped, "With a Messages<> list the type is derived, use pushMessage(inMessage).");
+	if (!writeMessage(inMessage, type, true)) {
+		assert(!"Pushing to a full channel.");
+		return;
+	}
+
+	commitStaged();
+}
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+template<typename T>
+bool LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::ThreadChannelInput::tryPushMessage(
+	const T& inMessage,
+	const TYPES type) noexcept
+{
+	static_assert(!MessageList::isTyped, "With a Messages<> list the type is derived, use tryPushMessage(inMessage).");
+	if (!writeMessage(inMessage, type, false)) {
+		return false;
+	}
+
+	commitStaged();
+	return true;
+}
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+template<typename T>
+bool LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::ThreadChannelInput::stageMessage(
+	const T& inMessage,
+	const TYPES type) noexcept
+{
+	static_assert(!MessageList::isTyped, "With a Messages<> list the type is derived, use stageMessage(inMessage).");
+	return writeMessage(inMessage, type, false);
+}
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+inline bool LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::ThreadChannelInput::tryForwardMessage(
+	const MessageContainer& inMessage) noexcept
+{
+	if (!makeRoom(false)) {
+		return false;
+	}
+
+	MessageContainer& element = threadChannel.stageBack();
+	element.type = inMessage.type;
+	element.message = inMessage.message;
+	commitStaged();
+	return true;
+}
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+template<typename T>
+void LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::ThreadChannelInput::pushMessageAt(
+	const T& inMessage,
+	const TYPES type,
+	const std::chrono::steady_clock::time_point inDeliveryTime) noexcept
+{
+	static_assert(scheduling, "pushMessageAt() requires TRAITS::scheduledMessageCapacity.");
+
+	if (!makeRoom(true)) {
+		assert(!"Pushing to a full channel.");
+		return;
+	}
+
+	// Zero means immediate and removedMark a removed message, so neither is a valid delivery time.
+	const int64_t deliveryTime = std::chrono::duration_cast<std::chrono::nanoseconds>(
+		inDeliveryTime.time_since_epoch()).count();
+	MessageContainer& element = threadChannel.stageBack();
+	element.deliveryTime = std::min<uint64_t>(std::max<int64_t>(deliveryTime, 1), removedMark - 1);
+	getMessageData<T>(element, type) = inMessage;
+	commitStaged();
+}
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+template<typename T, typename REP, typename PERIOD>
+void LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::ThreadChannelInput::pushMessageAfter(
+	const T& inMessage,
+	const TYPES type,
+	const std::chrono::duration<REP, PERIOD> inDelay) noexcept
+{
+	pushMessageAt(inMessage, type, std::chrono::steady_clock::now() + 
+		std::chrono::duration_cast<std::chrono::steady_clock::duration>(inDelay));
+}
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+inline void LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::ThreadChannelInput::commit() noexcept {
+	commitStaged();
+}
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+template<typename T>
+T& LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::ThreadChannelInput::reserve(const TYPES type) noexcept {
+	static_assert(!MessageList::isTyped, "With a Messages<> list the type is derived, use reserve<T>().");
+	return reserveMessage<T>(type);
+}
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+inline void LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::ThreadChannelInput::publish() noexcept {
+	commitStaged();
+}
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+template<typename T, typename... Args>
+void LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::ThreadChannelInput::emplace(
+	const TYPES type,
+	Args&&... inArgs) noexcept
+{
+	if (!makeRoom(true)) {
+		assert(!"Pushing to a full channel.");
+		return;
+	}
+
+	new (&getMessageData<T>(threadChannel.stageBack(), type)) T{std::forward<Args>(inArgs)...};
+	commitStaged();
+}
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+template<typename T>
+inline T& LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::getMessageData(
+	MessageContainer& inMessageContainer,
+	const TYPES type) noexcept
+{
+	static_assert(sizeof(T) <= sizeof(MessageStorage), "Type T might not be part of union MESSAGE. Size mismatch.");
+	static_assert(alignof(MessageStorage) % alignof(T) == 0, 
+		"Type T might not be part of union MESSAGE. Alignment mismatch.");
+	if constexpr (MessageList::isTyped) {
+		assert(type == getMessageType<T>());
+	}
+	inMessageContainer.type = type;
+
+	return *reinterpret_cast<T*>(&inMessageContainer.message);
+}
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+template<typename T>
+void LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::ThreadChannelInput::pushMessage(const T& inMessage) noexcept {
+	if (!writeMessage(inMessage, getMessageType<T>(), true)) {
+		assert(!"Pushing to a full channel.");
+		return;
+	}
+
+	commitStaged();
+}
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+template<typename T>
+bool LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::ThreadChannelInput::tryPushMessage(const T& inMessage) noexcept {
+	if (!writeMessage(inMessage, getMessageType<T>(), false)) {
+		return false;
+	}
+
+	commitStaged();
+	return true;
+}
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+template<typename T>
+bool LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::ThreadChannelInput::stageMessage(const T& inMessage) noexcept {
+	return writeMessage(inMessage, getMessageType<T>(), false);
+}
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+template<typename T>
+T& LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::ThreadChannelInput::reserve() noexcept {
+	return reserveMessage<T>(getMessageType<T>());
+}
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+template<typename T>
+inline bool LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::ThreadChannelInput::writeMessage(
+	const T& inMessage,
+	const TYPES inType,
+	const bool inWait) noexcept
+{
+	if (!makeRoom(inWait)) {
+		return false;
+	}
+
+	getMessageData<T>(threadChannel.stageBack(), inType) = inMessage;
+	return true;
+}
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+template<typename T>
+inline T& LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::ThreadChannelInput::reserveMessage(
+	const TYPES inType) noexcept
+{
+	const bool hasRoom = makeRoom(true);
+	assert(hasRoom);
+	(void)hasRoom;
+
+	return getMessageData<T>(threadChannel.stageBack(), inType);
+}
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+inline void LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::ThreadChannelInput::commitStaged() noexcept {
+	if (threadChannel.commit()) {
+		messageQueue.onMessagesPublished(channel);
+	}
+}
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+inline bool LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::ThreadChannelInput::makeRoom(const bool inWait) noexcept {
+	if (!threadChannel.refreshIsFull()) {
+		return true;
+	}
+	threadChannel.onFullPush();
+	commitStaged();
+
+	if constexpr (TRAITS::overflowPolicy == OverflowPolicy::OverwriteOldest) {
+		(void)inWait;
+		threadChannel.dropFront();
+		return true;
+	} else if constexpr (TRAITS::overflowPolicy == OverflowPolicy::Block) {
+		if (!inWait) {
+			return false;
+		}
+		for (uint32_t spin = 0; threadChannel.refreshIsFull(); ++spin) {
+			Internal::backoff(spin);
+		}
+		return true;
+	} else {
+		(void)inWait;
+		return false;
+	}
+}
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::PushBatch::PushBatch(
+	ThreadChannelInput& inThreadChannelInput) noexcept
+	: threadChannelInput(inThreadChannelInput)
+{
+}
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::PushBatch::~PushBatch() {
+	threadChannelInput.commit();
+}
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+template<typename T>
+bool LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::PushBatch::stageMessage(
+	const T& inMessage,
+	const TYPES type) noexcept
+{
+	return threadChannelInput.stageMessage(inMessage, type);
+}
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+template<typename T>
+bool LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::PushBatch::stageMessage(const T& inMessage) noexcept {
+	return threadChannelInput.stageMessage(inMessage);
+}
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+inline void LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::PushBatch::commit() noexcept {
+	threadChannelInput.commit();
+}
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::ConsumerGroupOutput::ConsumerGroupOutput(
+	LWMessageQueue& inMessageQueue,
+	const uint32_t inConsumer,
+	const uint32_t inNumConsumers) noexcept
+	: messageQueue(&inMessageQueue)
+	, consumer(inConsumer)
+	, numConsumers(inNumConsumers)
+{
+	static_assert(!TRAITS::enableReadyBitmap, "ConsumerGroupOutput does not support TRAITS::enableReadyBitmap.");
+	assert(inConsumer < inNumConsumers);
+}
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+template<typename F>
+uint32_t LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::ConsumerGroupOutput::drain(
+	F&& inFunction,
+	const uint32_t inMaxMessagesPerChannel)
+{
+	static_assert(!scheduling, "Scheduled delivery needs a single output thread.");
+
+	const uint32_t numChannels = messageQueue->threadChannels.size();
+	uint32_t numMessages = 0;
+	for (uint32_t channel = consumer; channel < numChannels; channel += numConsumers) {
+		numMessages += drainChannel(channel, inFunction, inMaxMessagesPerChannel);
+	}
+	if (numMessages != 0) {
+		return numMessages;
+	}
+
+	// Idle, help the consumer that is furthest behind.
+	uint32_t stolenChannel = numChannels;
+	uint32_t largestBacklog = 0;
+	for (uint32_t channel = 0; channel < numChannels; ++channel) {
+		const uint32_t backlog = messageQueue->threadChannels[channel].backlog();
+		if (backlog > largestBacklog && channel % numConsumers != consumer) {
+			stolenChannel = channel;
+			largestBacklog = backlog;
+		}
+	}
+	if (stolenChannel != numChannels) {
+		numMessages = drainChannel(stolenChannel, inFunction, inMaxMessagesPerChannel);
+	}
+	return numMessages;
+}
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+inline uint32_t LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::ConsumerGroupOutput::getConsumer() const noexcept {
+	return consumer;
+}
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+template<typename F>
+uint32_t LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::ConsumerGroupOutput::drainChannel(
+	const uint32_t inChannel,
+	F& inFunction,
+	const uint32_t inMaxMessages)
+{
+	ThreadChannel& threadChannel = messageQueue->threadChannels[inChannel];
+	if (!threadChannel.tryClaimOwnership(consumer)) {
+		return 0;
+	}
+
+	const uint32_t numMessages = ThreadChannelOutput(*messageQueue, inChannel).drain(inFunction, inMaxMessages);
+	if (numMessages < inMaxMessages) {
+		threadChannel.reclaimIfDrained();
+	}
+	threadChannel.releaseOwnership();
+	return numMessages;
+}
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::SharedChannelInput::SharedChannelInput(
+	LWMessageQueue& inMessageQueue) noexcept
+	: messageQueue(inMessageQueue)
+{
+}
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+template<typename T>
+void LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::SharedChannelInput::pushMessage(
+	const T& inMessage,
+	const TYPES type) noexcept
+{
+	static_assert(!MessageList::isTyped, "With a Messages<> list the type is derived, use pushMessage(inMessage).");
+	writeMessage(inMessage, type, true);
+}
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+template<typename T>
+bool LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::SharedChannelInput::tryPushMessage(
+	const T& inMessage,
+	const TYPES type) noexcept
+{
+	static_assert(!MessageList::isTyped, "With a Messages<> list the type is derived, use tryPushMessage(inMessage).");
+	return writeMessage(inMessage, type, false);
+}
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+template<typename T>
+void LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::SharedChannelInput::pushMessage(const T& inMessage) noexcept {
+	writeMessage(inMessage, getMessageType<T>(), true);
+}
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+template<typename T>
+bool LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::SharedChannelInput::tryPushMessage(const T& inMessage) noexcept {
+	return writeMessage(inMessage, getMessageType<T>(), false);
+}
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+template<typename T>
+inline bool LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::SharedChannelInput::writeMessage(
+	const T& inMessage,
+	const TYPES inType,
+	const bool inWait) noexcept
+{
+	uint32_t index;
+	MessageContainer* messageContainer = inWait ? 
+		&messageQueue.sharedChannel.claim(index) : messageQueue.sharedChannel.tryClaim(index);
+	if (messageContainer == nullptr) {
+		return false;
+	}
+
+	getMessageData<T>(*messageContainer, inType) = inMessage;
+	messageQueue.sharedChannel.publish(index);
+	messageQueue.onSharedMessagePublished();
+	return true;
+}
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::SharedChannelOutput::SharedChannelOutput(
+	LWMessageQueue& inMessageQueue) noexcept
+	: messageQueue(inMessageQueue)
+{
+}
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+inline uint32_t LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::SharedChannelOutput::getNumMessages() noexcept {
+	return messageQueue.sharedChannel.size();
+}
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+inline typename LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::MessageContainer 
+LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::SharedChannelOutput::popMessage() noexcept {
+	const MessageContainer* messageContainer = messageQueue.sharedChannel.front();
+	assert(messageContainer != nullptr);
+
+	const MessageContainer returnElement = *messageContainer;
+	messageQueue.sharedChannel.popFront();
+	return returnElement;
+}
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+inline uint32_t LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::SharedChannelOutput::popMessages(
+	MessageContainer* outMessages,
+	const uint32_t inMaxMessages) noexcept
+{
+	assert(outMessages != nullptr || inMaxMessages == 0);
+	return drain([&outMessages](const MessageContainer& inMessageContainer) {
+		*outMessages++ = inMessageContainer;
+	}, inMaxMessages);
+}
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+template<typename F>
+uint32_t LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::SharedChannelOutput::drain(
+	F&& inFunction,
+	const uint32_t inMaxMessages)
+{
+	uint32_t numMessages = 0;
+	while (numMessages < inMaxMessages) {
+		const MessageContainer* messageContainer = messageQueue.sharedChannel.front();
+		if (messageContainer == nullptr) {
+			break;
+		}
+		inFunction(*messageContainer);
+		messageQueue.sharedChannel.popFront();
+		++numMessages;
+	}
+	return numMessages;
+}
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::AcquiredInput::AcquiredInput() noexcept
+	: messageQueue(nullptr),
+	channel(0)
+{
+}
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::AcquiredInput::AcquiredInput(
+	LWMessageQueue& inMessageQueue,
+	const uint32_t inChannel) noexcept
+	: messageQueue(&inMessageQueue),
+	channel(inChannel)
+{
+}
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::AcquiredInput::AcquiredInput(AcquiredInput&& other) noexcept
+	: messageQueue(other.messageQueue),
+	channel(other.channel)
+{
+	other.messageQueue = nullptr;
+}
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+typename LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::AcquiredInput& 
+LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::AcquiredInput::operator=(AcquiredInput&& other) noexcept {
+	if (this != &other) {
+		release();
+		messageQueue = other.messageQueue;
+		channel = other.channel;
+		other.messageQueue = nullptr;
+	}
+	return *this;
+}
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::AcquiredInput::~AcquiredInput() {
+	release();
+}
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+inline bool LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::AcquiredInput::isValid() const noexcept {
+	return messageQueue != nullptr;
+}
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+inline uint32_t LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::AcquiredInput::getChannel() const noexcept {
+	assert(isValid());
+	return channel;
+}
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+inline typename LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::ThreadChannelInput 
+LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::AcquiredInput::getInput() const noexcept {
+	assert(isValid());
+	return ThreadChannelInput(*messageQueue, channel);
+}
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+void LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::AcquiredInput::release() noexcept {
+	if (messageQueue == nullptr) {
+		return;
+	}
+
+	getInput().commit();
+	messageQueue->threadChannels[channel].releaseAcquired();
+	// Make the output thread visit the channel even if it is already drained, so that it can hand it back.
+	messageQueue->onMessagesPublished(channel);
+	messageQueue = nullptr;
+}
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::ThreadChannelOutput::ThreadChannelOutput(
+	LWMessageQueue& inMessageQueue,
+	const uint32_t inChannel) noexcept
+	: messageQueue(inMessageQueue),
+	threadChannel(inMessageQueue.threadChannels[inChannel]),
+	channel(inChannel)
+{
+}
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+inline uint32_t LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::ThreadChannelOutput::getNumMessages() const noexcept {
+	if constexpr (scheduling) {
+		return messageQueue.timerWheel.getNumDue(channel) + threadChannel.sweptSize();
+	} else {
+		return threadChannel.countedSize();
+	}
+}
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+inline typename LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::MessageContainer 
+LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::ThreadChannelOutput::popMessage() noexcept {
+	if constexpr (scheduling) {
+		TimerWheel& timerWheel = messageQueue.timerWheel;
+		if (timerWheel.getNumDue(channel) != 0) {
+			const MessageContainer messageContainer = timerWheel.frontDue(channel);
+			timerWheel.popDue(channel);
+			return messageContainer;
+		}
+	}
+	return threadChannel.popFront();
+}
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+inline uint32_t LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::ThreadChannelOutput::popMessages(
+	MessageContainer* outMessages,
+	const uint32_t inMaxMessages) noexcept
+{
+	assert(outMessages != nullptr || inMaxMessages == 0);
+	if constexpr (scheduling) {
+		collectScheduled();
+		const auto copyMessage = [&outMessages](const MessageContainer& inMessageContainer) {
+			*outMessages++ = inMessageContainer;
+		};
+		const uint32_t numDue = drainDue(copyMessage, inMaxMessages);
+		return numDue + threadChannel.consumeRuns([&outMessages](const MessageContainer* inRun, const uint32_t inRunLength) {
+			outMessages = std::copy(inRun, inRun + inRunLength, outMessages);
+		}, inMaxMessages - numDue);
+	} else if constexpr (overwriteOldest) {
+		const uint32_t numMessages = std::min(threadChannel.countedSize(), inMaxMessages);
+		for (uint32_t index = 0; index < numMessages; ++index) {
+			outMessages[index] = threadChannel.popFront();
+		}
+		return numMessages;
+	} else {
+		return threadChannel.consumeRuns([&outMessages](const MessageContainer* inRun, const uint32_t inRunLength) {
+			outMessages = std::copy(inRun, inRun + inRunLength, outMessages);
+		}, inMaxMessages);
+	}
+}
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+template<typename F>
+uint32_t LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::ThreadChannelOutput::drain(
+	F&& inFunction,
+	const uint32_t inMaxMessages)
+{
+	if constexpr (scheduling) {
+		collectScheduled();
+		const uint32_t numDue = drainDue(inFunction, inMaxMessages);
+		return numDue + threadChannel.consumeRuns([&inFunction](const MessageContainer* inRun, const uint32_t inRunLength) {
+			for (uint32_t index = 0; index < inRunLength; ++index) {
+				inFunction(inRun[index]);
+			}
+		}, inMaxMessages - numDue);
+	} else if constexpr (overwriteOldest) {
+		const uint32_t numMessages = std::min(threadChannel.countedSize(), inMaxMessages);
+		for (uint32_t index = 0; index < numMessages; ++index) {
+			const MessageContainer messageContainer = threadChannel.popFront();
+			inFunction(messageContainer);
+		}
+		return numMessages;
+	} else {
+		return threadChannel.consumeRuns([&inFunction](const MessageContainer* inRun, const uint32_t inRunLength) {
+			for (uint32_t index = 0; index < inRunLength; ++index) {
+				inFunction(inRun[index]);
+			}
+		}, inMaxMessages);
+	}
+}
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+template<typename V>
+uint32_t LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::ThreadChannelOutput::dispatch(
+	V&& inVisitor,
+	const uint32_t inMaxMessages)
+{
+	static_assert(MessageList::isTyped, "dispatch() requires MESSAGE to be a Messages<> list.");
+	return drain([&inVisitor](const MessageContainer& inMessageContainer) {
+		MessageList::visit(inMessageContainer.message, inMessageContainer.type, inVisitor);
+	}, inMaxMessages);
+}
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+inline const typename LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::MessageContainer& 
+LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::ThreadChannelOutput::peek() noexcept {
+	static_assert(!scheduling, "Scheduled delivery does not support in place access.");
+	return threadChannel.front();
+}
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+inline typename LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::MessageRange 
+LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::ThreadChannelOutput::getReadableMessages() noexcept {
+	static_assert(!scheduling, "Scheduled delivery does not support in place access.");
+	return threadChannel.readableElements();
+}
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+inline void LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::ThreadChannelOutput::release(
+	const uint32_t inNumMessages) noexcept
+{
+	static_assert(!scheduling, "Scheduled delivery does not support in place access.");
+	threadChannel.popFront(inNumMessages);
+}
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+inline uint32_t LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::ThreadChannelOutput::collectScheduled() noexcept {
+	static_assert(scheduling, "collectScheduled() requires TRAITS::scheduledMessageCapacity.");
+	TimerWheel& timerWheel = messageQueue.timerWheel;
 
-	@details
-		Messages are passed through ThreadChannels. Each thread producing messages (input thread) gets one 
-		ThreadChannelInput instance each, and the single consumer (output) thread gets one ThreadChannelOutput instance
-		per input thread. A good design pattern could be to let the consumer thread own the LWMessageQueue instance, 
-		and only pass ThreadChannelInput instances to the producer threads. If you need more consumers, simply create 
-		an LWMessageQueue instance per consumer thread.
+	// The clock is only read when a message is waiting, or a scheduled message is found.
+	uint64_t now = 0;
+	if (!timerWheel.isIdle()) {
+		now = Internal::traceTime();
+		timerWheel.advance(now);
+	}
+	using SweepAction = typename ThreadChannel::SweepAction;
+	const uint32_t numSwept = threadChannel.sweepScheduled([this, &timerWheel, &now](const MessageContainer& inMessage) {
+		if (now == 0) {
+			now = Internal::traceTime();
+			timerWheel.advance(now);
+		}
+		if (inMessage.deliveryTime <= now) {
+			return SweepAction::Keep;
+		}
+		return timerWheel.insert(channel, inMessage.deliveryTime, inMessage) ? SweepAction::Remove : SweepAction::Stop;
+	});
+	return timerWheel.getNumDue(channel) + numSwept;
+}
 
-		It is up to the user to make sure not to push messages to a full channel. The channel (SIZE) must be 
-		dimensioned so that it never overflows. In debug builds, an assert will be hit if the channel is full when 
-		pushing new messages.
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+template<typename F>
+uint32_t LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::ThreadChannelOutput::drainDue(
+	F& inFunction,
+	const uint32_t inMaxMessages)
+{
+	TimerWheel& timerWheel = messageQueue.timerWheel;
+	const uint32_t numMessages = std::min(timerWheel.getNumDue(channel), inMaxMessages);
+	for (uint32_t index = 0; index < numMessages; ++index) {
+		inFunction(timerWheel.frontDue(channel));
+		timerWheel.popDue(channel);
+	}
+	return numMessages;
+}
 
-		It is also up to the user to never pop messages from an empty channel. This should be done by first 
-		getting the number of pending messages from the output channel and then popping exactly that many messages. 
-		This also makes sure the output thread will finish popping messages. In debug builds, an assert will be hit 
-		if the channel is empty when popping a message.
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::LWMessageQueue() noexcept(!TRAITS::enableEventFd) {
+	static_assert(!isDynamic, "Runtime sized queues are constructed with a size and a number of channels.");
+}
 
-		Messages are defined as POD type structs, and a union of those structs is passed as a template parameter 
-		(MESSAGE) to LWMessageQueue. Push and pop operations copy the message data, so structs should be small enuough
-		so that this still is a cheap operation.
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::LWMessageQueue(
+	const uint32_t inSize,
+	const uint32_t inChannels,
+	const bool inPrefault)
+{
+	static_assert(isDynamic, "Only runtime sized queues are constructed with a size and a number of channels.");
+	if (!Internal::isPowerOfTwo(inSize) || inSize > 0x80000000u) {
+		throw std::invalid_argument("LWMessageQueue size must be a power of two that fits 32 bit indices.");
+	}
+	if (inChannels == 0) {
+		throw std::invalid_argument("LWMessageQueue must have at least one channel.");
+	}
 
-		Messages of any type (from the MESSAGE union) can be pushed to an input channel. When popping messages you get 
-		an LWMessageQueue<>::MessageContainer instance. To get the actual message from the container, first call 
-		messageContainer.getType() to determine the type, comparing it with the supplied TYPES enum values, and then 
-		call messageContainer.getMessage<TYPE>() to get the message data cast to the correct POD type struct.
+	// Channels first, then the rings, each ring starting on a cache line of its own.
+	constexpr size_t cacheLineSize = TRAITS::cacheLineSize;
+	const size_t channelsSize = sizeof(ThreadChannel) * inChannels;
+	const size_t ringSize = (sizeof(MessageContainer) * inSize + cacheLineSize - 1) & ~(cacheLineSize - 1);
+	const size_t storageSize = channelsSize + ringSize * inChannels;
 
-		See the Example/Message.h and Example/example.cpp for more details on how to use LWMessageQueue and how to 
-		define messages.
+	void* storage = TRAITS::Allocator::allocate(storageSize);
+	if (storage == nullptr) {
+		throw std::bad_alloc();
+	}
+	assert(reinterpret_cast<uintptr_t>(storage) % alignof(ThreadChannel) == 0);
+	if (inPrefault) {
+		Internal::prefault(storage, storageSize);
+	}
 
-		Template parameters:
-		SIZE is the number of allowed pending messages in one channel.
-		CHANNELS is the number of channels, i.e. the number of input/producer threads.
-		MESSAGE should be a union of all available Message types. Message types are POD type structs with message 
-		specific data fields. See example message definitions and usage in Example/Message.h and Example/example.cpp.
-		TYPES should be a enum class with one entry per message type. See Example/Message.h and Example/example.cpp for
-		types definition.
-*/
-template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES>
-class LWMessageQueue {
-private:
-	class ThreadChannel;
-public:
-	/** Used for message storage in the queue. When you pop a message from an output channel, you get instances
-		of this type.
-	*/
-	class MessageContainer {
-	public:
-		/** Get a reference to the message data, as the correct message type. */
-		template<typename T>
-		inline const T& getMessage() const noexcept;
+	uint8_t* bytes = static_cast<uint8_t*>(storage);
+	ThreadChannel* channels = reinterpret_cast<ThreadChannel*>(bytes);
+	for (uint32_t channel = 0; channel < inChannels; ++channel) {
+		MessageContainer* elements = new (bytes + channelsSize + ringSize * channel) MessageContainer[inSize];
+		new (&channels[channel]) ThreadChannel(elements, inSize);
+	}
 
-		/** Check if a message container contains a message of a specific type. */
-		inline TYPES getType() const noexcept;
+	threadChannels.channels = channels;
+	threadChannels.count = inChannels;
+	threadChannels.storage = storage;
+	threadChannels.storageSize = storageSize;
+}
 
-	private:
-		TYPES type;
-		MESSAGE message;
-		friend class LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES>;
-	};
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::~LWMessageQueue() {
+	// The destroying thread may have pushed with pushMessage(). Forget its channel without releasing it.
+	if (hasThreadInputs.load(std::memory_order_relaxed)) {
+		if (ThreadInput* threadInput = findThreadInput()) {
+			threadInput->acquiredInput.messageQueue = nullptr;
+			threadInput->messageQueue = nullptr;
+		}
+	}
 
-	/** Each input thread has its own ThreadChannelInput instance. Use it to push messages to the queue. */
-	class ThreadChannelInput {
-	public:
-		ThreadChannelInput(ThreadChannel& inThreadChannel) noexcept;
-		ThreadChannelInput(const ThreadChannelInput& other) = default;
-		ThreadChannelInput& operator=(const ThreadChannelInput& other) = default;
+	if constexpr (isDynamic) {
+		for (uint32_t channel = 0; channel < threadChannels.count; ++channel) {
+			threadChannels[channel].~ThreadChannel();
+		}
+		TRAITS::Allocator::deallocate(threadChannels.storage, threadChannels.storageSize);
+	}
+}
 
-		/** Check if the channel is full. No more messages can be pushed. Should only be used for debugging purposes.
-			The MessageQueue should always be dimensioned so that this does not happen.
-		*/
-		inline bool isFull() const noexcept;
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+typename LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::ThreadChannelInput 
+LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::getThreadChannelInput(const uint32_t inChannel) noexcept {
+	assert(inChannel < threadChannels.size());
+	return ThreadChannelInput(*this, inChannel);
+}
 
-		/** Push a message to the channel. The user must make sure the channel is not full before calling. Only 
-			one thread may push messages to a single channel.
-			@param inMessage Message data from the MESSAGE union.
-			@param inType Message type from the TYPES enum.
-		*/
-		template<typename T>
-		void pushMessage(const T& inMessage, const TYPES inType) noexcept;
-	private:
-		ThreadChannel& threadChannel;
-	};
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+typename LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::ThreadChannelOutput 
+LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::getThreadChannelOutput(const uint32_t inChannel) noexcept {
+	assert(inChannel < threadChannels.size());
+	return ThreadChannelOutput(*this, inChannel);
+}
 
-	/** The single output thread has one ThreadChannelOutput instance per input thread. Use them to pop messages
-		from the queue. 
-	*/
-	class ThreadChannelOutput {
-	public:
-		ThreadChannelOutput(ThreadChannel& inThreadChannel) noexcept;
-		ThreadChannelOutput(const ThreadChannelOutput& other) = default;
-		ThreadChannelOutput& operator=(const ThreadChannelOutput& other) = default;
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+uint32_t LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::snapshotStats(
+	ChannelStats* outStats,
+	const uint32_t inMaxChannels) const noexcept
+{
+	static_assert(TRAITS::enableStats, "snapshotStats() requires TRAITS::enableStats.");
 
-		/** Get number of pending messages in the channel. The output thread should get this number and then pop
-			exactly that many messages from the channel. This way it is guaranteed that an empty channel is not 
-			popped and that the output thread receive loop finishes.
-		*/
-		inline uint32_t getNumMessages() const noexcept;
+	const uint32_t numChannels = std::min(threadChannels.size(), inMaxChannels);
+	for (uint32_t channel = 0; channel < numChannels; ++channel) {
+		threadChannels[channel].snapshotStats(outStats[channel]);
+	}
+	return numChannels;
+}
 
-		/** Pop the next message from the channel. The user must make sure that the channel is not empty before 
-			calling. Only one thread may pop messages from all channels.
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+typename LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::LatencyPercentiles 
+LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::getLatencyPercentiles(const uint32_t inChannel) const noexcept {
+	static_assert(tracing, "getLatencyPercentiles() requires TRAITS::traceSampleInterval.");
+	assert(inChannel < threadChannels.size());
 
-			@return A MessageContainer. Check type by calling messageContainer.getType(); 
-			Then get the message data with correct type by calling messageContainer.getMessage<MESSAGE_TYPE>();
-		*/
-		inline MessageContainer popMessage() noexcept;
+	return threadChannels[inChannel].getLatencyPercentiles();
+}
 
-	private:
-		ThreadChannel& threadChannel;
-	};
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+void LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::dumpLatencyPercentiles(std::ostream& outStream) const {
+	static_assert(tracing, "dumpLatencyPercentiles() requires TRAITS::traceSampleInterval.");
 
-	LWMessageQueue() = default;
-	~LWMessageQueue() = default;
+	outStream << "channel,samples,p50_ns,p90_ns,p99_ns,p999_ns,max_ns\n";
+	for (uint32_t channel = 0; channel < threadChannels.size(); ++channel) {
+		const LatencyPercentiles percentiles = threadChannels[channel].getLatencyPercentiles();
+		if (percentiles.numSamples != 0) {
+			outStream << channel << ',' << percentiles.numSamples << ',' << percentiles.p50 << ',' << 
+				percentiles.p90 << ',' << percentiles.p99 << ',' << percentiles.p999 << ',' << percentiles.max << '\n';
+		}
+	}
+}
 
-	LWMessageQueue(const LWMessageQueue&) = delete;
-	LWMessageQueue& operator=(const LWMessageQueue&) = delete;
-	LWMessageQueue(const LWMessageQueue&&) = delete;
-	LWMessageQueue& operator=(const LWMessageQueue&&) = delete;
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+inline uint32_t LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::getChannelSize() const noexcept {
+	return threadChannels[0].capacity();
+}
 
-	/** Get a thread channel input for an input thread. */
-	ThreadChannelInput getThreadChannelInput(const uint32_t inChannel) noexcept;
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+inline uint32_t LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::getNumChannels() const noexcept {
+	return threadChannels.size();
+}
 
-	/** Get a thread channel output for the output thread. */
-	ThreadChannelOutput getThreadChannelOutput(const uint32_t inChannel) noexcept;
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+typename LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::ConsumerGroupOutput 
+LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::getConsumerGroupOutput(
+	const uint32_t inConsumer,
+	const uint32_t inNumConsumers) noexcept
+{
+	return ConsumerGroupOutput(*this, inConsumer, inNumConsumers);
+}
 
-private:
-	class ThreadChannel {
-	public:
-		ThreadChannel() noexcept;
-		~ThreadChannel() = default;
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+typename LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::SharedChannelInput 
+LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::getSharedChannelInput() noexcept {
+	static_assert(hasSharedChannel, "getSharedChannelInput() requires TRAITS::sharedChannelSize.");
+	return SharedChannelInput(*this);
+}
 
-		ThreadChannel(const ThreadChannel&) = delete;
-		const ThreadChannel& operator=(const ThreadChannel&) = delete;
-		ThreadChannel(const ThreadChannel&&) = delete;
-		const ThreadChannel& operator=(const ThreadChannel&&) = delete;
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+typename LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::SharedChannelOutput 
+LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::getSharedChannelOutput() noexcept {
+	static_assert(hasSharedChannel, "getSharedChannelOutput() requires TRAITS::sharedChannelSize.");
+	return SharedChannelOutput(*this);
+}
 
-		inline uint32_t size() const noexcept;
-		void pushBack(const MessageContainer& inElement) noexcept;
-		MessageContainer popFront() noexcept;
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+typename LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::AcquiredInput 
+LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::acquireInput() noexcept {
+	for (uint32_t channel = 0; channel < threadChannels.size(); ++channel) {
+		if (threadChannels[channel].tryAcquire()) {
+			return AcquiredInput(*this, channel);
+		}
+	}
+	return AcquiredInput();
+}
 
-	private:
-		MessageContainer elements[SIZE];
-		uint32_t readPoint;
-		uint32_t writePoint;
-		std::atomic<uint32_t> numElements;
-	};
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+template<typename T>
+bool LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::pushMessage(
+	const T& inMessage,
+	const TYPES inType) noexcept
+{
+	static_assert(!MessageList::isTyped, "With a Messages<> list the type is derived, use pushMessage(inMessage).");
+	AcquiredInput* acquiredInput = getCachedInput();
+	if (acquiredInput == nullptr) {
+		return false;
+	}
 
-	ThreadChannel threadChannels[CHANNELS];
-	static constexpr uint32_t sizeMinusOne = SIZE - 1;
-};
+	// Only Block waits for room, so the other policies go through tryPushMessage() to report a rejected push.
+	if constexpr (TRAITS::overflowPolicy == OverflowPolicy::Block) {
+		acquiredInput->getInput().pushMessage(inMessage, inType);
+		return true;
+	} else {
+		return acquiredInput->getInput().tryPushMessage(inMessage, inType);
+	}
+}
 
-namespace Internal {
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+template<typename T>
+bool LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::pushMessage(const T& inMessage) noexcept {
+	AcquiredInput* acquiredInput = getCachedInput();
+	if (acquiredInput == nullptr) {
+		return false;
+	}
 
-constexpr bool isPowerOfTwo(const uint32_t value) {
-	return (value != 0) && ((value & (value - 1)) == 0);
+	if constexpr (TRAITS::overflowPolicy == OverflowPolicy::Block) {
+		acquiredInput->getInput().pushMessage(inMessage);
+		return true;
+	} else {
+		return acquiredInput->getInput().tryPushMessage(inMessage);
+	}
 }
 
-} // namespace Internal
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+inline typename LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::AcquiredInput* 
+LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::getCachedInput() noexcept {
+	if (ThreadInput* threadInput = findThreadInput()) {
+		return &threadInput->acquiredInput;
+	}
+
+	AcquiredInput acquiredInput = acquireInput();
+	if (!acquiredInput.isValid()) {
+		return nullptr;
+	}
+	hasThreadInputs.store(true, std::memory_order_relaxed);
+
+	// Take a free entry, or release the channel of the entry cached longest ago.
+	ThreadInputCache& threadInputCache = getThreadInputCache();
+	ThreadInput* threadInput = nullptr;
+	for (ThreadInput& entry : threadInputCache.threadInputs) {
+		if (entry.messageQueue == nullptr) {
+			threadInput = &entry;
+			break;
+		}
+	}
+	if (threadInput == nullptr) {
+		threadInput = &threadInputCache.threadInputs[threadInputCache.nextEvicted];
+		threadInputCache.nextEvicted = (threadInputCache.nextEvicted + 1) % threadInputCacheSize;
+	}
+	threadInput->acquiredInput = std::move(acquiredInput);
+	threadInput->messageQueue = this;
+	return &threadInput->acquiredInput;
+}
 
-template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES>
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
 template<typename T>
-inline const T& LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES>::MessageContainer::getMessage() const noexcept {
-	return *(reinterpret_cast<const T*>(&message));
+constexpr TYPES LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::getMessageType() noexcept {
+	static_assert(MessageList::isTyped, "The message type can only be derived when MESSAGE is a Messages<> list.");
+	static_assert(MessageList::template contains<T>, "Type T is not in the Messages<> list.");
+	return MessageList::template tagOf<T>();
 }
 
-template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES>
-inline TYPES LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES>::MessageContainer::getType() const noexcept {
-	return type;
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+constexpr uint64_t LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::layoutFingerprint() noexcept {
+	const uint64_t values[] = {
+		sizeof(LWMessageQueue), alignof(LWMessageQueue), sizeof(MessageContainer), sizeof(MESSAGE), SIZE, CHANNELS, 
+		ChannelLayout::cacheLineSize, ChannelLayout::channelSize, ChannelLayout::producerOffset, 
+		ChannelLayout::producerSize, ChannelLayout::consumerOffset, ChannelLayout::consumerSize, 
+		ChannelLayout::elementsOffset, static_cast<uint64_t>(TRAITS::overflowPolicy), TRAITS::enableReadyBitmap, 
+		TRAITS::sharedChannelSize, TRAITS::enableStats, TRAITS::traceSampleInterval, TRAITS::scheduledMessageCapacity
+	};
+
+	// FNV-1a over the bytes of every value.
+	uint64_t hash = 0xcbf29ce484222325ull;
+	for (const uint64_t value : values) {
+		for (uint32_t byte = 0; byte < sizeof(value); ++byte) {
+			hash = (hash ^ ((value >> (byte * 8)) & 0xff)) * 0x100000001b3ull;
+		}
+	}
+	return hash;
+}
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+void LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::releaseThreadInput() noexcept {
+	if (ThreadInput* threadInput = findThreadInput()) {
+		threadInput->acquiredInput.release();
+		threadInput->messageQueue = nullptr;
+	}
+}
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+inline typename LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::ThreadInputCache& 
+LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::getThreadInputCache() noexcept {
+	thread_local ThreadInputCache threadInputCache;
+	return threadInputCache;
+}
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+inline typename LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::ThreadInput* 
+LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::findThreadInput() noexcept {
+	for (ThreadInput& threadInput : getThreadInputCache().threadInputs) {
+		if (threadInput.messageQueue == this) {
+			return &threadInput;
+		}
+	}
+	return nullptr;
+}
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+inline void LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::reclaimIfDrained(const uint32_t inChannel) noexcept {
+	if constexpr (scheduling) {
+		// A message held back in the timing wheel would otherwise be delivered to the next owner of the channel.
+		if (timerWheel.getNumHeld(inChannel) != 0) {
+			return;
+		}
+	}
+	threadChannels[inChannel].reclaimIfDrained();
+}
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+template<typename F>
+uint32_t LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::forEachAcquiredChannel(F&& inFunction) {
+	uint32_t numVisited = 0;
+	for (uint32_t channel = 0; channel < threadChannels.size(); ++channel) {
+		if (!threadChannels[channel].isAcquired()) {
+			continue;
+		}
+		inFunction(channel);
+		++numVisited;
+		reclaimIfDrained(channel);
+	}
+	return numVisited;
+}
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+void LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::setChannelPriority(
+	const uint32_t inChannel,
+	const uint32_t inLane,
+	const uint32_t inWeight) noexcept
+{
+	assert(inChannel < threadChannels.size());
+	assert(inLane < numPriorityLanes);
+	assert(inWeight > 0);
+
+	DrainSchedule& schedule = threadChannels[inChannel].getSchedule();
+	schedule.lane = inLane;
+	schedule.weight = inWeight;
+	schedule.deficit = 0;
+	drainScheduler.usedLanes |= 1u << inLane;
+}
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+template<typename F>
+uint32_t LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::drain(F&& inFunction, const uint32_t inBudget) {
+	uint32_t numMessages = 0;
+	uint32_t lane = 0;
+	while (numMessages < inBudget && lane < numPriorityLanes) {
+		if ((drainScheduler.usedLanes & (1u << lane)) == 0) {
+			++lane;
+			continue;
+		}
+
+		// After a round that sent messages, start over from the highest lane, in case it has new messages. 
+		// An empty round means that the lane is empty.
+		const uint32_t numDrained = drainLane(lane, inFunction, inBudget - numMessages);
+		numMessages += numDrained;
+		lane = (numDrained != 0) ? 0 : lane + 1;
+	}
+	return numMessages;
 }
 
-template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES>
-LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES>::ThreadChannelInput::ThreadChannelInput(
-	ThreadChannel& inThreadChannel) noexcept
-	: threadChannel(inThreadChannel)
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+template<typename F>
+uint32_t LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::drainLane(
+	const uint32_t inLane,
+	F& inFunction,
+	const uint32_t inBudget)
 {
+	const uint32_t numChannels = threadChannels.size();
+	uint32_t channel = drainScheduler.nextChannel[inLane];
+	uint32_t numMessages = 0;
+	for (uint32_t visited = 0; visited < numChannels && numMessages < inBudget; ++visited) {
+		ThreadChannel& threadChannel = threadChannels[channel];
+		DrainSchedule& schedule = threadChannel.getSchedule();
+		if (schedule.lane == inLane) {
+			// Messages have unit cost, so the deficit is only left over when the budget ran out.
+			if (schedule.deficit == 0) {
+				schedule.deficit = schedule.weight;
+			}
+			const uint32_t maxMessages = std::min(schedule.deficit, inBudget - numMessages);
+			const uint32_t numDrained = ThreadChannelOutput(*this, channel).drain(inFunction, maxMessages);
+			numMessages += numDrained;
+			if (numDrained < maxMessages) {
+				schedule.deficit = 0;
+				reclaimIfDrained(channel);
+			} else {
+				schedule.deficit -= numDrained;
+				if (schedule.deficit != 0) {
+					break;
+				}
+			}
+		}
+		channel = (channel + 1 == numChannels) ? 0 : channel + 1;
+	}
+	drainScheduler.nextChannel[inLane] = channel;
+	return numMessages;
+}
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+template<typename F>
+uint32_t LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::forEachReadyChannel(F&& inFunction) {
+	static_assert(TRAITS::enableReadyBitmap, "forEachReadyChannel() requires TRAITS::enableReadyBitmap.");
+
+	uint32_t numVisited = 0;
+	for (uint32_t word = 0; word < readyBitmap.numWords; ++word) {
+		uint64_t bits = readyBitmap.takeReady(word);
+		while (bits != 0) {
+			const uint32_t channel = word * 64 + Internal::countTrailingZeros(bits);
+			bits &= bits - 1;
+
+			inFunction(channel);
+			++numVisited;
+			if (threadChannels[channel].size() != 0) {
+				readyBitmap.restoreReady(channel);
+			} else {
+				threadChannels[channel].reclaimIfDrained();
+			}
+		}
+	}
+	return numVisited;
 }
 
-template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES>
-inline bool LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES>::ThreadChannelInput::isFull() const noexcept {
-	return (threadChannel.size() == SIZE);
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+bool LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::nextReadyChannel(uint32_t& outChannel) noexcept {
+	static_assert(TRAITS::enableReadyBitmap, "nextReadyChannel() requires TRAITS::enableReadyBitmap.");
+
+	const uint32_t lastChannel = readyBitmap.lastReadyChannel;
+	if (lastChannel != CHANNELS) {
+		if (threadChannels[lastChannel].size() != 0) {
+			readyBitmap.restoreReady(lastChannel);
+		} else {
+			threadChannels[lastChannel].reclaimIfDrained();
+		}
+	}
+
+	// Continue after the last returned channel, so that a channel that is always ready can not starve the others.
+	const uint32_t firstChannel = (lastChannel + 1) % CHANNELS;
+	for (uint32_t step = 0; step <= readyBitmap.numWords; ++step) {
+		const uint32_t word = (firstChannel / 64 + step) % readyBitmap.numWords;
+		uint64_t bits = readyBitmap.peekReady(word);
+		if (step == 0) {
+			bits &= ~uint64_t(0) << (firstChannel % 64);
+		}
+		if (bits != 0) {
+			const uint32_t bit = Internal::countTrailingZeros(bits);
+			readyBitmap.takeReady(word, uint64_t(1) << bit);
+			outChannel = word * 64 + bit;
+			readyBitmap.lastReadyChannel = outChannel;
+			return true;
+		}
+	}
+
+	readyBitmap.lastReadyChannel = CHANNELS;
+	return false;
 }
 
-template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES>
-template<typename T>
-void LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES>::ThreadChannelInput::pushMessage(
-	const T& inMessage,
-	const TYPES type) noexcept
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+inline void LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::onMessagesPublished(const uint32_t inChannel) noexcept {
+	constexpr bool notifies = TRAITS::enableBlockingWait || TRAITS::enableEventFd;
+	if constexpr (TRAITS::enableReadyBitmap || notifies) {
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+	}
+	if constexpr (TRAITS::enableReadyBitmap) {
+		if (!readyBitmap.setReady(inChannel)) {
+			// The bit was already set, either the consumer has not taken it yet or it will see the new messages 
+			// when draining the channel it took the bit for. It is not parked in either case.
+			return;
+		}
+	} else {
+		(void)inChannel;
+	}
+	if constexpr (notifies) {
+		// With the ready bitmap, the consumer checks the bits before parking or arming, so the bit set above must 
+		// be ordered before checking if it is parked or armed.
+		if constexpr (TRAITS::enableReadyBitmap) {
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+		}
+		if constexpr (TRAITS::enableBlockingWait) {
+			consumerParker.notify();
+		}
+		if constexpr (TRAITS::enableEventFd) {
+			eventNotifier.notify();
+		}
+	}
+}
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+inline void LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::onSharedMessagePublished() noexcept {
+	// The shared channel has no ready bit. The consumer checks it directly before parking or arming, so every push 
+	// pays the fence, see TRAITS::sharedChannelSize.
+	if constexpr (TRAITS::enableBlockingWait || TRAITS::enableEventFd) {
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+	}
+	if constexpr (TRAITS::enableBlockingWait) {
+		consumerParker.notify();
+	}
+	if constexpr (TRAITS::enableEventFd) {
+		eventNotifier.notify();
+	}
+}
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+template<typename REP, typename PERIOD>
+bool LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::waitForMessages(
+	const std::chrono::duration<REP, PERIOD>& inTimeout)
 {
-	static_assert(sizeof(T) <= sizeof(MESSAGE), "Type T might not be part of union MESSAGE. Size mismatch.");
-	static_assert(alignof(MESSAGE) % alignof(T) == 0, "Type T might not be part of union MESSAGE. Alignment mismatch.");
-	MessageContainer messageContainer;
-	messageContainer.type = type;
+	static_assert(TRAITS::enableBlockingWait, "waitForMessages() requires TRAITS::enableBlockingWait.");
+
+	return consumerParker.wait([this]() { return hasMessages(); }, 
+		std::chrono::duration_cast<std::chrono::nanoseconds>(inTimeout));
+}
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+int LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::getEventFd() const noexcept {
+	static_assert(TRAITS::enableEventFd, "getEventFd() requires TRAITS::enableEventFd.");
+
+	return eventNotifier.getFileDescriptor();
+}
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+bool LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::armEventFd() noexcept {
+	static_assert(TRAITS::enableEventFd, "armEventFd() requires TRAITS::enableEventFd.");
+
+	return eventNotifier.arm([this]() { return hasMessages(); });
+}
 
-	T* messageData = reinterpret_cast<T*>(&messageContainer.message);
-	*messageData = inMessage;
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+inline bool LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::hasMessages() noexcept {
+	if constexpr (hasSharedChannel) {
+		if (sharedChannel.front() != nullptr) {
+			return true;
+		}
+	}
+	if constexpr (TRAITS::enableReadyBitmap) {
+		return readyBitmap.isAnyReady();
+	} else {
+		for (uint32_t channel = 0; channel < threadChannels.size(); ++channel) {
+			if (threadChannels[channel].size() != 0) {
+				return true;
+			}
+		}
+		return false;
+	}
+}
 
-	threadChannel.pushBack(messageContainer);
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::ThreadChannel::ThreadChannel() noexcept
+{
+	static_assert(isDynamic || Internal::isPowerOfTwo(SIZE), "Template parameter SIZE must be a power of two.");
+	static_assert(SIZE <= 0x80000000u, "Template parameter SIZE must fit the free running 32 bit indices.");
+	static_assert(Internal::isPowerOfTwo(TRAITS::cacheLineSize), "TRAITS::cacheLineSize must be a power of two.");
+	assert(producer.writeIndex.is_lock_free());
 }
 
-template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES>
-LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES>::ThreadChannelOutput::ThreadChannelOutput(
-	ThreadChannel& inThreadChannel) noexcept
-	: threadChannel(inThreadChannel)
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::ThreadChannel::ThreadChannel(
+	MessageContainer* inElements,
+	const uint32_t inSize) noexcept
+	: ThreadChannel()
 {
+	static_assert(isDynamic, "Only channels of runtime sized queues use external elements.");
+	ring.elements = inElements;
+	ring.size = inSize;
 }
 
-template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES>
-inline uint32_t LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES>::ThreadChannelOutput::getNumMessages() const noexcept {
-	return threadChannel.size();
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+inline bool LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::ThreadChannel::isFull() const noexcept {
+	return (producer.stagedWriteIndex - consumer.readIndex.load(std::memory_order_acquire) == ring.capacity());
 }
 
-template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES>
-inline typename LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES>::MessageContainer 
-LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES>::ThreadChannelOutput::popMessage() noexcept {
-	return threadChannel.popFront();
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+inline bool LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::ThreadChannel::refreshIsFull() noexcept {
+	if (producer.stagedWriteIndex - producer.cachedReadIndex == ring.capacity()) {
+		producer.cachedReadIndex = consumer.readIndex.load(std::memory_order_acquire);
+	}
+	return (producer.stagedWriteIndex - producer.cachedReadIndex == ring.capacity());
+}
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+inline typename LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::MessageContainer& 
+LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::ThreadChannel::stageBack() noexcept {
+	assert(producer.stagedWriteIndex - producer.cachedReadIndex < ring.capacity());
+
+	producer.stats.onPush();
+	MessageContainer& element = ring.elements[producer.stagedWriteIndex++ & indexMask()];
+	if constexpr (tracing) {
+		element.pushTime = producer.traceSampler.sample();
+	}
+	if constexpr (scheduling) {
+		element.deliveryTime = 0;
+	}
+	return element;
+}
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+inline bool LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::ThreadChannel::commit() noexcept {
+	// Skip the store when there is nothing to publish, to not invalidate the consumer's copy of the cache line.
+	if (producer.writeIndex.load(std::memory_order_relaxed) == producer.stagedWriteIndex) {
+		return false;
+	}
+	producer.writeIndex.store(producer.stagedWriteIndex, std::memory_order_release);
+	return true;
+}
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+inline void LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::ThreadChannel::dropFront() noexcept {
+	static_assert(overwriteOldest, "Only lossy channels drop messages.");
+
+	// The consumer may move readIndex concurrently, so drop the oldest message with a compare and swap, and only 
+	// if the channel is still full.
+	uint32_t currentReadIndex = consumer.readIndex.load(std::memory_order_acquire);
+	while (producer.stagedWriteIndex - currentReadIndex == ring.capacity()) {
+		if (consumer.readIndex.compare_exchange_weak(currentReadIndex, currentReadIndex + 1, 
+			std::memory_order_acq_rel, std::memory_order_acquire))
+		{
+			++currentReadIndex;
+			break;
+		}
+	}
+	producer.cachedReadIndex = currentReadIndex;
+}
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+inline bool LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::ThreadChannel::tryAcquire() noexcept {
+	uint32_t expected = registrationFree;
+	return consumer.registration.load(std::memory_order_relaxed) == registrationFree &&
+		consumer.registration.compare_exchange_strong(expected, registrationAcquired, std::memory_order_acquire);
+}
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+inline void LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::ThreadChannel::releaseAcquired() noexcept {
+	assert(consumer.registration.load(std::memory_order_relaxed) == registrationAcquired);
+	consumer.registration.store(registrationReleased, std::memory_order_release);
 }
 
-template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES>
-typename LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES>::ThreadChannelInput 
-LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES>::getThreadChannelInput(const uint32_t inChannel) noexcept {
-	assert(inChannel < CHANNELS);
-	return ThreadChannelInput(threadChannels[inChannel]);
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+inline bool LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::ThreadChannel::isAcquired() const noexcept {
+	return consumer.registration.load(std::memory_order_relaxed) != registrationFree;
 }
 
-template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES>
-typename LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES>::ThreadChannelOutput 
-LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES>::getThreadChannelOutput(const uint32_t inChannel) noexcept {
-	assert(inChannel < CHANNELS);
-	return ThreadChannelOutput(threadChannels[inChannel]);
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+inline void LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::ThreadChannel::reclaimIfDrained() noexcept {
+	// Check the registration before the size. Once released, no more messages can arrive, so an empty channel 
+	// stays empty until it is acquired again.
+	if (consumer.registration.load(std::memory_order_acquire) == registrationReleased && size() == 0) {
+		consumer.registration.store(registrationFree, std::memory_order_release);
+	}
 }
 
-template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES>
-LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES>::ThreadChannel::ThreadChannel() noexcept
-	: readPoint(0),
-	writePoint(0),
-	numElements(0)
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+inline void LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::ThreadChannel::snapshotStats(
+	ChannelStats& outStats) const noexcept
 {
-	static_assert(Internal::isPowerOfTwo(SIZE), "Template parameter SIZE must be a power of two.");
-	assert(numElements.is_lock_free());
+	outStats.numPushes = producer.stats.numPushes.load(std::memory_order_relaxed);
+	outStats.numFullPushes = producer.stats.numFullPushes.load(std::memory_order_relaxed);
+	outStats.numPops = consumer.stats.numPops.load(std::memory_order_relaxed);
+	outStats.numNearFull = consumer.stats.numNearFull.load(std::memory_order_relaxed);
+	outStats.numConsumerStalls = consumer.stats.numStalls.load(std::memory_order_relaxed);
+	outStats.highWaterMark = consumer.stats.highWaterMark.load(std::memory_order_relaxed);
 }
 
-template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES>
-inline uint32_t LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES>::ThreadChannel::size() const noexcept {
-	return numElements;
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+inline typename LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::LatencyPercentiles 
+LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::ThreadChannel::getLatencyPercentiles() const noexcept {
+	using Histogram = Internal::LatencyHistogram<TRAITS::cacheLineSize, true>;
+
+	// Copy the counts first, so that the percentiles agree with each other while the channel is in use.
+	uint64_t counts[Histogram::numBuckets];
+	LatencyPercentiles percentiles;
+	for (uint32_t bucket = 0; bucket < Histogram::numBuckets; ++bucket) {
+		counts[bucket] = consumer.latency.count(bucket);
+		percentiles.numSamples += counts[bucket];
+	}
+	if (percentiles.numSamples == 0) {
+		return percentiles;
+	}
+
+	// The value of the rank ceil(numSamples * inPerMillion / 1000000), counting from 1.
+	const auto valueAt = [&counts, &percentiles](const uint64_t inPerMillion) {
+		const uint64_t rank = std::max<uint64_t>((percentiles.numSamples * inPerMillion + 999999) / 1000000, 1);
+		uint64_t numBelow = 0;
+		for (uint32_t bucket = 0; bucket < Histogram::numBuckets; ++bucket) {
+			numBelow += counts[bucket];
+			if (numBelow >= rank) {
+				return Histogram::bucketMax(bucket);
+			}
+		}
+		return Histogram::bucketMax(Histogram::numBuckets - 1);
+	};
+	percentiles.p50 = valueAt(500000);
+	percentiles.p90 = valueAt(900000);
+	percentiles.p99 = valueAt(990000);
+	percentiles.p999 = valueAt(999000);
+	percentiles.max = valueAt(1000000);
+	return percentiles;
 }
 
-template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES>
-void LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES>::ThreadChannel::pushBack(
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+inline void LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::ThreadChannel::traceLatency(
 	const MessageContainer& inElement) noexcept
 {
-	assert(numElements < SIZE);
-	assert(writePoint < SIZE);
+	if constexpr (tracing) {
+		if (inElement.pushTime != 0) {
+			const uint64_t popTime = Internal::traceTime();
+			consumer.latency.record(popTime > inElement.pushTime ? popTime - inElement.pushTime : 0);
+		}
+	}
+}
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+inline bool LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::ThreadChannel::tryClaimOwnership(
+	const uint32_t inConsumer) noexcept
+{
+	// Acquire pairs with the release in releaseOwnership(), so the consumer state written by the previous owner 
+	// is visible.
+	uint32_t expected = noOwner;
+	return consumer.owner.load(std::memory_order_relaxed) == noOwner &&
+		consumer.owner.compare_exchange_strong(expected, inConsumer, std::memory_order_acquire);
+}
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+inline void LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::ThreadChannel::releaseOwnership() noexcept {
+	assert(consumer.owner.load(std::memory_order_relaxed) != noOwner);
+	consumer.owner.store(noOwner, std::memory_order_release);
+}
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+inline uint32_t LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::ThreadChannel::backlog() const noexcept {
+	// Load readIndex first, so that the writeIndex loaded after it is never behind it.
+	const uint32_t currentReadIndex = consumer.readIndex.load(std::memory_order_acquire);
+	return std::min(producer.writeIndex.load(std::memory_order_relaxed) - currentReadIndex, ring.capacity());
+}
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+inline uint32_t LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::ThreadChannel::size() noexcept {
+	if constexpr (overwriteOldest) {
+		// Load readIndex first. The producer may move it, but never past a writeIndex loaded after it.
+		const uint32_t currentReadIndex = consumer.readIndex.load(std::memory_order_acquire);
+		consumer.cachedWriteIndex = producer.writeIndex.load(std::memory_order_acquire);
+		return std::min(consumer.cachedWriteIndex - currentReadIndex, ring.capacity());
+	} else {
+		consumer.cachedWriteIndex = producer.writeIndex.load(std::memory_order_acquire);
+		return consumer.cachedWriteIndex - consumer.readIndex.load(std::memory_order_relaxed);
+	}
+}
 
-	elements[writePoint] = inElement;
-	writePoint = (writePoint + 1) & sizeMinusOne; 
-	numElements.fetch_add(1);
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+inline uint32_t LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::ThreadChannel::countedSize() noexcept {
+	const uint32_t numElements = size();
+	consumer.stats.onRead(numElements, ring.capacity());
+	return numElements;
 }
 
-template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES>
-typename LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES>::MessageContainer 
-LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES>::ThreadChannel::popFront() noexcept {
-	assert(numElements > 0);
-	assert(readPoint < SIZE);
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+typename LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::MessageContainer 
+LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::ThreadChannel::popFront() noexcept {
+	if constexpr (overwriteOldest) {
+		// Copy the element, then claim it with a compare and swap. If the producer dropped it in the meantime, it 
+		// may also have overwritten it, so the copy is discarded and the next element is tried.
+		uint32_t currentReadIndex = consumer.readIndex.load(std::memory_order_acquire);
+		while (true) {
+			if (consumer.cachedWriteIndex - currentReadIndex - 1 >= ring.capacity()) {
+				consumer.cachedWriteIndex = producer.writeIndex.load(std::memory_order_acquire);
+			}
+			assert(currentReadIndex != consumer.cachedWriteIndex);
+
+			const MessageContainer returnElement = ring.elements[currentReadIndex & indexMask()];
+			if (consumer.readIndex.compare_exchange_strong(currentReadIndex, currentReadIndex + 1, 
+				std::memory_order_acq_rel, std::memory_order_acquire))
+			{
+				consumer.stats.onPop(1);
+				traceLatency(returnElement);
+				return returnElement;
+			}
+		}
+	}
+
+	const uint32_t currentReadIndex = consumer.readIndex.load(std::memory_order_relaxed);
+	if constexpr (scheduling) {
+		// Only swept messages may be popped, since the others may still have to wait in the timing wheel.
+		assert(currentReadIndex != consumer.sweptIndex);
+	} else {
+		if (currentReadIndex == consumer.cachedWriteIndex) {
+			consumer.cachedWriteIndex = producer.writeIndex.load(std::memory_order_acquire);
+		}
+		assert(currentReadIndex != consumer.cachedWriteIndex);
+	}
+	consumer.stats.onPop(1);
 
-	MessageContainer returnElement = elements[readPoint];
-	readPoint = (readPoint + 1) & sizeMinusOne;
-	numElements.fetch_sub(1);
+	MessageContainer returnElement = ring.elements[currentReadIndex & indexMask()];
+	if constexpr (scheduling) {
+		consumer.readIndex.store(skipRemoved(currentReadIndex + 1), std::memory_order_release);
+	} else {
+		consumer.readIndex.store(currentReadIndex + 1, std::memory_order_release);
+	}
+	traceLatency(returnElement);
 
 	return returnElement;
 }
 
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+inline const typename LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::MessageContainer& 
+LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::ThreadChannel::front() noexcept {
+	static_assert(!overwriteOldest, "Lossy channels do not support in place access.");
+
+	const uint32_t currentReadIndex = consumer.readIndex.load(std::memory_order_relaxed);
+	if (currentReadIndex == consumer.cachedWriteIndex) {
+		consumer.cachedWriteIndex = producer.writeIndex.load(std::memory_order_acquire);
+	}
+	assert(currentReadIndex != consumer.cachedWriteIndex);
+
+	return ring.elements[currentReadIndex & indexMask()];
+}
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+inline typename LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::MessageRange 
+LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::ThreadChannel::readableElements() noexcept {
+	static_assert(!overwriteOldest, "Lossy channels do not support in place access.");
+
+	consumer.cachedWriteIndex = producer.writeIndex.load(std::memory_order_acquire);
+	const uint32_t currentReadIndex = consumer.readIndex.load(std::memory_order_relaxed);
+	consumer.stats.onRead(consumer.cachedWriteIndex - currentReadIndex, ring.capacity());
+	return MessageRange(ring.elements, indexMask(), currentReadIndex, consumer.cachedWriteIndex);
+}
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+inline void LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::ThreadChannel::popFront(
+	const uint32_t inNumElements) noexcept
+{
+	static_assert(!overwriteOldest, "Lossy channels do not support in place access.");
+
+	const uint32_t currentReadIndex = consumer.readIndex.load(std::memory_order_relaxed);
+	assert(inNumElements <= consumer.cachedWriteIndex - currentReadIndex);
+	consumer.stats.onPop(inNumElements);
+	if constexpr (tracing) {
+		for (uint32_t element = 0; element < inNumElements; ++element) {
+			traceLatency(ring.elements[(currentReadIndex + element) & indexMask()]);
+		}
+	}
+
+	consumer.readIndex.store(currentReadIndex + inNumElements, std::memory_order_release);
+}
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+template<typename F>
+uint32_t LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::ThreadChannel::consumeRuns(
+	F&& inFunction,
+	const uint32_t inMaxElements)
+{
+	static_assert(!overwriteOldest, "Lossy channels do not support in place access.");
+
+	const uint32_t currentReadIndex = consumer.readIndex.load(std::memory_order_relaxed);
+	if constexpr (scheduling) {
+		return consumeSwept(inFunction, currentReadIndex, inMaxElements);
+	}
+	uint32_t numElements = consumer.cachedWriteIndex - currentReadIndex;
+	if (numElements < inMaxElements) {
+		consumer.cachedWriteIndex = producer.writeIndex.load(std::memory_order_acquire);
+		numElements = consumer.cachedWriteIndex - currentReadIndex;
+	}
+	consumer.stats.onRead(numElements, ring.capacity());
+	numElements = std::min(numElements, inMaxElements);
+	if (numElements == 0) {
+		return 0;
+	}
+	consumer.stats.onPop(numElements);
+
+	const uint32_t firstElement = currentReadIndex & indexMask();
+	const uint32_t firstRunLength = std::min(numElements, ring.capacity() - firstElement);
+	inFunction(&ring.elements[firstElement], firstRunLength);
+	if (firstRunLength < numElements) {
+		inFunction(&ring.elements[0], numElements - firstRunLength);
+	}
+	if constexpr (tracing) {
+		for (uint32_t element = 0; element < numElements; ++element) {
+			traceLatency(ring.elements[(currentReadIndex + element) & indexMask()]);
+		}
+	}
+
+	consumer.readIndex.store(currentReadIndex + numElements, std::memory_order_release);
+	return numElements;
+}
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+template<typename F>
+uint32_t LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::ThreadChannel::sweepScheduled(F&& inSchedule) {
+	static_assert(scheduling, "sweepScheduled() requires TRAITS::scheduledMessageCapacity.");
+
+	consumer.cachedWriteIndex = producer.writeIndex.load(std::memory_order_acquire);
+	uint32_t sweptIndex = consumer.sweptIndex;
+	for (; sweptIndex != consumer.cachedWriteIndex; ++sweptIndex) {
+		MessageContainer& element = ring.elements[sweptIndex & indexMask()];
+		if (element.deliveryTime == 0) {
+			continue;
+		}
+		const SweepAction action = inSchedule(static_cast<const MessageContainer&>(element));
+		if (action == SweepAction::Stop) {
+			break;
+		}
+		if (action == SweepAction::Remove) {
+			element.deliveryTime = removedMark;
+			++consumer.numRemoved;
+		}
+	}
+	consumer.sweptIndex = sweptIndex;
+
+	// Hand the slots of removed messages at the front back to the producer right away.
+	const uint32_t currentReadIndex = consumer.readIndex.load(std::memory_order_relaxed);
+	const uint32_t firstKeptIndex = skipRemoved(currentReadIndex);
+	if (firstKeptIndex != currentReadIndex) {
+		consumer.readIndex.store(firstKeptIndex, std::memory_order_release);
+	}
+	return sweptIndex - firstKeptIndex - consumer.numRemoved;
+}
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+inline uint32_t LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::ThreadChannel::sweptSize() const noexcept {
+	return consumer.sweptIndex - consumer.readIndex.load(std::memory_order_relaxed) - consumer.numRemoved;
+}
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+template<typename F>
+uint32_t LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::ThreadChannel::consumeSwept(
+	F& inFunction,
+	const uint32_t inReadIndex,
+	const uint32_t inMaxElements)
+{
+	const uint32_t numPending = consumer.sweptIndex - inReadIndex - consumer.numRemoved;
+	consumer.stats.onRead(numPending, ring.capacity());
+	const uint32_t numElements = std::min(numPending, inMaxElements);
+	if (numElements == 0) {
+		return 0;
+	}
+	consumer.stats.onPop(numElements);
+
+	uint32_t index = inReadIndex;
+	for (uint32_t numConsumed = 0; numConsumed < numElements; ) {
+		const uint32_t firstElement = index & indexMask();
+		const uint32_t maxRunLength = std::min(numElements - numConsumed, ring.capacity() - firstElement);
+		uint32_t runLength = 1;
+		while (runLength < maxRunLength && ring.elements[firstElement + runLength].deliveryTime != removedMark) {
+			++runLength;
+		}
+		inFunction(&ring.elements[firstElement], runLength);
+		if constexpr (tracing) {
+			for (uint32_t element = 0; element < runLength; ++element) {
+				traceLatency(ring.elements[firstElement + element]);
+			}
+		}
+		numConsumed += runLength;
+		index = skipRemoved(index + runLength);
+	}
+
+	consumer.readIndex.store(index, std::memory_order_release);
+	return numElements;
+}
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+inline uint32_t LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::ThreadChannel::skipRemoved(
+	uint32_t inIndex) noexcept
+{
+	while (inIndex != consumer.sweptIndex && ring.elements[inIndex & indexMask()].deliveryTime == removedMark) {
+		++inIndex;
+		--consumer.numRemoved;
+	}
+	return inIndex;
+}
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::SharedChannel::SharedChannel() noexcept {
+	static_assert(Internal::isPowerOfTwo(sharedSize), "TRAITS::sharedChannelSize must be a power of two.");
+	static_assert(sharedSize >= 2, "TRAITS::sharedChannelSize must be at least 2, since with a single slot the "
+		"sequence of a published message equals the sequence the next producer claims.");
+	static_assert(sharedSize <= 0x80000000u, "TRAITS::sharedChannelSize must fit the free running 32 bit indices.");
+	static_assert(!overwriteOldest, "The shared channel does not support OverflowPolicy::OverwriteOldest.");
+
+	for (uint32_t index = 0; index < sharedSize; ++index) {
+		slots[index].sequence.store(index, std::memory_order_relaxed);
+	}
+}
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+inline typename LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::MessageContainer& 
+LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::SharedChannel::claim(uint32_t& outIndex) noexcept {
+	outIndex = writeIndex.fetch_add(1, std::memory_order_relaxed);
+	Slot& slot = slots[outIndex & (sharedSize - 1)];
+
+	// The slot is still in use by the previous lap only if the channel is full.
+	for (uint32_t spin = 0; slot.sequence.load(std::memory_order_acquire) != outIndex; ++spin) {
+		Internal::backoff(spin);
+	}
+	return slot.element;
+}
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+inline typename LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::MessageContainer* 
+LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::SharedChannel::tryClaim(uint32_t& outIndex) noexcept {
+	uint32_t index = writeIndex.load(std::memory_order_relaxed);
+	while (true) {
+		Slot& slot = slots[index & (sharedSize - 1)];
+		const int32_t difference = static_cast<int32_t>(slot.sequence.load(std::memory_order_acquire) - index);
+		if (difference == 0) {
+			if (writeIndex.compare_exchange_weak(index, index + 1, std::memory_order_relaxed)) {
+				outIndex = index;
+				return &slot.element;
+			}
+		} else if (difference < 0) {
+			return nullptr;
+		} else {
+			index = writeIndex.load(std::memory_order_relaxed);
+		}
+	}
+}
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+inline void LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::SharedChannel::publish(const uint32_t inIndex) noexcept {
+	slots[inIndex & (sharedSize - 1)].sequence.store(inIndex + 1, std::memory_order_release);
+}
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+inline const typename LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::MessageContainer* 
+LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::SharedChannel::front() noexcept {
+	Slot& slot = slots[readIndex & (sharedSize - 1)];
+	if (slot.sequence.load(std::memory_order_acquire) != readIndex + 1) {
+		return nullptr;
+	}
+	return &slot.element;
+}
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+inline void LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::SharedChannel::popFront() noexcept {
+	assert(slots[readIndex & (sharedSize - 1)].sequence.load(std::memory_order_relaxed) == readIndex + 1);
+
+	slots[readIndex & (sharedSize - 1)].sequence.store(readIndex + sharedSize, std::memory_order_release);
+	++readIndex;
+}
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+inline uint32_t LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::SharedChannel::size() noexcept {
+	uint32_t numElements = 0;
+	while (numElements < sharedSize && 
+		slots[(readIndex + numElements) & (sharedSize - 1)].sequence.load(std::memory_order_acquire) == 
+			readIndex + numElements + 1)
+	{
+		++numElements;
+	}
+	return numElements;
+}
+
 } // namespace LWMessageQueue
@@ -0,0 +1,506 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 Marcus Spangenberg
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#pragma once
+
+#if !defined(__linux__)
+#error "LWMessageRecorder requires Linux (mmap with MAP_POPULATE, POSIX files)."
+#endif
+
+#include "LWMessageQueue.h"
+
+#include <condition_variable>
+#include <errno.h>
+#include <fcntl.h>
+#include <mutex>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <system_error>
+#include <thread>
+#include <unistd.h>
+
+namespace LWMessageQueue {
+
+namespace Internal {
+
+/** Layout of a recording: a header, then fixed size records back to back. A record with time zero ends the
+	recording, which is how a file left at its preallocated size by a crashed recorder is read. The header holds
+	the layout fingerprint of the recorded queue type, see LWMessageQueue::layoutFingerprint().
+*/
+template<typename MESSAGE_CONTAINER>
+struct Recording {
+	struct Header {
+		uint64_t magic;
+		uint32_t version;
+		uint32_t recordSize;
+		uint64_t layoutFingerprint;
+	};
+
+	struct Record {
+		uint64_t time;
+		uint32_t channel;
+		MESSAGE_CONTAINER message;
+	};
+
+	static constexpr uint64_t headerMagic = 0x4345524d574cull; // "LWMREC"
+	static constexpr uint32_t version = 2;
+	static constexpr size_t recordsOffset = 64;
+
+	static_assert(sizeof(Header) <= recordsOffset, "The header must fit before the first record.");
+	static_assert(std::is_trivially_copyable<MESSAGE_CONTAINER>::value, "Recorded messages must be plain data.");
+};
+
+} // namespace Internal
+
+/**
+	@brief
+		Records the messages popped from an LWMessageQueue to a file, for LWMessageReplayer to push them again.
+
+	@details
+		The output thread calls record() for every message it pops, and the message is copied with its channel
+		and a timestamp to a memory mapped window of the file. A mapping thread owned by the recorder grows the 
+		file and maps and prefaults the window of the next chunk while the current one fills, and unmaps windows 
+		that are done with. The kernel writes the pages back in the background, so record() costs a copy of the 
+		message, and once per chunk the hand over of the next window, without system calls or page faults as 
+		long as the mapping thread keeps ahead. Messages are stored as raw bytes, so a recording is only replayed into the MESSAGE_QUEUE 
+		type it was recorded from. The layout fingerprint of that type is stored in the file, and checked by
+		LWMessageReplayer.
+
+		Template parameters:
+		MESSAGE_QUEUE is the LWMessageQueue type whose messages are recorded.
+*/
+template<typename MESSAGE_QUEUE>
+class LWMessageRecorder {
+public:
+	using MessageContainer = typename MESSAGE_QUEUE::MessageContainer;
+
+	/** Bytes the file is grown and mapped by at a time. */
+	static constexpr size_t defaultChunkSize = 64 << 20;
+
+	LWMessageRecorder() noexcept = default;
+	~LWMessageRecorder();
+
+	LWMessageRecorder(const LWMessageRecorder&) = delete;
+	LWMessageRecorder& operator=(const LWMessageRecorder&) = delete;
+
+	/** Create or truncate the file inPath, and start recording to it and the mapping thread.
+		@param inChunkSize Bytes the file is grown by at a time. Must be a multiple of the page size.
+		@return False on failure, with errno set.
+	*/
+	bool open(const char* inPath, const size_t inChunkSize = defaultChunkSize) noexcept;
+
+	/** Append inMessage, popped from channel inChannel, to the recording. Output thread only. Waits for the 
+		mapping thread if it has not mapped the next window yet when the current one is full.
+		@return False if the file could not be grown, in which case the message is not recorded.
+	*/
+	inline bool record(const uint32_t inChannel, const MessageContainer& inMessage) noexcept;
+
+	/** Stop the mapping thread, cut the file to the recorded messages and close it. Called by the destructor.
+		@return False if the file could not be cut, with errno set. The recording is still complete, since the
+			replayer stops at the first unwritten record.
+	*/
+	bool close() noexcept;
+
+	/** Number of messages recorded since open(). */
+	inline uint64_t getNumRecords() const noexcept { return numRecords; }
+
+private:
+	using Recording = Internal::Recording<MessageContainer>;
+	using Record = typename Recording::Record;
+
+	/** Map and prefault the window at inOffset, growing the file if needed.
+		@return The window, or nullptr with errno set.
+	*/
+	uint8_t* mapWindow(const uint64_t inOffset) noexcept;
+
+	/** Replace the full window with the one mapped ahead by the mapping thread. */
+	bool takeNextWindow() noexcept;
+
+	/** Body of the mapping thread. */
+	void mapAhead() noexcept;
+
+	int fileDescriptor = -1;
+	/** Windows start every chunkSize bytes, and overlap the next window by at least one record, so that a 
+		record starting before the end of its chunk never straddles two windows.
+	*/
+	size_t chunkSize = 0;
+	size_t windowSize = 0;
+	uint8_t* window = nullptr;
+	uint64_t windowOffset = 0;
+	uint64_t writeOffset = 0;
+	uint64_t numRecords = 0;
+
+	/** Written by open() and then by the mapping thread only. */
+	uint64_t fileSize = 0;
+
+	std::thread mappingThread;
+	std::mutex mutex;
+	std::condition_variable condition;
+
+	/** Guarded by mutex. The mapping thread maps nextWindow at nextWindowOffset, and unmaps retiredWindow. */
+	uint8_t* nextWindow = nullptr;
+	uint8_t* retiredWindow = nullptr;
+	uint64_t nextWindowOffset = 0;
+	int mappingError = 0;
+	bool isStopping = false;
+};
+
+/**
+	@brief
+		Pushes the messages of a recording made by LWMessageRecorder to an LWMessageQueue of the same type.
+
+	@details
+		Every message is pushed to the channel it was popped from, through tryForwardMessage(), from the calling
+		thread, which must be the only input thread of those channels. Messages are replayed at the pace they were
+		recorded, faster, or as fast as the output thread takes them.
+
+		Template parameters:
+		MESSAGE_QUEUE is the LWMessageQueue type of the recording.
+*/
+template<typename MESSAGE_QUEUE>
+class LWMessageReplayer {
+public:
+	using MessageContainer = typename MESSAGE_QUEUE::MessageContainer;
+
+	LWMessageReplayer() noexcept = default;
+	~LWMessageReplayer();
+
+	LWMessageReplayer(const LWMessageReplayer&) = delete;
+	LWMessageReplayer& operator=(const LWMessageReplayer&) = delete;
+
+	/** Map the recording inPath.
+		@return False on failure, with errno set. errno is EPROTO for a file that is not a recording, or a 
+			recording of a queue type with a different layout fingerprint than MESSAGE_QUEUE.
+	*/
+	bool open(const char* inPath) noexcept;
+
+	/** Unmap the recording. Called by the destructor. */
+	void close() noexcept;
+
+	/** Number of messages in the recording. */
+	inline uint64_t getNumRecords() const noexcept { return numRecords; }
+
+	/** Push every recorded message to its channel of inMessageQueue, waiting while a channel is full. Messages of
+		channels that inMessageQueue does not have, as with a runtime sized queue with fewer channels, are skipped.
+		@param inSpeed 1 to push at the recorded pace, 2 for twice as fast and so on, or 0 to push as fast as
+			possible.
+		@return Number of messages pushed.
+	*/
+	uint64_t replay(MESSAGE_QUEUE& inMessageQueue, const double inSpeed);
+
+private:
+	using Recording = Internal::Recording<MessageContainer>;
+	using Record = typename Recording::Record;
+
+	const uint8_t* file = nullptr;
+	size_t fileSize = 0;
+	uint64_t numRecords = 0;
+};
+
+template<typename MESSAGE_QUEUE>
+LWMessageRecorder<MESSAGE_QUEUE>::~LWMessageRecorder() {
+	close();
+}
+
+template<typename MESSAGE_QUEUE>
+bool LWMessageRecorder<MESSAGE_QUEUE>::open(const char* inPath, const size_t inChunkSize) noexcept {
+	assert(fileDescriptor < 0);
+	const size_t pageSize = sysconf(_SC_PAGESIZE);
+	assert(inChunkSize >= Recording::recordsOffset && inChunkSize % pageSize == 0);
+
+	fileDescriptor = ::open(inPath, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+	if (fileDescriptor < 0) {
+		return false;
+	}
+	chunkSize = inChunkSize;
+	windowSize = inChunkSize + (sizeof(Record) + pageSize - 1) / pageSize * pageSize;
+	windowOffset = 0;
+	writeOffset = 0;
+	fileSize = 0;
+	numRecords = 0;
+	window = mapWindow(0);
+	if (window == nullptr) {
+		const int error = errno;
+		close();
+		errno = error;
+		return false;
+	}
+
+	typename Recording::Header header;
+	header.magic = Recording::headerMagic;
+	header.version = Recording::version;
+	header.recordSize = sizeof(Record);
+	header.layoutFingerprint = MESSAGE_QUEUE::layoutFingerprint();
+	memcpy(window, &header, sizeof(header));
+	writeOffset = Recording::recordsOffset;
+
+	nextWindowOffset = chunkSize;
+	try {
+		mappingThread = std::thread([this]() { mapAhead(); });
+	}
+	catch (const std::system_error& inError) {
+		close();
+		errno = inError.code().value();
+		return false;
+	}
+	return true;
+}
+
+template<typename MESSAGE_QUEUE>
+inline bool LWMessageRecorder<MESSAGE_QUEUE>::record(
+	const uint32_t inChannel,
+	const MessageContainer& inMessage) noexcept
+{
+	assert(fileDescriptor >= 0);
+
+	if (writeOffset - windowOffset >= chunkSize) {
+		if (!takeNextWindow()) {
+			return false;
+		}
+	}
+
+	Record record;
+	record.time = Internal::traceTime();
+	record.channel = inChannel;
+	record.message = inMessage;
+	memcpy(window + (writeOffset - windowOffset), &record, sizeof(Record));
+	writeOffset += sizeof(Record);
+	++numRecords;
+	return true;
+}
+
+template<typename MESSAGE_QUEUE>
+bool LWMessageRecorder<MESSAGE_QUEUE>::close() noexcept {
+	if (fileDescriptor < 0) {
+		return true;
+	}
+
+	if (mappingThread.joinable()) {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			isStopping = true;
+		}
+		condition.notify_all();
+		mappingThread.join();
+	}
+	for (uint8_t* mappedWindow : {window, nextWindow, retiredWindow}) {
+		if (mappedWindow != nullptr) {
+			munmap(mappedWindow, windowSize);
+		}
+	}
+	window = nullptr;
+	nextWindow = nullptr;
+	retiredWindow = nullptr;
+	mappingError = 0;
+	isStopping = false;
+
+	// Drop the zero filled rest of the last window.
+	bool isCut = true;
+	int error = 0;
+	if (writeOffset != 0 && ftruncate(fileDescriptor, writeOffset) != 0) {
+		isCut = false;
+		error = errno;
+	}
+	::close(fileDescriptor);
+	fileDescriptor = -1;
+	errno = error;
+	return isCut;
+}
+
+template<typename MESSAGE_QUEUE>
+uint8_t* LWMessageRecorder<MESSAGE_QUEUE>::mapWindow(const uint64_t inOffset) noexcept {
+	if (inOffset + windowSize > fileSize) {
+		if (ftruncate(fileDescriptor, inOffset + windowSize) != 0) {
+			return nullptr;
+		}
+		fileSize = inOffset + windowSize;
+	}
+
+	void* newWindow = mmap(nullptr, windowSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fileDescriptor, 
+		inOffset);
+	if (newWindow == MAP_FAILED) {
+		return nullptr;
+	}
+	return static_cast<uint8_t*>(newWindow);
+}
+
+template<typename MESSAGE_QUEUE>
+bool LWMessageRecorder<MESSAGE_QUEUE>::takeNextWindow() noexcept {
+	std::unique_lock<std::mutex> lock(mutex);
+	condition.wait(lock, [this]() { return nextWindow != nullptr || mappingError != 0; });
+	if (nextWindow == nullptr) {
+		errno = mappingError;
+		return false;
+	}
+
+	// The mapping thread took the previous retired window before it mapped nextWindow.
+	assert(retiredWindow == nullptr);
+	retiredWindow = window;
+	window = nextWindow;
+	nextWindow = nullptr;
+	windowOffset = nextWindowOffset;
+	nextWindowOffset += chunkSize;
+	lock.unlock();
+	condition.notify_all();
+	return true;
+}
+
+template<typename MESSAGE_QUEUE>
+void LWMessageRecorder<MESSAGE_QUEUE>::mapAhead() noexcept {
+	std::unique_lock<std::mutex> lock(mutex);
+	while (true) {
+		condition.wait(lock, [this]() {
+			return isStopping || retiredWindow != nullptr || (nextWindow == nullptr && mappingError == 0);
+		});
+		if (isStopping) {
+			return;
+		}
+
+		uint8_t* oldWindow = retiredWindow;
+		retiredWindow = nullptr;
+		const bool mapsWindow = (nextWindow == nullptr && mappingError == 0);
+		const uint64_t offset = nextWindowOffset;
+		lock.unlock();
+
+		if (oldWindow != nullptr) {
+			munmap(oldWindow, windowSize);
+		}
+		uint8_t* newWindow = mapsWindow ? mapWindow(offset) : nullptr;
+		const int error = errno;
+
+		lock.lock();
+		if (mapsWindow) {
+			if (newWindow != nullptr) {
+				nextWindow = newWindow;
+			} else {
+				mappingError = error;
+			}
+			condition.notify_all();
+		}
+	}
+}
+
+template<typename MESSAGE_QUEUE>
+LWMessageReplayer<MESSAGE_QUEUE>::~LWMessageReplayer() {
+	close();
+}
+
+template<typename MESSAGE_QUEUE>
+bool LWMessageReplayer<MESSAGE_QUEUE>::open(const char* inPath) noexcept {
+	assert(file == nullptr);
+
+	const int fileDescriptor = ::open(inPath, O_RDONLY | O_CLOEXEC);
+	if (fileDescriptor < 0) {
+		return false;
+	}
+	struct stat status;
+	if (fstat(fileDescriptor, &status) != 0) {
+		::close(fileDescriptor);
+		return false;
+	}
+	if (static_cast<size_t>(status.st_size) < Recording::recordsOffset) {
+		::close(fileDescriptor);
+		errno = EPROTO;
+		return false;
+	}
+
+	void* newFile = mmap(nullptr, status.st_size, PROT_READ, MAP_PRIVATE, fileDescriptor, 0);
+	::close(fileDescriptor);
+	if (newFile == MAP_FAILED) {
+		return false;
+	}
+	madvise(newFile, status.st_size, MADV_SEQUENTIAL);
+
+	typename Recording::Header header;
+	memcpy(&header, newFile, sizeof(header));
+	if (header.magic != Recording::headerMagic || header.version != Recording::version ||
+		header.recordSize != sizeof(Record) || header.layoutFingerprint != MESSAGE_QUEUE::layoutFingerprint())
+	{
+		munmap(newFile, status.st_size);
+		errno = EPROTO;
+		return false;
+	}
+
+	file = static_cast<const uint8_t*>(newFile);
+	fileSize = status.st_size;
+
+	// Count up to the first unwritten record, in case the recorder did not close the file.
+	numRecords = (fileSize - Recording::recordsOffset) / sizeof(Record);
+	for (uint64_t index = 0; index < numRecords; ++index) {
+		// The time is the first member of a record.
+		uint64_t time;
+		memcpy(&time, file + Recording::recordsOffset + index * sizeof(Record), sizeof(time));
+		if (time == 0) {
+			numRecords = index;
+			break;
+		}
+	}
+	return true;
+}
+
+template<typename MESSAGE_QUEUE>
+void LWMessageReplayer<MESSAGE_QUEUE>::close() noexcept {
+	if (file != nullptr) {
+		munmap(const_cast<uint8_t*>(file), fileSize);
+		file = nullptr;
+		fileSize = 0;
+		numRecords = 0;
+	}
+}
+
+template<typename MESSAGE_QUEUE>
+uint64_t LWMessageReplayer<MESSAGE_QUEUE>::replay(MESSAGE_QUEUE& inMessageQueue, const double inSpeed) {
+	assert(file != nullptr);
+	assert(inSpeed >= 0.0);
+
+	const std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+	uint64_t firstTime = 0;
+	uint64_t numPushed = 0;
+	for (uint64_t index = 0; index < numRecords; ++index) {
+		Record record;
+		memcpy(&record, file + Recording::recordsOffset + index * sizeof(Record), sizeof(Record));
+		if (index == 0) {
+			firstTime = record.time;
+		}
+		if (record.channel >= inMessageQueue.getNumChannels()) {
+			continue;
+		}
+
+		if (inSpeed != 0.0) {
+			const std::chrono::nanoseconds delay(static_cast<int64_t>((record.time - firstTime) / inSpeed));
+			std::this_thread::sleep_until(startTime + delay);
+		}
+
+		typename MESSAGE_QUEUE::ThreadChannelInput channelInput = inMessageQueue.getThreadChannelInput(record.channel);
+		while (!channelInput.tryForwardMessage(record.message)) {
+			std::this_thread::yield();
+		}
+		++numPushed;
+	}
+	return numPushed;
+}
+
+} // namespace LWMessageQueue
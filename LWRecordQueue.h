@@ -0,0 +1,652 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 Marcus Spangenberg
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#pragma once
+
+#include <type_traits>
+#include "LWMessageQueue.h"
+
+namespace LWMessageQueue {
+
+/**
+	@brief
+		A static size message queue with the same threading model as LWMessageQueue, where each message only takes
+		the space of its own type instead of the largest type in the MESSAGE union.
+
+	@details
+		Every channel is a ring of BYTES bytes holding variable length records. A record is a small header with the
+		message type and size, followed by exactly sizeof(T) bytes of message data, rounded up to recordAlignment.
+		A record never wraps around the end of the ring. When the next record does not fit before the end, the input
+		thread fills the rest of the ring with a padding record that the output thread skips. Use it instead of
+		LWMessageQueue when a few message types are much larger than the common ones.
+
+		Messages are pushed with the same calls as on LWMessageQueue, e.g. pushMessage(message, type), so message
+		structs and TYPES enums from Example/Message.h can be used unchanged, without a MESSAGE union. Since messages
+		have different sizes, they can not be popped by value. The output thread reads them in place as
+		MessageRecord instances, with ThreadChannelOutput::peek() and ThreadChannelOutput::release(), or with
+		ThreadChannelOutput::drain().
+
+		Whether a channel is full depends on the size of the next message, so ThreadChannelInput::hasRoomFor()
+		replaces isFull(). TRAITS::overflowPolicy may be OverflowPolicy::Reject or OverflowPolicy::Block. The ready
+		bitmap, blocking wait, eventfd, shared channel, stats, latency tracing and scheduled delivery of 
+		LWMessageQueue are not available on record queues, and enabling them in TRAITS does not compile.
+
+		Template parameters:
+		BYTES is the size of the ring of one channel, in bytes. Must be a power of two.
+		CHANNELS is the number of channels, i.e. the number of input/producer threads.
+		TYPES should be a enum class with one entry per message type, at most 32 bits wide.
+		TRAITS is an optional configuration struct, see DefaultTraits.
+*/
+template<uint32_t BYTES, uint32_t CHANNELS, typename TYPES, typename TRAITS = DefaultTraits>
+class LWRecordQueue {
+private:
+	class ThreadChannel;
+public:
+	/** Alignment of records in the ring, and of the message data in each record. */
+	static constexpr uint32_t recordAlignment = 8;
+
+	/** A message in the ring. When reading messages you get references to instances of this type. */
+	class alignas(recordAlignment) MessageRecord {
+	public:
+		/** Get a reference to the message data, as the correct message type. */
+		template<typename T>
+		inline const T& getMessage() const noexcept;
+
+		/** Check if a message record contains a message of a specific type. */
+		inline TYPES getType() const noexcept;
+
+		/** Size of the message data in bytes, i.e. sizeof(T) of the pushed message type. */
+		inline uint32_t getMessageSize() const noexcept;
+
+	private:
+		MessageRecord(const uint32_t inMessageSize, const TYPES inType) noexcept;
+
+		inline bool isPadding() const noexcept;
+
+		uint32_t messageSize;
+		TYPES type;
+		friend class LWRecordQueue<BYTES, CHANNELS, TYPES, TRAITS>;
+	};
+
+	/** Each input thread has its own ThreadChannelInput instance. Use it to push messages to the queue. */
+	class ThreadChannelInput {
+	public:
+		ThreadChannelInput(ThreadChannel& inThreadChannel) noexcept;
+		ThreadChannelInput(const ThreadChannelInput& other) = default;
+		ThreadChannelInput& operator=(const ThreadChannelInput& other) = default;
+
+		/** Check if a message of type T can be pushed without applying the overflow policy. Does not change the 
+			channel. A message that does not fit before the end of the ring only counts as fitting when there is 
+			room for both the padding and the message at once, while a push places the padding on its own as soon
+			as it fits. To wait for room for such a message, retry tryPushMessage() instead of polling this.
+		*/
+		template<typename T>
+		bool hasRoomFor() const noexcept;
+
+		/** Push a message to the channel. If the channel has no room for it, TRAITS::overflowPolicy decides what
+			happens, see OverflowPolicy. Only one thread may push messages to a single channel.
+			@param inMessage Message data, a POD type struct.
+			@param inType Message type from the TYPES enum.
+		*/
+		template<typename T>
+		void pushMessage(const T& inMessage, const TYPES inType) noexcept;
+
+		/** Push a message to the channel if there is room for it. Never waits.
+			@return True if the message was pushed.
+		*/
+		template<typename T>
+		bool tryPushMessage(const T& inMessage, const TYPES inType) noexcept;
+
+		/** Write a message to the channel without making it visible to the output thread, see
+			LWMessageQueue::ThreadChannelInput::stageMessage().
+			@return True if the message was staged.
+		*/
+		template<typename T>
+		bool stageMessage(const T& inMessage, const TYPES inType) noexcept;
+
+		/** Publish all staged messages to the output thread, with a single store. */
+		inline void commit() noexcept;
+
+		/** Reserve a record for a message of type T, and get a reference to its uninitialized message data in
+			place. The message becomes visible to the output thread on the next publish(), commit() or
+			pushMessage(). A full channel is handled as in pushMessage(), except that with OverflowPolicy::Reject
+			the user must make sure there is room before calling.
+		*/
+		template<typename T>
+		T& reserve(const TYPES inType) noexcept;
+
+		/** Publish reserved and staged messages. Same as commit(). */
+		inline void publish() noexcept;
+
+		/** Construct a message of type T directly in the channel from inArgs, and publish it. A full channel is
+			handled as in pushMessage().
+		*/
+		template<typename T, typename... Args>
+		void emplace(const TYPES inType, Args&&... inArgs) noexcept;
+
+	private:
+		/** Stage a record for a message of type T, applying the overflow policy if there is no room for it.
+			@param inWait Wait for room with OverflowPolicy::Block.
+			@return Message data of the record, or nullptr if there is no room.
+		*/
+		template<typename T>
+		inline T* stageRecord(const TYPES inType, const bool inWait) noexcept;
+
+		ThreadChannel& threadChannel;
+	};
+
+	/** The single output thread has one ThreadChannelOutput instance per input thread. Use them to read messages
+		from the queue.
+	*/
+	class ThreadChannelOutput {
+	public:
+		ThreadChannelOutput(ThreadChannel& inThreadChannel) noexcept;
+		ThreadChannelOutput(const ThreadChannelOutput& other) = default;
+		ThreadChannelOutput& operator=(const ThreadChannelOutput& other) = default;
+
+		/** Check if the channel has no pending messages. */
+		inline bool isEmpty() noexcept;
+
+		/** Get number of pending messages in the channel. Walks the pending records, so prefer isEmpty() or
+			drain() when the exact number is not needed.
+		*/
+		uint32_t getNumMessages() noexcept;
+
+		/** Get a reference to the next message in the channel without copying or removing it. The user must make
+			sure that the channel is not empty before calling. The reference is valid until the message is
+			released.
+		*/
+		inline const MessageRecord& peek() noexcept;
+
+		/** Remove the next inNumMessages messages from the channel, handing their bytes back to the input thread.
+			The messages must have been seen as pending, through isEmpty(), getNumMessages() or peek().
+		*/
+		void release(const uint32_t inNumMessages) noexcept;
+
+		/** Call inFunction(const MessageRecord&) for up to inMaxMessages pending messages, in order. Records are
+			passed by reference to the ring, so the reference must not be kept after inFunction returns. The read
+			position is published once, after the last call. It is safe to call on an empty channel.
+			@return Number of messages processed.
+		*/
+		template<typename F>
+		uint32_t drain(F&& inFunction, const uint32_t inMaxMessages);
+
+	private:
+		ThreadChannel& threadChannel;
+	};
+
+	LWRecordQueue() = default;
+	~LWRecordQueue() = default;
+
+	LWRecordQueue(const LWRecordQueue&) = delete;
+	LWRecordQueue& operator=(const LWRecordQueue&) = delete;
+	LWRecordQueue(const LWRecordQueue&&) = delete;
+	LWRecordQueue& operator=(const LWRecordQueue&&) = delete;
+
+	/** Get a thread channel input for an input thread. */
+	ThreadChannelInput getThreadChannelInput(const uint32_t inChannel) noexcept;
+
+	/** Get a thread channel output for the output thread. */
+	ThreadChannelOutput getThreadChannelOutput(const uint32_t inChannel) noexcept;
+
+	/** Number of ring bytes taken by a message of type T, including its header. */
+	template<typename T>
+	static constexpr uint32_t recordSize() noexcept {
+		return sizeof(MessageRecord) + ((sizeof(T) + recordAlignment - 1) & ~(recordAlignment - 1));
+	}
+
+private:
+	/** Single producer, single consumer byte ring. writeIndex and readIndex are free running byte counters, masked
+		when indexing the ring, and always multiples of recordAlignment. As in LWMessageQueue, each side owns one
+		index on its own cache line and keeps a cached copy of the other side's index.
+	*/
+	class alignas(TRAITS::cacheLineSize) ThreadChannel {
+	public:
+		ThreadChannel() noexcept;
+		~ThreadChannel() = default;
+
+		ThreadChannel(const ThreadChannel&) = delete;
+		const ThreadChannel& operator=(const ThreadChannel&) = delete;
+		ThreadChannel(const ThreadChannel&&) = delete;
+		const ThreadChannel& operator=(const ThreadChannel&&) = delete;
+
+		/** Producer side. Records are staged at stagedWriteIndex and become visible to the consumer when
+			writeIndex is moved up to it by commit(). When a record does not fit before the end of the ring, 
+			makeRoomFor() stages a padding record as soon as there is room for it, so that the record can start at
+			the beginning of the ring once the consumer has caught up. hasRoomFor() only checks.
+		*/
+		inline bool hasRoomFor(const uint32_t inRecordSize) const noexcept;
+		inline bool makeRoomFor(const uint32_t inRecordSize) noexcept;
+		inline uint8_t* stageBack(const uint32_t inMessageSize, const TYPES inType) noexcept;
+		inline bool commit() noexcept;
+
+		/** Consumer side. front() skips padding, and returns nullptr when the channel is empty. ioReadIndex is
+			moved past the padding. firstRecord() also publishes the read position when it skipped padding, so 
+			that an input thread waiting for room sees the padding consumed even if the channel is otherwise empty.
+		*/
+		inline const MessageRecord* front(uint32_t& ioReadIndex) noexcept;
+		inline const MessageRecord* firstRecord() noexcept;
+		inline void publishReadIndex(const uint32_t inReadIndex) noexcept;
+		inline uint32_t getReadIndex() const noexcept;
+		inline uint32_t nextRecord(const uint32_t inReadIndex, const MessageRecord& inRecord) const noexcept;
+
+	private:
+		inline bool hasFreeBytes(const uint32_t inNumBytes) noexcept;
+		inline uint32_t getNumFreeBytes() const noexcept;
+
+		/** Written by the input thread only. */
+		struct alignas(TRAITS::cacheLineSize) ProducerState {
+			std::atomic<uint32_t> writeIndex{0};
+			uint32_t stagedWriteIndex = 0;
+			uint32_t cachedReadIndex = 0;
+		};
+
+		/** Written by the output thread only. */
+		struct alignas(TRAITS::cacheLineSize) ConsumerState {
+			std::atomic<uint32_t> readIndex{0};
+			uint32_t cachedWriteIndex = 0;
+		};
+
+		ProducerState producer;
+		ConsumerState consumer;
+		alignas(TRAITS::cacheLineSize) uint8_t buffer[BYTES];
+	};
+
+	ThreadChannel threadChannels[CHANNELS];
+
+	static constexpr uint32_t bytesMinusOne = BYTES - 1;
+	static constexpr uint32_t paddingSize = 0xffffffffu;
+};
+
+template<uint32_t BYTES, uint32_t CHANNELS, typename TYPES, typename TRAITS>
+LWRecordQueue<BYTES, CHANNELS, TYPES, TRAITS>::MessageRecord::MessageRecord(
+	const uint32_t inMessageSize,
+	const TYPES inType) noexcept
+	: messageSize(inMessageSize),
+	type(inType)
+{
+}
+
+template<uint32_t BYTES, uint32_t CHANNELS, typename TYPES, typename TRAITS>
+template<typename T>
+inline const T& LWRecordQueue<BYTES, CHANNELS, TYPES, TRAITS>::MessageRecord::getMessage() const noexcept {
+	assert(sizeof(T) <= messageSize);
+	return *reinterpret_cast<const T*>(reinterpret_cast<const uint8_t*>(this) + sizeof(MessageRecord));
+}
+
+template<uint32_t BYTES, uint32_t CHANNELS, typename TYPES, typename TRAITS>
+inline TYPES LWRecordQueue<BYTES, CHANNELS, TYPES, TRAITS>::MessageRecord::getType() const noexcept {
+	return type;
+}
+
+template<uint32_t BYTES, uint32_t CHANNELS, typename TYPES, typename TRAITS>
+inline uint32_t LWRecordQueue<BYTES, CHANNELS, TYPES, TRAITS>::MessageRecord::getMessageSize() const noexcept {
+	return messageSize;
+}
+
+template<uint32_t BYTES, uint32_t CHANNELS, typename TYPES, typename TRAITS>
+inline bool LWRecordQueue<BYTES, CHANNELS, TYPES, TRAITS>::MessageRecord::isPadding() const noexcept {
+	return messageSize == paddingSize;
+}
+
+template<uint32_t BYTES, uint32_t CHANNELS, typename TYPES, typename TRAITS>
+LWRecordQueue<BYTES, CHANNELS, TYPES, TRAITS>::ThreadChannelInput::ThreadChannelInput(
+	ThreadChannel& inThreadChannel) noexcept
+	: threadChannel(inThreadChannel)
+{
+}
+
+template<uint32_t BYTES, uint32_t CHANNELS, typename TYPES, typename TRAITS>
+template<typename T>
+bool LWRecordQueue<BYTES, CHANNELS, TYPES, TRAITS>::ThreadChannelInput::hasRoomFor() const noexcept {
+	return threadChannel.hasRoomFor(recordSize<T>());
+}
+
+template<uint32_t BYTES, uint32_t CHANNELS, typename TYPES, typename TRAITS>
+template<typename T>
+void LWRecordQueue<BYTES, CHANNELS, TYPES, TRAITS>::ThreadChannelInput::pushMessage(
+	const T& inMessage,
+	const TYPES inType) noexcept
+{
+	T* message = stageRecord<T>(inType, true);
+	if (message == nullptr) {
+		assert(!"Pushing to a full channel.");
+		return;
+	}
+
+	*message = inMessage;
+	threadChannel.commit();
+}
+
+template<uint32_t BYTES, uint32_t CHANNELS, typename TYPES, typename TRAITS>
+template<typename T>
+bool LWRecordQueue<BYTES, CHANNELS, TYPES, TRAITS>::ThreadChannelInput::tryPushMessage(
+	const T& inMessage,
+	const TYPES inType) noexcept
+{
+	T* message = stageRecord<T>(inType, false);
+	if (message == nullptr) {
+		return false;
+	}
+
+	*message = inMessage;
+	threadChannel.commit();
+	return true;
+}
+
+template<uint32_t BYTES, uint32_t CHANNELS, typename TYPES, typename TRAITS>
+template<typename T>
+bool LWRecordQueue<BYTES, CHANNELS, TYPES, TRAITS>::ThreadChannelInput::stageMessage(
+	const T& inMessage,
+	const TYPES inType) noexcept
+{
+	T* message = stageRecord<T>(inType, false);
+	if (message == nullptr) {
+		return false;
+	}
+
+	*message = inMessage;
+	return true;
+}
+
+template<uint32_t BYTES, uint32_t CHANNELS, typename TYPES, typename TRAITS>
+inline void LWRecordQueue<BYTES, CHANNELS, TYPES, TRAITS>::ThreadChannelInput::commit() noexcept {
+	threadChannel.commit();
+}
+
+template<uint32_t BYTES, uint32_t CHANNELS, typename TYPES, typename TRAITS>
+template<typename T>
+T& LWRecordQueue<BYTES, CHANNELS, TYPES, TRAITS>::ThreadChannelInput::reserve(const TYPES inType) noexcept {
+	T* message = stageRecord<T>(inType, true);
+	assert(message != nullptr);
+
+	return *message;
+}
+
+template<uint32_t BYTES, uint32_t CHANNELS, typename TYPES, typename TRAITS>
+inline void LWRecordQueue<BYTES, CHANNELS, TYPES, TRAITS>::ThreadChannelInput::publish() noexcept {
+	threadChannel.commit();
+}
+
+template<uint32_t BYTES, uint32_t CHANNELS, typename TYPES, typename TRAITS>
+template<typename T, typename... Args>
+void LWRecordQueue<BYTES, CHANNELS, TYPES, TRAITS>::ThreadChannelInput::emplace(
+	const TYPES inType,
+	Args&&... inArgs) noexcept
+{
+	T* message = stageRecord<T>(inType, true);
+	if (message == nullptr) {
+		assert(!"Pushing to a full channel.");
+		return;
+	}
+
+	new (message) T{std::forward<Args>(inArgs)...};
+	threadChannel.commit();
+}
+
+template<uint32_t BYTES, uint32_t CHANNELS, typename TYPES, typename TRAITS>
+template<typename T>
+inline T* LWRecordQueue<BYTES, CHANNELS, TYPES, TRAITS>::ThreadChannelInput::stageRecord(
+	const TYPES inType,
+	const bool inWait) noexcept
+{
+	static_assert(std::is_trivially_copyable<T>::value, "Messages must be POD type structs.");
+	static_assert(alignof(T) <= recordAlignment, "Message alignment exceeds LWRecordQueue::recordAlignment.");
+	static_assert(recordSize<T>() <= BYTES, "Message does not fit in the ring of a channel.");
+
+	if (!threadChannel.makeRoomFor(recordSize<T>())) {
+		// Commit staged messages, so that the output thread can make room.
+		threadChannel.commit();
+
+		if constexpr (TRAITS::overflowPolicy == OverflowPolicy::Block) {
+			if (!inWait) {
+				return nullptr;
+			}
+			for (uint32_t spin = 0; !threadChannel.makeRoomFor(recordSize<T>()); ++spin) {
+				Internal::backoff(spin);
+			}
+		} else {
+			(void)inWait;
+			return nullptr;
+		}
+	}
+
+	return reinterpret_cast<T*>(threadChannel.stageBack(sizeof(T), inType));
+}
+
+template<uint32_t BYTES, uint32_t CHANNELS, typename TYPES, typename TRAITS>
+LWRecordQueue<BYTES, CHANNELS, TYPES, TRAITS>::ThreadChannelOutput::ThreadChannelOutput(
+	ThreadChannel& inThreadChannel) noexcept
+	: threadChannel(inThreadChannel)
+{
+}
+
+template<uint32_t BYTES, uint32_t CHANNELS, typename TYPES, typename TRAITS>
+inline bool LWRecordQueue<BYTES, CHANNELS, TYPES, TRAITS>::ThreadChannelOutput::isEmpty() noexcept {
+	return threadChannel.firstRecord() == nullptr;
+}
+
+template<uint32_t BYTES, uint32_t CHANNELS, typename TYPES, typename TRAITS>
+uint32_t LWRecordQueue<BYTES, CHANNELS, TYPES, TRAITS>::ThreadChannelOutput::getNumMessages() noexcept {
+	uint32_t numMessages = 0;
+	threadChannel.firstRecord();
+	uint32_t readIndex = threadChannel.getReadIndex();
+	while (const MessageRecord* record = threadChannel.front(readIndex)) {
+		readIndex = threadChannel.nextRecord(readIndex, *record);
+		++numMessages;
+	}
+	return numMessages;
+}
+
+template<uint32_t BYTES, uint32_t CHANNELS, typename TYPES, typename TRAITS>
+inline const typename LWRecordQueue<BYTES, CHANNELS, TYPES, TRAITS>::MessageRecord&
+LWRecordQueue<BYTES, CHANNELS, TYPES, TRAITS>::ThreadChannelOutput::peek() noexcept {
+	const MessageRecord* record = threadChannel.firstRecord();
+	assert(record != nullptr);
+
+	return *record;
+}
+
+template<uint32_t BYTES, uint32_t CHANNELS, typename TYPES, typename TRAITS>
+void LWRecordQueue<BYTES, CHANNELS, TYPES, TRAITS>::ThreadChannelOutput::release(const uint32_t inNumMessages) noexcept {
+	uint32_t readIndex = threadChannel.getReadIndex();
+	for (uint32_t index = 0; index < inNumMessages; ++index) {
+		const MessageRecord* record = threadChannel.front(readIndex);
+		assert(record != nullptr);
+		readIndex = threadChannel.nextRecord(readIndex, *record);
+	}
+	threadChannel.publishReadIndex(readIndex);
+}
+
+template<uint32_t BYTES, uint32_t CHANNELS, typename TYPES, typename TRAITS>
+template<typename F>
+uint32_t LWRecordQueue<BYTES, CHANNELS, TYPES, TRAITS>::ThreadChannelOutput::drain(
+	F&& inFunction,
+	const uint32_t inMaxMessages)
+{
+	uint32_t numMessages = 0;
+	uint32_t readIndex = threadChannel.getReadIndex();
+	while (numMessages < inMaxMessages) {
+		const MessageRecord* record = threadChannel.front(readIndex);
+		if (record == nullptr) {
+			break;
+		}
+		inFunction(*record);
+		readIndex = threadChannel.nextRecord(readIndex, *record);
+		++numMessages;
+	}
+	threadChannel.publishReadIndex(readIndex);
+	return numMessages;
+}
+
+template<uint32_t BYTES, uint32_t CHANNELS, typename TYPES, typename TRAITS>
+typename LWRecordQueue<BYTES, CHANNELS, TYPES, TRAITS>::ThreadChannelInput
+LWRecordQueue<BYTES, CHANNELS, TYPES, TRAITS>::getThreadChannelInput(const uint32_t inChannel) noexcept {
+	assert(inChannel < CHANNELS);
+	return ThreadChannelInput(threadChannels[inChannel]);
+}
+
+template<uint32_t BYTES, uint32_t CHANNELS, typename TYPES, typename TRAITS>
+typename LWRecordQueue<BYTES, CHANNELS, TYPES, TRAITS>::ThreadChannelOutput
+LWRecordQueue<BYTES, CHANNELS, TYPES, TRAITS>::getThreadChannelOutput(const uint32_t inChannel) noexcept {
+	assert(inChannel < CHANNELS);
+	return ThreadChannelOutput(threadChannels[inChannel]);
+}
+
+template<uint32_t BYTES, uint32_t CHANNELS, typename TYPES, typename TRAITS>
+LWRecordQueue<BYTES, CHANNELS, TYPES, TRAITS>::ThreadChannel::ThreadChannel() noexcept
+{
+	static_assert(Internal::isPowerOfTwo(BYTES), "Template parameter BYTES must be a power of two.");
+	static_assert(BYTES >= 2 * sizeof(MessageRecord), "Template parameter BYTES is too small.");
+	static_assert(BYTES <= 0x80000000u, "Template parameter BYTES must fit the free running 32 bit indices.");
+	static_assert(sizeof(MessageRecord) == recordAlignment, "TYPES must be at most 32 bits wide.");
+	static_assert(Internal::isPowerOfTwo(TRAITS::cacheLineSize), "TRAITS::cacheLineSize must be a power of two.");
+	static_assert(TRAITS::overflowPolicy != OverflowPolicy::OverwriteOldest,
+		"LWRecordQueue does not support OverflowPolicy::OverwriteOldest.");
+	static_assert(!TRAITS::enableReadyBitmap && !TRAITS::enableBlockingWait,
+		"LWRecordQueue does not support the ready bitmap or blocking wait.");
+	static_assert(!TRAITS::enableStats && TRAITS::traceSampleInterval == 0 && !TRAITS::enableEventFd && 
+		TRAITS::sharedChannelSize == 0 && TRAITS::scheduledMessageCapacity == 0, "LWRecordQueue does not support stats, "
+		"latency tracing, the eventfd, the shared channel or scheduled delivery.");
+	assert(producer.writeIndex.is_lock_free());
+}
+
+template<uint32_t BYTES, uint32_t CHANNELS, typename TYPES, typename TRAITS>
+inline bool LWRecordQueue<BYTES, CHANNELS, TYPES, TRAITS>::ThreadChannel::hasRoomFor(
+	const uint32_t inRecordSize) const noexcept
+{
+	const uint32_t offset = producer.stagedWriteIndex & bytesMinusOne;
+	const uint32_t paddingBytes = (inRecordSize > BYTES - offset) ? BYTES - offset : 0;
+	return paddingBytes + inRecordSize <= getNumFreeBytes();
+}
+
+template<uint32_t BYTES, uint32_t CHANNELS, typename TYPES, typename TRAITS>
+inline bool LWRecordQueue<BYTES, CHANNELS, TYPES, TRAITS>::ThreadChannel::makeRoomFor(
+	const uint32_t inRecordSize) noexcept
+{
+	const uint32_t offset = producer.stagedWriteIndex & bytesMinusOne;
+	if (inRecordSize > BYTES - offset) {
+		// Waiting for room for both the padding and the record could wait forever if the record is larger than
+		// the part of the ring before the padding, so the padding is staged on its own.
+		if (!hasFreeBytes(BYTES - offset)) {
+			return false;
+		}
+		new (&buffer[offset]) MessageRecord(paddingSize, TYPES());
+		producer.stagedWriteIndex += BYTES - offset;
+	}
+	return hasFreeBytes(inRecordSize);
+}
+
+template<uint32_t BYTES, uint32_t CHANNELS, typename TYPES, typename TRAITS>
+inline bool LWRecordQueue<BYTES, CHANNELS, TYPES, TRAITS>::ThreadChannel::hasFreeBytes(
+	const uint32_t inNumBytes) noexcept
+{
+	if (producer.stagedWriteIndex - producer.cachedReadIndex + inNumBytes > BYTES) {
+		producer.cachedReadIndex = consumer.readIndex.load(std::memory_order_acquire);
+	}
+	return (producer.stagedWriteIndex - producer.cachedReadIndex + inNumBytes <= BYTES);
+}
+
+template<uint32_t BYTES, uint32_t CHANNELS, typename TYPES, typename TRAITS>
+inline uint32_t LWRecordQueue<BYTES, CHANNELS, TYPES, TRAITS>::ThreadChannel::getNumFreeBytes() const noexcept {
+	return BYTES - (producer.stagedWriteIndex - consumer.readIndex.load(std::memory_order_acquire));
+}
+
+template<uint32_t BYTES, uint32_t CHANNELS, typename TYPES, typename TRAITS>
+inline uint8_t* LWRecordQueue<BYTES, CHANNELS, TYPES, TRAITS>::ThreadChannel::stageBack(
+	const uint32_t inMessageSize,
+	const TYPES inType) noexcept
+{
+	const uint32_t size = sizeof(MessageRecord) + ((inMessageSize + recordAlignment - 1) & ~(recordAlignment - 1));
+	const uint32_t offset = producer.stagedWriteIndex & bytesMinusOne;
+	assert(size <= BYTES - offset);
+	assert(producer.stagedWriteIndex - producer.cachedReadIndex + size <= BYTES);
+
+	new (&buffer[offset]) MessageRecord(inMessageSize, inType);
+	producer.stagedWriteIndex += size;
+	return &buffer[offset + sizeof(MessageRecord)];
+}
+
+template<uint32_t BYTES, uint32_t CHANNELS, typename TYPES, typename TRAITS>
+inline bool LWRecordQueue<BYTES, CHANNELS, TYPES, TRAITS>::ThreadChannel::commit() noexcept {
+	if (producer.writeIndex.load(std::memory_order_relaxed) == producer.stagedWriteIndex) {
+		return false;
+	}
+	producer.writeIndex.store(producer.stagedWriteIndex, std::memory_order_release);
+	return true;
+}
+
+template<uint32_t BYTES, uint32_t CHANNELS, typename TYPES, typename TRAITS>
+inline const typename LWRecordQueue<BYTES, CHANNELS, TYPES, TRAITS>::MessageRecord*
+LWRecordQueue<BYTES, CHANNELS, TYPES, TRAITS>::ThreadChannel::front(uint32_t& ioReadIndex) noexcept {
+	while (true) {
+		if (ioReadIndex == consumer.cachedWriteIndex) {
+			consumer.cachedWriteIndex = producer.writeIndex.load(std::memory_order_acquire);
+			if (ioReadIndex == consumer.cachedWriteIndex) {
+				return nullptr;
+			}
+		}
+
+		const uint32_t offset = ioReadIndex & bytesMinusOne;
+		const MessageRecord* record = reinterpret_cast<const MessageRecord*>(&buffer[offset]);
+		if (!record->isPadding()) {
+			return record;
+		}
+		ioReadIndex += BYTES - offset;
+	}
+}
+
+template<uint32_t BYTES, uint32_t CHANNELS, typename TYPES, typename TRAITS>
+inline const typename LWRecordQueue<BYTES, CHANNELS, TYPES, TRAITS>::MessageRecord*
+LWRecordQueue<BYTES, CHANNELS, TYPES, TRAITS>::ThreadChannel::firstRecord() noexcept {
+	uint32_t readIndex = getReadIndex();
+	const MessageRecord* record = front(readIndex);
+	publishReadIndex(readIndex);
+	return record;
+}
+
+template<uint32_t BYTES, uint32_t CHANNELS, typename TYPES, typename TRAITS>
+inline void LWRecordQueue<BYTES, CHANNELS, TYPES, TRAITS>::ThreadChannel::publishReadIndex(
+	const uint32_t inReadIndex) noexcept
+{
+	if (consumer.readIndex.load(std::memory_order_relaxed) != inReadIndex) {
+		consumer.readIndex.store(inReadIndex, std::memory_order_release);
+	}
+}
+
+template<uint32_t BYTES, uint32_t CHANNELS, typename TYPES, typename TRAITS>
+inline uint32_t LWRecordQueue<BYTES, CHANNELS, TYPES, TRAITS>::ThreadChannel::getReadIndex() const noexcept {
+	return consumer.readIndex.load(std::memory_order_relaxed);
+}
+
+template<uint32_t BYTES, uint32_t CHANNELS, typename TYPES, typename TRAITS>
+inline uint32_t LWRecordQueue<BYTES, CHANNELS, TYPES, TRAITS>::ThreadChannel::nextRecord(
+	const uint32_t inReadIndex,
+	const MessageRecord& inRecord) const noexcept
+{
+	return inReadIndex + sizeof(MessageRecord) +
+		((inRecord.messageSize + recordAlignment - 1) & ~(recordAlignment - 1));
+}
+
+} // namespace LWMessageQueue
@@ -0,0 +1,306 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 Marcus Spangenberg
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#pragma once
+
+#if !defined(__linux__)
+#error "LWSharedMemoryQueue requires Linux (shm_open/memfd_create)."
+#endif
+
+#include "LWMessageQueue.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace LWMessageQueue {
+
+/**
+	@brief
+		A static size LWMessageQueue placed in a shared memory segment, so that input threads in other processes
+		can push messages to it.
+
+	@details
+		The process owning the output thread creates the segment, either named with shm_open() or anonymous with
+		memfd_create(), and constructs the queue in it. Producer processes attach to the segment by name, or by a
+		file descriptor inherited through fork() or passed over a Unix socket, and push through getQueue() as
+		within one process. Pushing and popping make no system calls.
+
+		A static size queue holds no pointers, only indices into the rings inside it, so every process may map the
+		segment at a different address. The segment starts with a header recording a magic number, a version and
+		a fingerprint of the queue layout, and attaching fails unless all of them match, so that processes built
+		with a different queue type or TRAITS are refused instead of corrupting the queue.
+
+		Every channel must still have a single input thread, across all processes, and MESSAGE must be plain
+		data without pointers into the memory of one process. A channel acquired with acquireInput() or
+		pushMessage() by a process that dies is not released. TRAITS::enableBlockingWait and TRAITS::enableEventFd
+		are not supported, since the consumer parks on a process private futex or eventfd.
+
+		Template parameters are those of LWMessageQueue, except that SIZE and CHANNELS may not be dynamicExtent.
+*/
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES = typename Internal::MessageList<MESSAGE>::Tag,
+	typename TRAITS = DefaultTraits>
+class LWSharedMemoryQueue {
+public:
+	using MessageQueue = LWMessageQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>;
+
+	/** Incremented whenever the header or the layout of LWMessageQueue changes incompatibly. */
+	static constexpr uint32_t version = 1;
+
+	LWSharedMemoryQueue() noexcept = default;
+	~LWSharedMemoryQueue();
+
+	LWSharedMemoryQueue(const LWSharedMemoryQueue&) = delete;
+	LWSharedMemoryQueue& operator=(const LWSharedMemoryQueue&) = delete;
+	LWSharedMemoryQueue(const LWSharedMemoryQueue&&) = delete;
+	LWSharedMemoryQueue& operator=(const LWSharedMemoryQueue&&) = delete;
+
+	/** Create the shared memory segment inName, as for shm_open(), and construct an empty queue in it. Fails if
+		the segment exists. The segment is removed when the creator detaches, while processes still attached keep
+		their mapping.
+		@return False on failure, with errno set.
+	*/
+	bool create(const char* inName) noexcept;
+
+	/** Create an anonymous segment with memfd_create(), and construct an empty queue in it. Producer processes
+		attach with the descriptor of getFileDescriptor(), inherited through fork() or passed over a Unix socket.
+		@return False on failure, with errno set.
+	*/
+	bool createAnonymous() noexcept;
+
+	/** Attach to the queue of the shared memory segment inName.
+		@return False if the segment does not exist, is not fully created, or has a different version or
+			layout. errno is EPROTO in the last two cases.
+	*/
+	bool attach(const char* inName) noexcept;
+
+	/** Attach to the queue of the segment open as inFileDescriptor. The descriptor is duplicated, so the caller
+		keeps ownership of inFileDescriptor.
+		@return As attach(const char*).
+	*/
+	bool attach(const int inFileDescriptor) noexcept;
+
+	/** Unmap the segment. The creator also destroys the queue and removes the segment name, but the memory
+		stays valid for processes still attached. Called by the destructor.
+	*/
+	void detach() noexcept;
+
+	/** The queue in the segment, or nullptr when not created or attached. */
+	inline MessageQueue* getQueue() noexcept { return messageQueue; }
+
+	/** Descriptor of the segment, or -1 when not created or attached. */
+	inline int getFileDescriptor() const noexcept { return fileDescriptor; }
+
+	/** Fingerprint of the layout of MessageQueue, compared when attaching. See LWMessageQueue::layoutFingerprint(). */
+	static constexpr uint64_t layoutFingerprint() noexcept;
+
+private:
+	/** First bytes of the segment. Written by the creator before state is set to stateReady. */
+	struct Header {
+		uint64_t magic;
+		uint32_t version;
+		uint32_t queueOffset;
+		uint64_t segmentSize;
+		uint64_t layoutFingerprint;
+		std::atomic<uint32_t> state;
+	};
+
+	static constexpr uint64_t headerMagic = 0x4d4853514d574cull; // "LWMQSHM"
+	static constexpr uint32_t stateReady = 1;
+	static constexpr uint32_t stateClosed = 2;
+
+	static constexpr size_t alignment = std::max<size_t>(alignof(MessageQueue), TRAITS::cacheLineSize);
+	static constexpr size_t queueOffset = (sizeof(Header) + alignment - 1) & ~(alignment - 1);
+	static constexpr size_t segmentSize = queueOffset + sizeof(MessageQueue);
+
+	static_assert(MessageQueue::ChannelLayout::elementsSize != 0, "Runtime sized queues hold pointers to their "
+		"rings, and can not be shared between processes.");
+	static_assert(!TRAITS::enableBlockingWait, "The blocking wait parks on a process private futex.");
+	static_assert(!TRAITS::enableEventFd, "The eventfd is created by and private to one process.");
+	static_assert(std::atomic<uint32_t>::is_always_lock_free, "Shared atomics must be lock free.");
+	static_assert(std::is_trivially_copyable<MESSAGE>::value, "Shared messages must be plain data.");
+
+	bool createQueue(const int inFileDescriptor) noexcept;
+	bool attachQueue(const int inFileDescriptor) noexcept;
+
+	void* segment = nullptr;
+	MessageQueue* messageQueue = nullptr;
+	int fileDescriptor = -1;
+	bool isCreator = false;
+	std::string name;
+};
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+LWSharedMemoryQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::~LWSharedMemoryQueue() {
+	detach();
+}
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+bool LWSharedMemoryQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::create(const char* inName) noexcept {
+	assert(segment == nullptr);
+
+	const int newFileDescriptor = shm_open(inName, O_RDWR | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR);
+	if (newFileDescriptor < 0) {
+		return false;
+	}
+	if (!createQueue(newFileDescriptor)) {
+		shm_unlink(inName);
+		return false;
+	}
+	name = inName;
+	return true;
+}
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+bool LWSharedMemoryQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::createAnonymous() noexcept {
+	assert(segment == nullptr);
+
+	const int newFileDescriptor = memfd_create("LWMessageQueue", MFD_CLOEXEC);
+	if (newFileDescriptor < 0) {
+		return false;
+	}
+	return createQueue(newFileDescriptor);
+}
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+bool LWSharedMemoryQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::attach(const char* inName) noexcept {
+	assert(segment == nullptr);
+
+	const int newFileDescriptor = shm_open(inName, O_RDWR, 0);
+	if (newFileDescriptor < 0) {
+		return false;
+	}
+	return attachQueue(newFileDescriptor);
+}
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+bool LWSharedMemoryQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::attach(const int inFileDescriptor) noexcept {
+	assert(segment == nullptr);
+
+	const int newFileDescriptor = fcntl(inFileDescriptor, F_DUPFD_CLOEXEC, 0);
+	if (newFileDescriptor < 0) {
+		return false;
+	}
+	return attachQueue(newFileDescriptor);
+}
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+void LWSharedMemoryQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::detach() noexcept {
+	if (segment == nullptr) {
+		return;
+	}
+
+	if (isCreator) {
+		// Late attachers are refused, while processes already attached may keep pushing to the mapped memory.
+		static_cast<Header*>(segment)->state.store(stateClosed, std::memory_order_release);
+		messageQueue->~MessageQueue();
+		if (!name.empty()) {
+			shm_unlink(name.c_str());
+		}
+	}
+	munmap(segment, segmentSize);
+	close(fileDescriptor);
+
+	segment = nullptr;
+	messageQueue = nullptr;
+	fileDescriptor = -1;
+	isCreator = false;
+	name.clear();
+}
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+constexpr uint64_t LWSharedMemoryQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::layoutFingerprint() noexcept {
+	return MessageQueue::layoutFingerprint();
+}
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+bool LWSharedMemoryQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::createQueue(const int inFileDescriptor) noexcept {
+	void* newSegment = MAP_FAILED;
+	if (ftruncate(inFileDescriptor, segmentSize) == 0) {
+		newSegment = mmap(nullptr, segmentSize, PROT_READ | PROT_WRITE, MAP_SHARED, inFileDescriptor, 0);
+	}
+	if (newSegment == MAP_FAILED) {
+		close(inFileDescriptor);
+		return false;
+	}
+
+	// The new segment is zero filled, so attachers see state zero until the queue is constructed.
+	Header* header = new (newSegment) Header();
+	header->magic = headerMagic;
+	header->version = version;
+	header->queueOffset = queueOffset;
+	header->segmentSize = segmentSize;
+	header->layoutFingerprint = layoutFingerprint();
+	messageQueue = new (static_cast<uint8_t*>(newSegment) + queueOffset) MessageQueue();
+	header->state.store(stateReady, std::memory_order_release);
+
+	segment = newSegment;
+	fileDescriptor = inFileDescriptor;
+	isCreator = true;
+	return true;
+}
+
+template<uint32_t SIZE, uint32_t CHANNELS, typename MESSAGE, typename TYPES, typename TRAITS>
+bool LWSharedMemoryQueue<SIZE, CHANNELS, MESSAGE, TYPES, TRAITS>::attachQueue(const int inFileDescriptor) noexcept {
+	// Check the size before mapping, so that a segment of another queue type is never touched beyond its end.
+	struct stat status;
+	if (fstat(inFileDescriptor, &status) != 0) {
+		close(inFileDescriptor);
+		return false;
+	}
+	if (static_cast<uint64_t>(status.st_size) != segmentSize) {
+		close(inFileDescriptor);
+		errno = EPROTO;
+		return false;
+	}
+
+	void* newSegment = mmap(nullptr, segmentSize, PROT_READ | PROT_WRITE, MAP_SHARED, inFileDescriptor, 0);
+	if (newSegment == MAP_FAILED) {
+		close(inFileDescriptor);
+		return false;
+	}
+
+	const Header* header = static_cast<const Header*>(newSegment);
+	if (header->state.load(std::memory_order_acquire) != stateReady || header->magic != headerMagic ||
+		header->version != version || header->queueOffset != queueOffset || header->segmentSize != segmentSize ||
+		header->layoutFingerprint != layoutFingerprint())
+	{
+		munmap(newSegment, segmentSize);
+		close(inFileDescriptor);
+		errno = EPROTO;
+		return false;
+	}
+
+	segment = newSegment;
+	messageQueue = reinterpret_cast<MessageQueue*>(static_cast<uint8_t*>(newSegment) + queueOffset);
+	fileDescriptor = inFileDescriptor;
+	isCreator = false;
+	return true;
+}
+
+} // namespace LWMessageQueue
@@ -1,46 +1,2521 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <exception>
 #include <iostream>
 #include <memory>
 #include <sstream>
 #include <string>
+#include <system_error>
 #include <stdint.h>
+#include <time.h>
 #include <thread>
+#include <type_traits>
+#include <utility>
 #include <vector>
+#include "LWBroadcastQueue.h"
+#include "LWConflatingQueue.h"
 #include "LWMessageQueue.h"
+#include "LWRecordQueue.h"
 #include "TestUtils.h"
 
+#if defined(__linux__)
+#include <errno.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include "LWMessageRecorder.h"
+#include "LWSharedMemoryQueue.h"
+#endif
+
 using namespace TestUtils;
 
-namespace {
+namespace {
+
+struct Message1 {
+	uint32_t value;
+};
+
+struct Message2 {
+	char charValue;
+	uint32_t uintValue;
+};
+
+struct Message3 {
+	char* stringRef;
+	uint32_t uintValue;
+	double doubleValue;
+};
+
+union MessageUnion {
+	Message1 message1;
+	Message2 message2;
+	Message3 message3;
+};
+
+enum class MessageType {
+	Message1,
+	Message2,
+	Message3
+};
+
+template<uint32_t BYTES>
+struct SizedMessage {
+	uint8_t data[BYTES];
+};
+
+template<uint32_t BYTES>
+union SizedMessageUnion {
+	SizedMessage<BYTES> message;
+};
+
+} // namespace
+
+void popMessagesTest() {
+	TEST_ENTER;
+
+	using MessageQueue = LWMessageQueue::LWMessageQueue<4, 1, MessageUnion, MessageType>;
+	std::unique_ptr<MessageQueue> messageQueue(new MessageQueue());
+
+	MessageQueue::ThreadChannelOutput channelOutput = messageQueue->getThreadChannelOutput(0);
+	MessageQueue::ThreadChannelInput channelInput = messageQueue->getThreadChannelInput(0);
+
+	MessageQueue::MessageContainer messageContainers[4];
+	TEST_VERIFY(channelOutput.popMessages(messageContainers, 4) == 0);
+
+	// Move the read position so that the next batch wraps around the end of the ring.
+	Message1 message;
+	for (uint32_t i = 0; i < 3; ++i) {
+		message.value = i;
+		channelInput.pushMessage(message, MessageType::Message1);
+	}
+	TEST_VERIFY(channelOutput.popMessages(messageContainers, 4) == 3);
+	TEST_VERIFY(messageContainers[2].getMessage<Message1>().value == 2);
+
+	for (uint32_t i = 0; i < 4; ++i) {
+		message.value = 10 + i;
+		channelInput.pushMessage(message, MessageType::Message1);
+	}
+	TEST_VERIFY(channelOutput.popMessages(messageContainers, 3) == 3);
+	TEST_VERIFY(channelOutput.getNumMessages() == 1);
+	TEST_VERIFY(channelOutput.popMessages(&messageContainers[3], 3) == 1);
+	for (uint32_t i = 0; i < 4; ++i) {
+		TEST_VERIFY(messageContainers[i].getType() == MessageType::Message1);
+		TEST_VERIFY(messageContainers[i].getMessage<Message1>().value == 10 + i);
+	}
+	TEST_VERIFY(!channelInput.isFull());
+}
+
+void drainTest() {
+	TEST_ENTER;
+
+	using MessageQueue = LWMessageQueue::LWMessageQueue<4, 1, MessageUnion, MessageType>;
+	std::unique_ptr<MessageQueue> messageQueue(new MessageQueue());
+
+	MessageQueue::ThreadChannelOutput channelOutput = messageQueue->getThreadChannelOutput(0);
+	MessageQueue::ThreadChannelInput channelInput = messageQueue->getThreadChannelInput(0);
+
+	uint32_t expectedValue = 0;
+	auto verifyNext = [&expectedValue](const MessageQueue::MessageContainer& inMessageContainer) {
+		TEST_VERIFY(inMessageContainer.getType() == MessageType::Message1);
+		TEST_VERIFY(inMessageContainer.getMessage<Message1>().value == expectedValue);
+		++expectedValue;
+	};
+
+	Message1 message;
+	uint32_t nextValue = 0;
+	for (uint32_t round = 0; round < 5; ++round) {
+		for (uint32_t i = 0; i < 3; ++i) {
+			message.value = nextValue++;
+			channelInput.pushMessage(message, MessageType::Message1);
+		}
+		TEST_VERIFY(channelOutput.drain(verifyNext, 2) == 2);
+		TEST_VERIFY(channelOutput.drain(verifyNext, 2) == 1);
+		TEST_VERIFY(channelOutput.drain(verifyNext, 2) == 0);
+	}
+	TEST_VERIFY(expectedValue == nextValue);
+}
+
+void stageMessageTest() {
+	TEST_ENTER;
+
+	using MessageQueue = LWMessageQueue::LWMessageQueue<4, 1, MessageUnion, MessageType>;
+	std::unique_ptr<MessageQueue> messageQueue(new MessageQueue());
+
+	MessageQueue::ThreadChannelOutput channelOutput = messageQueue->getThreadChannelOutput(0);
+	MessageQueue::ThreadChannelInput channelInput = messageQueue->getThreadChannelInput(0);
+
+	Message1 message;
+	message.value = 0;
+	TEST_VERIFY(channelInput.stageMessage(message, MessageType::Message1));
+	message.value = 1;
+	TEST_VERIFY(channelInput.stageMessage(message, MessageType::Message1));
+	TEST_VERIFY(channelOutput.getNumMessages() == 0);
+
+	channelInput.commit();
+	TEST_VERIFY(channelOutput.getNumMessages() == 2);
+
+	// Staging into a full channel fails and publishes what was staged.
+	message.value = 2;
+	TEST_VERIFY(channelInput.stageMessage(message, MessageType::Message1));
+	message.value = 3;
+	TEST_VERIFY(channelInput.stageMessage(message, MessageType::Message1));
+	TEST_VERIFY(channelInput.isFull());
+	TEST_VERIFY(!channelInput.stageMessage(message, MessageType::Message1));
+	TEST_VERIFY(channelOutput.getNumMessages() == 4);
+
+	uint32_t expectedValue = 0;
+	auto verifyNext = [&expectedValue](const MessageQueue::MessageContainer& inMessageContainer) {
+		TEST_VERIFY(inMessageContainer.getMessage<Message1>().value == expectedValue);
+		++expectedValue;
+	};
+	TEST_VERIFY(channelOutput.drain(verifyNext, 4) == 4);
+
+	// Batches wrapping around the end of the ring are committed on scope exit.
+	{
+		MessageQueue::PushBatch pushBatch(channelInput);
+		for (uint32_t i = 0; i < 3; ++i) {
+			message.value = 4 + i;
+			TEST_VERIFY(pushBatch.stageMessage(message, MessageType::Message1));
+		}
+		TEST_VERIFY(channelOutput.getNumMessages() == 0);
+	}
+	TEST_VERIFY(channelOutput.getNumMessages() == 3);
+	TEST_VERIFY(channelOutput.drain(verifyNext, 4) == 3);
+	TEST_VERIFY(expectedValue == 7);
+}
+
+void reserveMessageTest() {
+	TEST_ENTER;
+
+	using MessageQueue = LWMessageQueue::LWMessageQueue<2, 1, MessageUnion, MessageType>;
+	std::unique_ptr<MessageQueue> messageQueue(new MessageQueue());
+
+	MessageQueue::ThreadChannelOutput channelOutput = messageQueue->getThreadChannelOutput(0);
+	MessageQueue::ThreadChannelInput channelInput = messageQueue->getThreadChannelInput(0);
+
+	char text[] = "text";
+	Message3& message = channelInput.reserve<Message3>(MessageType::Message3);
+	message.stringRef = text;
+	message.uintValue = 7;
+	message.doubleValue = 0.5;
+	TEST_VERIFY(channelOutput.getNumMessages() == 0);
+	channelInput.publish();
+	TEST_VERIFY(channelOutput.getNumMessages() == 1);
+
+	channelInput.emplace<Message2>(MessageType::Message2, 'a', 11u);
+	TEST_VERIFY(channelInput.isFull());
+
+	MessageQueue::MessageContainer messageContainer = channelOutput.popMessage();
+	TEST_VERIFY(messageContainer.getType() == MessageType::Message3);
+	TEST_VERIFY(messageContainer.getMessage<Message3>().stringRef == text);
+	TEST_VERIFY(messageContainer.getMessage<Message3>().uintValue == 7);
+	TEST_VERIFY(messageContainer.getMessage<Message3>().doubleValue == 0.5);
+
+	messageContainer = channelOutput.popMessage();
+	TEST_VERIFY(messageContainer.getType() == MessageType::Message2);
+	TEST_VERIFY(messageContainer.getMessage<Message2>().charValue == 'a');
+	TEST_VERIFY(messageContainer.getMessage<Message2>().uintValue == 11);
+}
+
+void peekMessageTest() {
+	TEST_ENTER;
+
+	using MessageQueue = LWMessageQueue::LWMessageQueue<4, 1, MessageUnion, MessageType>;
+	std::unique_ptr<MessageQueue> messageQueue(new MessageQueue());
+
+	MessageQueue::ThreadChannelOutput channelOutput = messageQueue->getThreadChannelOutput(0);
+	MessageQueue::ThreadChannelInput channelInput = messageQueue->getThreadChannelInput(0);
+
+	TEST_VERIFY(channelOutput.getReadableMessages().empty());
+
+	Message1 message;
+	for (uint32_t i = 0; i < 3; ++i) {
+		message.value = i;
+		channelInput.pushMessage(message, MessageType::Message1);
+	}
+
+	TEST_VERIFY(channelOutput.getNumMessages() == 3);
+	TEST_VERIFY(channelOutput.peek().getMessage<Message1>().value == 0);
+	TEST_VERIFY(channelOutput.getNumMessages() == 3);
+	channelOutput.release(1);
+	TEST_VERIFY(channelOutput.peek().getMessage<Message1>().value == 1);
+	channelOutput.release(1);
+
+	// Wrap around the end of the ring, and check that the view does not include messages pushed after it was taken.
+	for (uint32_t i = 3; i < 5; ++i) {
+		message.value = i;
+		channelInput.pushMessage(message, MessageType::Message1);
+	}
+	MessageQueue::MessageRange messageRange = channelOutput.getReadableMessages();
+	TEST_VERIFY(messageRange.size() == 3);
+	message.value = 5;
+	channelInput.pushMessage(message, MessageType::Message1);
+	TEST_VERIFY(channelInput.isFull());
+	TEST_VERIFY(messageRange.size() == 3);
+
+	uint32_t expectedValue = 2;
+	for (const MessageQueue::MessageContainer& messageContainer : messageRange) {
+		TEST_VERIFY(messageContainer.getMessage<Message1>().value == expectedValue);
+		++expectedValue;
+	}
+	TEST_VERIFY(expectedValue == 5);
+	TEST_VERIFY(messageRange[2].getMessage<Message1>().value == 4);
+
+	channelOutput.release(messageRange.size());
+	TEST_VERIFY(channelOutput.getNumMessages() == 1);
+	TEST_VERIFY(!channelInput.isFull());
+	TEST_VERIFY(channelOutput.peek().getMessage<Message1>().value == 5);
+}
+
+namespace ReadyChannelTest {
+
+struct ReadyBitmapTraits : LWMessageQueue::DefaultTraits {
+	static constexpr bool enableReadyBitmap = true;
+};
+
+void readyChannelTest() {
+	TEST_ENTER;
+
+	using MessageQueue = LWMessageQueue::LWMessageQueue<4, 130, MessageUnion, MessageType, ReadyBitmapTraits>;
+	std::unique_ptr<MessageQueue> messageQueue(new MessageQueue());
+
+	uint32_t readyChannel = 0;
+	TEST_VERIFY(!messageQueue->nextReadyChannel(readyChannel));
+	TEST_VERIFY(messageQueue->forEachReadyChannel([](uint32_t) {}) == 0);
+
+	Message1 message;
+	message.value = 0;
+	messageQueue->getThreadChannelInput(129).pushMessage(message, MessageType::Message1);
+	messageQueue->getThreadChannelInput(3).pushMessage(message, MessageType::Message1);
+	messageQueue->getThreadChannelInput(3).pushMessage(message, MessageType::Message1);
+	messageQueue->getThreadChannelInput(64).pushMessage(message, MessageType::Message1);
+
+	// Drain channel 3 only partially, it must be visited again.
+	std::vector<uint32_t> visitedChannels;
+	TEST_VERIFY(messageQueue->forEachReadyChannel([&](const uint32_t inChannel) {
+		visitedChannels.push_back(inChannel);
+		messageQueue->getThreadChannelOutput(inChannel).drain([](const MessageQueue::MessageContainer&) {}, 1);
+	}) == 3);
+	TEST_VERIFY(visitedChannels == std::vector<uint32_t>({3, 64, 129}));
+
+	TEST_VERIFY(messageQueue->nextReadyChannel(readyChannel));
+	TEST_VERIFY(readyChannel == 3);
+	TEST_VERIFY(messageQueue->getThreadChannelOutput(3).popMessages(nullptr, 0) == 0);
+
+	// Channel 3 still has a message, so it is made ready again by the next call.
+	messageQueue->getThreadChannelInput(5).pushMessage(message, MessageType::Message1);
+	TEST_VERIFY(messageQueue->nextReadyChannel(readyChannel));
+	TEST_VERIFY(readyChannel == 5);
+	messageQueue->getThreadChannelOutput(5).release(messageQueue->getThreadChannelOutput(5).getNumMessages());
+	TEST_VERIFY(messageQueue->nextReadyChannel(readyChannel));
+	TEST_VERIFY(readyChannel == 3);
+	messageQueue->getThreadChannelOutput(3).release(messageQueue->getThreadChannelOutput(3).getNumMessages());
+	TEST_VERIFY(!messageQueue->nextReadyChannel(readyChannel));
+}
+
+const uint32_t numInputThreads = 70;
+const uint32_t numMessages = 20000;
+using MessageQueue = LWMessageQueue::LWMessageQueue<256, numInputThreads, MessageUnion, MessageType, ReadyBitmapTraits>;
+
+void inputThreadEntry(MessageQueue::ThreadChannelInput inThreadChannelInput, const uint32_t inChannelIndex) {
+	Message2 message;
+	message.charValue = static_cast<char>(inChannelIndex);
+	for (uint32_t i = 0; i < numMessages; ++i) {
+		while (inThreadChannelInput.isFull()) {
+			std::this_thread::yield();
+		}
+		message.uintValue = i;
+		inThreadChannelInput.pushMessage(message, MessageType::Message2);
+	}
+}
+
+void outputThreadEntry(MessageQueue* inMessageQueue) {
+	try {
+		std::vector<uint32_t> nextValues(numInputThreads, 0);
+		uint32_t receivedMessages = 0;
+		while (receivedMessages < numMessages * numInputThreads) {
+			inMessageQueue->forEachReadyChannel([&](const uint32_t inChannel) {
+				receivedMessages += inMessageQueue->getThreadChannelOutput(inChannel).drain([&](const MessageQueue::MessageContainer& inMessageContainer) {
+					const Message2& message = inMessageContainer.getMessage<Message2>();
+					TEST_VERIFY(message.charValue == static_cast<char>(inChannel));
+					TEST_VERIFY(message.uintValue == nextValues[inChannel]);
+					++nextValues[inChannel];
+				}, 256);
+			});
+			std::this_thread::yield();
+		}
+		std::cout << "   Output thread received " << receivedMessages << " messages" << std::endl;
+	} catch (const TestFailure& exception) {
+		std::cout << "Test failed: " << exception.getInfo() << std::endl;
+	}
+}
+
+void multiThreadReadyChannelTest() {
+	TEST_ENTER;
+
+	std::unique_ptr<MessageQueue> messageQueue(new MessageQueue());
+
+	std::vector<std::unique_ptr<std::thread>> inputThreads;
+	for (uint32_t channelIndex = 0; channelIndex < numInputThreads; ++channelIndex) {
+		inputThreads.emplace_back(new std::thread(inputThreadEntry, messageQueue->getThreadChannelInput(channelIndex), channelIndex));
+	}
+	std::thread outputThread(outputThreadEntry, messageQueue.get());
+
+	for (auto& inputThread : inputThreads) {
+		inputThread->join();
+	}
+	outputThread.join();
+}
+
+} // namespace ReadyChannelTest
+
+namespace BlockingWaitTest {
+
+struct BlockingWaitTraits : LWMessageQueue::DefaultTraits {
+	static constexpr bool enableBlockingWait = true;
+};
+
+struct BlockingWaitReadyBitmapTraits : LWMessageQueue::DefaultTraits {
+	static constexpr bool enableBlockingWait = true;
+	static constexpr bool enableReadyBitmap = true;
+};
+
+int64_t getThreadCpuTimeNs() {
+#if defined(__linux__)
+	struct timespec timeSpec;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &timeSpec);
+	return static_cast<int64_t>(timeSpec.tv_sec) * 1000000000 + timeSpec.tv_nsec;
+#else
+	return 0;
+#endif
+}
+
+int64_t getSteadyTimeNs() {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+template<typename TRAITS>
+void idleWaitTest() {
+	using MessageQueue = LWMessageQueue::LWMessageQueue<16, 4, MessageUnion, MessageType, TRAITS>;
+	std::unique_ptr<MessageQueue> messageQueue(new MessageQueue());
+
+	// Nothing is pushed, so the consumer should sleep through almost all of the wait.
+	const int64_t startCpuTime = getThreadCpuTimeNs();
+	const int64_t startTime = getSteadyTimeNs();
+	TEST_VERIFY(!messageQueue->waitForMessages(std::chrono::milliseconds(300)));
+	const int64_t waitTime = getSteadyTimeNs() - startTime;
+	const int64_t cpuTime = getThreadCpuTimeNs() - startCpuTime;
+
+	std::cout << "   Idle wait " << waitTime / 1000000 << " ms, consumer cpu " << cpuTime / 1000 << " us" << std::endl;
+	TEST_VERIFY(waitTime >= 300000000);
+	TEST_VERIFY(cpuTime < waitTime / 10);
+}
+
+template<typename TRAITS>
+void wakeUpTest() {
+	using MessageQueue = LWMessageQueue::LWMessageQueue<16, 4, MessageUnion, MessageType, TRAITS>;
+	std::unique_ptr<MessageQueue> messageQueue(new MessageQueue());
+
+	const uint32_t numWakeUps = 20;
+	std::atomic<int64_t> pushTime(0);
+	std::thread inputThread([&messageQueue, &pushTime]() {
+		typename MessageQueue::ThreadChannelInput channelInput = messageQueue->getThreadChannelInput(2);
+		Message1 message;
+		for (uint32_t i = 0; i < numWakeUps; ++i) {
+			// Give the consumer time to park before pushing.
+			std::this_thread::sleep_for(std::chrono::milliseconds(5));
+			while (channelInput.isFull()) {
+				std::this_thread::yield();
+			}
+			message.value = i;
+			pushTime.store(getSteadyTimeNs());
+			channelInput.pushMessage(message, MessageType::Message1);
+		}
+	});
+
+	typename MessageQueue::ThreadChannelOutput channelOutput = messageQueue->getThreadChannelOutput(2);
+	std::vector<int64_t> latencies;
+	uint32_t receivedMessages = 0;
+	while (receivedMessages < numWakeUps) {
+		TEST_VERIFY(messageQueue->waitForMessages(std::chrono::seconds(10)));
+		const int64_t wakeTime = getSteadyTimeNs();
+		latencies.push_back(wakeTime - pushTime.load());
+
+		if constexpr (TRAITS::enableReadyBitmap) {
+			uint32_t readyChannel = 0;
+			while (messageQueue->nextReadyChannel(readyChannel)) {
+				TEST_VERIFY(readyChannel == 2);
+				receivedMessages += channelOutput.drain([](const typename MessageQueue::MessageContainer&) {}, 16);
+			}
+		} else {
+			receivedMessages += channelOutput.drain([](const typename MessageQueue::MessageContainer&) {}, 16);
+		}
+	}
+	inputThread.join();
+
+	std::sort(latencies.begin(), latencies.end());
+	std::cout << "   Wake-up latency median " << latencies[latencies.size() / 2] / 1000 << " us, max " 
+		<< latencies.back() / 1000 << " us" << std::endl;
+	TEST_VERIFY(latencies.back() < 1000000000);
+}
+
+void blockingWaitTest() {
+	TEST_ENTER;
+
+	idleWaitTest<BlockingWaitTraits>();
+	wakeUpTest<BlockingWaitTraits>();
+	idleWaitTest<BlockingWaitReadyBitmapTraits>();
+	wakeUpTest<BlockingWaitReadyBitmapTraits>();
+}
+
+} // namespace BlockingWaitTest
+
+namespace OverflowPolicyTest {
+
+struct OverwriteOldestTraits : LWMessageQueue::DefaultTraits {
+	static constexpr LWMessageQueue::OverflowPolicy overflowPolicy = LWMessageQueue::OverflowPolicy::OverwriteOldest;
+};
+
+struct BlockTraits : LWMessageQueue::DefaultTraits {
+	static constexpr LWMessageQueue::OverflowPolicy overflowPolicy = LWMessageQueue::OverflowPolicy::Block;
+};
+
+void rejectTest() {
+	using MessageQueue = LWMessageQueue::LWMessageQueue<4, 1, MessageUnion, MessageType>;
+	std::unique_ptr<MessageQueue> messageQueue(new MessageQueue());
+
+	MessageQueue::ThreadChannelOutput channelOutput = messageQueue->getThreadChannelOutput(0);
+	MessageQueue::ThreadChannelInput channelInput = messageQueue->getThreadChannelInput(0);
+
+	Message1 message;
+	for (uint32_t i = 0; i < 4; ++i) {
+		message.value = i;
+		TEST_VERIFY(channelInput.tryPushMessage(message, MessageType::Message1));
+	}
+	TEST_VERIFY(!channelInput.tryPushMessage(message, MessageType::Message1));
+	TEST_VERIFY(channelOutput.getNumMessages() == 4);
+
+	TEST_VERIFY(channelOutput.popMessage().getMessage<Message1>().value == 0);
+	message.value = 4;
+	TEST_VERIFY(channelInput.tryPushMessage(message, MessageType::Message1));
+	TEST_VERIFY(channelOutput.getNumMessages() == 4);
+}
+
+void overwriteOldestTest() {
+	using MessageQueue = LWMessageQueue::LWMessageQueue<4, 1, MessageUnion, MessageType, OverwriteOldestTraits>;
+	std::unique_ptr<MessageQueue> messageQueue(new MessageQueue());
+
+	MessageQueue::ThreadChannelOutput channelOutput = messageQueue->getThreadChannelOutput(0);
+	MessageQueue::ThreadChannelInput channelInput = messageQueue->getThreadChannelInput(0);
+
+	Message1 message;
+	for (uint32_t i = 0; i < 6; ++i) {
+		message.value = i;
+		channelInput.pushMessage(message, MessageType::Message1);
+	}
+	TEST_VERIFY(channelOutput.getNumMessages() == 4);
+	TEST_VERIFY(channelOutput.popMessage().getMessage<Message1>().value == 2);
+
+	message.value = 6;
+	TEST_VERIFY(channelInput.tryPushMessage(message, MessageType::Message1));
+	message.value = 7;
+	TEST_VERIFY(channelInput.tryPushMessage(message, MessageType::Message1));
+
+	uint32_t expectedValue = 4;
+	TEST_VERIFY(channelOutput.drain([&expectedValue](const MessageQueue::MessageContainer& inMessageContainer) {
+		TEST_VERIFY(inMessageContainer.getMessage<Message1>().value == expectedValue);
+		++expectedValue;
+	}, 8) == 4);
+	TEST_VERIFY(channelOutput.getNumMessages() == 0);
+}
+
+void overwriteOldestMultiThreadTest() {
+	using MessageQueue = LWMessageQueue::LWMessageQueue<8, 1, MessageUnion, MessageType, OverwriteOldestTraits>;
+	std::unique_ptr<MessageQueue> messageQueue(new MessageQueue());
+
+	const uint32_t numMessages = 200000;
+	std::thread inputThread([&messageQueue]() {
+		MessageQueue::ThreadChannelInput channelInput = messageQueue->getThreadChannelInput(0);
+		Message2 message;
+		for (uint32_t i = 1; i <= numMessages; ++i) {
+			message.uintValue = i;
+			message.charValue = static_cast<char>(i);
+			channelInput.pushMessage(message, MessageType::Message2);
+			if ((i & 255) == 0) {
+				std::this_thread::yield();
+			}
+		}
+	});
+
+	// Messages may be lost, but must arrive whole and in order.
+	MessageQueue::ThreadChannelOutput channelOutput = messageQueue->getThreadChannelOutput(0);
+	uint32_t lastValue = 0;
+	uint32_t receivedMessages = 0;
+	while (lastValue < numMessages) {
+		MessageQueue::MessageContainer messageContainers[8];
+		const uint32_t numPopped = channelOutput.popMessages(messageContainers, 8);
+		for (uint32_t index = 0; index < numPopped; ++index) {
+			const Message2& message = messageContainers[index].getMessage<Message2>();
+			TEST_VERIFY(message.uintValue > lastValue);
+			TEST_VERIFY(message.charValue == static_cast<char>(message.uintValue));
+			lastValue = message.uintValue;
+		}
+		receivedMessages += numPopped;
+	}
+	inputThread.join();
+	std::cout << "   Lossy channel delivered " << receivedMessages << " of " << numMessages << " messages" << std::endl;
+}
+
+void blockTest() {
+	using MessageQueue = LWMessageQueue::LWMessageQueue<4, 1, MessageUnion, MessageType, BlockTraits>;
+	std::unique_ptr<MessageQueue> messageQueue(new MessageQueue());
+
+	MessageQueue::ThreadChannelOutput channelOutput = messageQueue->getThreadChannelOutput(0);
+	MessageQueue::ThreadChannelInput channelInput = messageQueue->getThreadChannelInput(0);
+
+	Message1 message;
+	message.value = 0;
+	for (uint32_t i = 0; i < 4; ++i) {
+		channelInput.pushMessage(message, MessageType::Message1);
+	}
+	TEST_VERIFY(!channelInput.tryPushMessage(message, MessageType::Message1));
+	TEST_VERIFY(channelOutput.getReadableMessages().size() == 4);
+	channelOutput.release(4);
+
+	const uint32_t numMessages = 20000;
+	std::thread inputThread([&channelInput]() {
+		Message1 message;
+		for (uint32_t i = 0; i < numMessages; ++i) {
+			message.value = i;
+			channelInput.pushMessage(message, MessageType::Message1);
+		}
+	});
+
+	uint32_t expectedValue = 0;
+	while (expectedValue < numMessages) {
+		const uint32_t numDrained = channelOutput.drain(
+			[&expectedValue](const MessageQueue::MessageContainer& inMessageContainer) {
+				TEST_VERIFY(inMessageContainer.getMessage<Message1>().value == expectedValue);
+				++expectedValue;
+			}, 4);
+		if (numDrained == 0) {
+			std::this_thread::yield();
+		}
+	}
+	inputThread.join();
+}
+
+void overflowPolicyTest() {
+	TEST_ENTER;
+
+	rejectTest();
+	overwriteOldestTest();
+	overwriteOldestMultiThreadTest();
+	blockTest();
+}
+
+} // namespace OverflowPolicyTest
+
+namespace RecordQueueTest {
+
+struct LargeMessage {
+	uint32_t sequence;
+	uint8_t payload[116];
+};
+
+struct HugeMessage {
+	uint32_t sequence;
+	uint8_t payload[188];
+};
+
+enum class RecordType {
+	Message1,
+	Message2,
+	Message3,
+	LargeMessage,
+	HugeMessage
+};
+
+struct BlockTraits : LWMessageQueue::DefaultTraits {
+	static constexpr LWMessageQueue::OverflowPolicy overflowPolicy = LWMessageQueue::OverflowPolicy::Block;
+};
+
+void recordTest() {
+	using RecordQueue = LWMessageQueue::LWRecordQueue<256, 1, RecordType>;
+	std::unique_ptr<RecordQueue> recordQueue(new RecordQueue());
+
+	static_assert(RecordQueue::recordSize<Message1>() == 16, "Small messages only take their own size.");
+	static_assert(RecordQueue::recordSize<LargeMessage>() == 128, "Large messages only take their own size.");
+
+	RecordQueue::ThreadChannelOutput channelOutput = recordQueue->getThreadChannelOutput(0);
+	RecordQueue::ThreadChannelInput channelInput = recordQueue->getThreadChannelInput(0);
+	TEST_VERIFY(channelOutput.isEmpty());
+
+	Message1 message1;
+	message1.value = 17;
+	channelInput.pushMessage(message1, RecordType::Message1);
+	LargeMessage& largeMessage = channelInput.reserve<LargeMessage>(RecordType::LargeMessage);
+	largeMessage.sequence = 18;
+	largeMessage.payload[115] = 19;
+	TEST_VERIFY(channelOutput.getNumMessages() == 1);
+	channelInput.publish();
+	channelInput.emplace<Message2>(RecordType::Message2, 'a', 20u);
+	TEST_VERIFY(channelOutput.getNumMessages() == 3);
+
+	TEST_VERIFY(channelOutput.peek().getType() == RecordType::Message1);
+	TEST_VERIFY(channelOutput.peek().getMessageSize() == sizeof(Message1));
+	TEST_VERIFY(channelOutput.peek().getMessage<Message1>().value == 17);
+	channelOutput.release(1);
+
+	const RecordQueue::MessageRecord& record = channelOutput.peek();
+	TEST_VERIFY(record.getType() == RecordType::LargeMessage);
+	TEST_VERIFY(record.getMessage<LargeMessage>().sequence == 18);
+	TEST_VERIFY(record.getMessage<LargeMessage>().payload[115] == 19);
+	channelOutput.release(1);
+
+	TEST_VERIFY(channelOutput.drain([](const RecordQueue::MessageRecord& inRecord) {
+		TEST_VERIFY(inRecord.getType() == RecordType::Message2);
+		TEST_VERIFY(inRecord.getMessage<Message2>().charValue == 'a');
+		TEST_VERIFY(inRecord.getMessage<Message2>().uintValue == 20);
+	}, 4) == 1);
+	TEST_VERIFY(channelOutput.isEmpty());
+}
+
+void paddingTest() {
+	using RecordQueue = LWMessageQueue::LWRecordQueue<256, 1, RecordType>;
+	std::unique_ptr<RecordQueue> recordQueue(new RecordQueue());
+
+	RecordQueue::ThreadChannelOutput channelOutput = recordQueue->getThreadChannelOutput(0);
+	RecordQueue::ThreadChannelInput channelInput = recordQueue->getThreadChannelInput(0);
+
+	// 160 bytes are used, so the second large message has to wrap to the start of the ring.
+	Message1 message1;
+	for (uint32_t i = 0; i < 10; ++i) {
+		message1.value = i;
+		channelInput.pushMessage(message1, RecordType::Message1);
+	}
+	TEST_VERIFY(channelOutput.drain([](const RecordQueue::MessageRecord&) {}, 2) == 2);
+
+	LargeMessage largeMessage;
+	largeMessage.sequence = 10;
+	TEST_VERIFY(!channelInput.hasRoomFor<LargeMessage>());
+	TEST_VERIFY(!channelInput.tryPushMessage(largeMessage, RecordType::LargeMessage));
+	TEST_VERIFY(channelOutput.getNumMessages() == 8);
+
+	TEST_VERIFY(channelOutput.drain([](const RecordQueue::MessageRecord&) {}, 7) == 7);
+	TEST_VERIFY(channelInput.tryPushMessage(largeMessage, RecordType::LargeMessage));
+	TEST_VERIFY(channelOutput.getNumMessages() == 2);
+	channelOutput.release(1);
+	TEST_VERIFY(channelOutput.peek().getMessage<LargeMessage>().sequence == 10);
+	channelOutput.release(1);
+	TEST_VERIFY(channelOutput.isEmpty());
+
+	// Move the write position to byte 80. A huge record does not fit in the 176 bytes before the end, nor in the 
+	// remaining 80 bytes after padding them, even with the ring empty. It fits once the padding has been consumed.
+	for (uint32_t i = 0; i < 13; ++i) {
+		channelInput.pushMessage(message1, RecordType::Message1);
+	}
+	TEST_VERIFY(channelOutput.drain([](const RecordQueue::MessageRecord&) {}, 13) == 13);
+	HugeMessage hugeMessage;
+	hugeMessage.sequence = 11;
+	TEST_VERIFY(!channelInput.hasRoomFor<HugeMessage>());
+	TEST_VERIFY(!channelInput.tryPushMessage(hugeMessage, RecordType::HugeMessage));
+	TEST_VERIFY(channelOutput.isEmpty());
+	TEST_VERIFY(channelInput.hasRoomFor<HugeMessage>());
+	TEST_VERIFY(channelInput.tryPushMessage(hugeMessage, RecordType::HugeMessage));
+	TEST_VERIFY(channelOutput.peek().getMessage<HugeMessage>().sequence == 11);
+}
+
+void multiThreadRecordTest() {
+	using RecordQueue = LWMessageQueue::LWRecordQueue<1024, 1, RecordType, BlockTraits>;
+	std::unique_ptr<RecordQueue> recordQueue(new RecordQueue());
+
+	const uint32_t numMessages = 200000;
+	RecordQueue::ThreadChannelInput channelInput = recordQueue->getThreadChannelInput(0);
+	std::thread inputThread([&channelInput]() {
+		for (uint32_t i = 0; i < numMessages; ++i) {
+			if (i % 7 == 0) {
+				LargeMessage message;
+				message.sequence = i;
+				message.payload[0] = static_cast<uint8_t>(i);
+				message.payload[115] = static_cast<uint8_t>(i);
+				channelInput.pushMessage(message, RecordType::LargeMessage);
+			} else {
+				Message1 message;
+				message.value = i;
+				channelInput.pushMessage(message, RecordType::Message1);
+			}
+		}
+	});
+
+	RecordQueue::ThreadChannelOutput channelOutput = recordQueue->getThreadChannelOutput(0);
+	uint32_t expectedValue = 0;
+	while (expectedValue < numMessages) {
+		const uint32_t numDrained = channelOutput.drain([&expectedValue](const RecordQueue::MessageRecord& inRecord) {
+			if (inRecord.getType() == RecordType::LargeMessage) {
+				const LargeMessage& message = inRecord.getMessage<LargeMessage>();
+				TEST_VERIFY(message.sequence == expectedValue);
+				TEST_VERIFY(message.payload[0] == static_cast<uint8_t>(expectedValue));
+				TEST_VERIFY(message.payload[115] == static_cast<uint8_t>(expectedValue));
+			} else {
+				TEST_VERIFY(inRecord.getType() == RecordType::Message1);
+				TEST_VERIFY(inRecord.getMessage<Message1>().value == expectedValue);
+			}
+			++expectedValue;
+		}, 64);
+		if (numDrained == 0) {
+			std::this_thread::yield();
+		}
+	}
+	inputThread.join();
+}
+
+void recordQueueTest() {
+	TEST_ENTER;
+
+	recordTest();
+	paddingTest();
+	multiThreadRecordTest();
+}
+
+} // namespace RecordQueueTest
+
+namespace DynamicQueueTest {
+
+struct CountingAllocator {
+	static void* allocate(const size_t inSize) noexcept {
+		++numAllocations;
+		allocatedSize = inSize;
+		return LWMessageQueue::HugePageAllocator::allocate(inSize);
+	}
+
+	static void deallocate(void* inMemory, const size_t inSize) noexcept {
+		--numAllocations;
+		deallocatedSize = inSize;
+		LWMessageQueue::HugePageAllocator::deallocate(inMemory, inSize);
+	}
+
+	static int32_t numAllocations;
+	static size_t allocatedSize;
+	static size_t deallocatedSize;
+};
+
+int32_t CountingAllocator::numAllocations = 0;
+size_t CountingAllocator::allocatedSize = 0;
+size_t CountingAllocator::deallocatedSize = 0;
+
+struct CountingAllocatorTraits : LWMessageQueue::DefaultTraits {
+	using Allocator = CountingAllocator;
+};
+
+using MessageQueue = LWMessageQueue::LWMessageQueue<
+	LWMessageQueue::dynamicExtent, LWMessageQueue::dynamicExtent, MessageUnion, MessageType, CountingAllocatorTraits>;
+
+void channelTest() {
+	MessageQueue messageQueue(8, 3, false);
+	TEST_VERIFY(CountingAllocator::numAllocations == 1);
+	TEST_VERIFY(CountingAllocator::allocatedSize >= 3 * 8 * sizeof(MessageQueue::MessageContainer));
+	TEST_VERIFY(messageQueue.getChannelSize() == 8);
+	TEST_VERIFY(messageQueue.getNumChannels() == 3);
+
+	// Fill the channels at different offsets, so that each one wraps around at a different message.
+	for (uint32_t channel = 0; channel < 3; ++channel) {
+		MessageQueue::ThreadChannelInput channelInput = messageQueue.getThreadChannelInput(channel);
+		MessageQueue::ThreadChannelOutput channelOutput = messageQueue.getThreadChannelOutput(channel);
+
+		Message1 message{};
+		for (uint32_t i = 0; i < channel * 3; ++i) {
+			channelInput.pushMessage(message, MessageType::Message1);
+		}
+		channelOutput.drain([](const MessageQueue::MessageContainer&) {}, 8);
+
+		for (uint32_t i = 0; i < 8; ++i) {
+			message.value = channel * 100 + i;
+			TEST_VERIFY(!channelInput.isFull());
+			channelInput.pushMessage(message, MessageType::Message1);
+		}
+		TEST_VERIFY(channelInput.isFull());
+	}
+
+	for (uint32_t channel = 0; channel < 3; ++channel) {
+		MessageQueue::ThreadChannelOutput channelOutput = messageQueue.getThreadChannelOutput(channel);
+		const MessageQueue::ThreadChannelOutput& constOutput = channelOutput;
+		TEST_VERIFY(constOutput.getNumMessages() == 8);
+		TEST_VERIFY(channelOutput.popMessage().getMessage<Message1>().value == channel * 100);
+
+		uint32_t expectedValue = channel * 100 + 1;
+		MessageQueue::MessageRange messageRange = channelOutput.getReadableMessages();
+		TEST_VERIFY(messageRange.size() == 7);
+		for (const MessageQueue::MessageContainer& messageContainer : messageRange) {
+			TEST_VERIFY(messageContainer.getMessage<Message1>().value == expectedValue);
+			++expectedValue;
+		}
+		channelOutput.release(messageRange.size());
+		TEST_VERIFY(channelOutput.getNumMessages() == 0);
+	}
+}
+
+bool throwsInvalidArgument(const uint32_t inSize, const uint32_t inChannels) {
+	try {
+		MessageQueue messageQueue(inSize, inChannels, false);
+	}
+	catch (const std::invalid_argument&) {
+		return true;
+	}
+	return false;
+}
+
+void invalidSizeTest() {
+	TEST_VERIFY(throwsInvalidArgument(0, 2));
+	TEST_VERIFY(throwsInvalidArgument(6, 2));
+	TEST_VERIFY(throwsInvalidArgument(8, 0));
+	TEST_VERIFY(!throwsInvalidArgument(8, 1));
+	TEST_VERIFY(CountingAllocator::numAllocations == 0);
+}
+
+void multiThreadDynamicTest() {
+	using HugePageMessageQueue = LWMessageQueue::LWMessageQueue<
+		LWMessageQueue::dynamicExtent, LWMessageQueue::dynamicExtent, MessageUnion, MessageType>;
+
+	const uint32_t numInputThreads = 4;
+	const uint32_t numMessages = 1 << 18;
+	HugePageMessageQueue messageQueue(1 << 16, numInputThreads);
+
+	std::vector<std::thread> inputThreads;
+	for (uint32_t channel = 0; channel < numInputThreads; ++channel) {
+		HugePageMessageQueue::ThreadChannelInput channelInput = messageQueue.getThreadChannelInput(channel);
+		inputThreads.emplace_back([channelInput]() mutable {
+			Message1 message;
+			for (uint32_t i = 0; i < numMessages; ++i) {
+				while (channelInput.isFull()) {
+					std::this_thread::yield();
+				}
+				message.value = i;
+				channelInput.pushMessage(message, MessageType::Message1);
+			}
+		});
+	}
+
+	uint32_t expectedValues[numInputThreads] = {};
+	uint32_t numReceived = 0;
+	while (numReceived < numInputThreads * numMessages) {
+		for (uint32_t channel = 0; channel < numInputThreads; ++channel) {
+			uint32_t& expectedValue = expectedValues[channel];
+			numReceived += messageQueue.getThreadChannelOutput(channel).drain(
+				[&expectedValue](const HugePageMessageQueue::MessageContainer& inMessageContainer) {
+					TEST_VERIFY(inMessageContainer.getMessage<Message1>().value == expectedValue);
+					++expectedValue;
+				}, 1024);
+		}
+	}
+
+	for (std::thread& inputThread : inputThreads) {
+		inputThread.join();
+	}
+}
+
+void dynamicQueueTest() {
+	TEST_ENTER;
+
+	channelTest();
+	TEST_VERIFY(CountingAllocator::numAllocations == 0);
+	TEST_VERIFY(CountingAllocator::deallocatedSize == CountingAllocator::allocatedSize);
+	invalidSizeTest();
+	multiThreadDynamicTest();
+}
+
+} // namespace DynamicQueueTest
+
+namespace ChannelRegistryTest {
+
+void acquireTest() {
+	using MessageQueue = LWMessageQueue::LWMessageQueue<4, 2, MessageUnion, MessageType>;
+	std::unique_ptr<MessageQueue> messageQueue(new MessageQueue());
+
+	uint32_t numVisited = 0;
+	auto drainChannel = [&messageQueue, &numVisited](const uint32_t inChannel) {
+		messageQueue->getThreadChannelOutput(inChannel).drain([](const MessageQueue::MessageContainer&) {}, 4);
+		++numVisited;
+	};
+	TEST_VERIFY(messageQueue->forEachAcquiredChannel(drainChannel) == 0);
+
+	MessageQueue::AcquiredInput firstInput = messageQueue->acquireInput();
+	MessageQueue::AcquiredInput secondInput = messageQueue->acquireInput();
+	TEST_VERIFY(firstInput.isValid() && firstInput.getChannel() == 0);
+	TEST_VERIFY(secondInput.isValid() && secondInput.getChannel() == 1);
+	TEST_VERIFY(!messageQueue->acquireInput().isValid());
+
+	Message1 message;
+	message.value = 1;
+	firstInput.getInput().pushMessage(message, MessageType::Message1);
+	TEST_VERIFY(firstInput.getInput().stageMessage(message, MessageType::Message1));
+
+	// Releasing commits staged messages. The channel is not reused until it has been drained.
+	MessageQueue::AcquiredInput movedInput(std::move(firstInput));
+	TEST_VERIFY(!firstInput.isValid());
+	movedInput.release();
+	TEST_VERIFY(!movedInput.isValid());
+	TEST_VERIFY(messageQueue->getThreadChannelOutput(0).getNumMessages() == 2);
+	TEST_VERIFY(!messageQueue->acquireInput().isValid());
+
+	TEST_VERIFY(messageQueue->forEachAcquiredChannel(drainChannel) == 2);
+	TEST_VERIFY(messageQueue->getThreadChannelOutput(0).getNumMessages() == 0);
+	MessageQueue::AcquiredInput reusedInput = messageQueue->acquireInput();
+	TEST_VERIFY(reusedInput.isValid() && reusedInput.getChannel() == 0);
+
+	// Released channels that were already drained are handed back on the next visit.
+	secondInput = MessageQueue::AcquiredInput();
+	TEST_VERIFY(messageQueue->forEachAcquiredChannel(drainChannel) == 2);
+	TEST_VERIFY(messageQueue->forEachAcquiredChannel(drainChannel) == 1);
+	TEST_VERIFY(messageQueue->acquireInput().getChannel() == 1);
+}
+
+struct ReadyBitmapTraits : LWMessageQueue::DefaultTraits {
+	static constexpr bool enableReadyBitmap = true;
+};
+
+void readyChannelReclaimTest() {
+	using MessageQueue = LWMessageQueue::LWMessageQueue<4, 2, MessageUnion, MessageType, ReadyBitmapTraits>;
+	std::unique_ptr<MessageQueue> messageQueue(new MessageQueue());
+
+	{
+		MessageQueue::AcquiredInput acquiredInput = messageQueue->acquireInput();
+		TEST_VERIFY(acquiredInput.getChannel() == 0);
+	}
+	MessageQueue::AcquiredInput firstInput = messageQueue->acquireInput();
+	TEST_VERIFY(firstInput.getChannel() == 1);
+
+	// Releasing an empty channel marks it ready, so that the output thread hands it back.
+	uint32_t channel = 2;
+	TEST_VERIFY(messageQueue->nextReadyChannel(channel));
+	TEST_VERIFY(channel == 0);
+	TEST_VERIFY(!messageQueue->nextReadyChannel(channel));
+	MessageQueue::AcquiredInput secondInput = messageQueue->acquireInput();
+	TEST_VERIFY(secondInput.getChannel() == 0);
+
+	Message1 message;
+	message.value = 1;
+	firstInput.getInput().pushMessage(message, MessageType::Message1);
+	secondInput.getInput().pushMessage(message, MessageType::Message1);
+	secondInput.release();
+	TEST_VERIFY(messageQueue->forEachReadyChannel([&messageQueue](const uint32_t inChannel) {
+		TEST_VERIFY(messageQueue->getThreadChannelOutput(inChannel).drain(
+			[](const MessageQueue::MessageContainer&) {}, 4) == 1);
+	}) == 2);
+	TEST_VERIFY(messageQueue->acquireInput().getChannel() == 0);
+}
+
+void threadPushTest() {
+	using MessageQueue = LWMessageQueue::LWMessageQueue<128, 4, MessageUnion, MessageType>;
+	std::unique_ptr<MessageQueue> messageQueue(new MessageQueue());
+
+	// More short lived threads than channels. Each batch of threads releases its channels on exit.
+	const uint32_t numMessages = 100;
+	for (uint32_t batch = 0; batch < 4; ++batch) {
+		std::vector<std::thread> inputThreads;
+		for (uint32_t thread = 0; thread < 4; ++thread) {
+			inputThreads.emplace_back([&messageQueue, batch, thread]() {
+				Message2 message;
+				message.charValue = static_cast<char>(batch * 4 + thread);
+				for (uint32_t i = 0; i < numMessages; ++i) {
+					message.uintValue = i;
+					TEST_VERIFY(messageQueue->pushMessage(message, MessageType::Message2));
+				}
+			});
+		}
+		for (std::thread& inputThread : inputThreads) {
+			inputThread.join();
+		}
+
+		uint32_t numReceived = 0;
+		TEST_VERIFY(messageQueue->forEachAcquiredChannel([&messageQueue, &numReceived](const uint32_t inChannel) {
+			MessageQueue::ThreadChannelOutput channelOutput = messageQueue->getThreadChannelOutput(inChannel);
+			const char sender = channelOutput.peek().getMessage<Message2>().charValue;
+			uint32_t expectedValue = 0;
+			numReceived += channelOutput.drain([sender, &expectedValue](const MessageQueue::MessageContainer& inMessage) {
+				TEST_VERIFY(inMessage.getMessage<Message2>().charValue == sender);
+				TEST_VERIFY(inMessage.getMessage<Message2>().uintValue == expectedValue);
+				++expectedValue;
+			}, numMessages);
+		}) == 4);
+		TEST_VERIFY(numReceived == 4 * numMessages);
+	}
+
+	// The calling thread keeps its channel until released.
+	Message1 message;
+	message.value = 5;
+	TEST_VERIFY(messageQueue->pushMessage(message, MessageType::Message1));
+	TEST_VERIFY(messageQueue->pushMessage(message, MessageType::Message1));
+	TEST_VERIFY(messageQueue->getThreadChannelOutput(0).getNumMessages() == 2);
+	messageQueue->releaseThreadInput();
+	TEST_VERIFY(messageQueue->forEachAcquiredChannel([&messageQueue](const uint32_t inChannel) {
+		TEST_VERIFY(messageQueue->getThreadChannelOutput(inChannel).drain(
+			[](const MessageQueue::MessageContainer&) {}, 4) == 2);
+	}) == 1);
+	TEST_VERIFY(messageQueue->forEachAcquiredChannel([](const uint32_t) {}) == 0);
+
+	// A thread keeps its channel in each queue it pushes to, alternating between queues does not re-acquire.
+	std::unique_ptr<MessageQueue> otherQueue(new MessageQueue());
+	for (uint32_t i = 0; i < 8; ++i) {
+		TEST_VERIFY(messageQueue->pushMessage(message, MessageType::Message1));
+		TEST_VERIFY(otherQueue->pushMessage(message, MessageType::Message1));
+	}
+	for (MessageQueue* queue : {messageQueue.get(), otherQueue.get()}) {
+		TEST_VERIFY(queue->forEachAcquiredChannel([queue](const uint32_t inChannel) {
+			TEST_VERIFY(queue->getThreadChannelOutput(inChannel).getNumMessages() == 8);
+		}) == 1);
+	}
+	otherQueue->releaseThreadInput();
+
+	// A push fails when the channel of the thread is full, and when no channel is free for a new thread.
+	using SmallQueue = LWMessageQueue::LWMessageQueue<4, 1, MessageUnion, MessageType>;
+	std::unique_ptr<SmallQueue> smallQueue(new SmallQueue());
+	for (uint32_t i = 0; i < 4; ++i) {
+		TEST_VERIFY(smallQueue->pushMessage(message, MessageType::Message1));
+	}
+	TEST_VERIFY(!smallQueue->pushMessage(message, MessageType::Message1));
+	bool isPushed = true;
+	std::thread([&smallQueue, &message, &isPushed]() {
+		isPushed = smallQueue->pushMessage(message, MessageType::Message1);
+	}).join();
+	TEST_VERIFY(!isPushed);
+	TEST_VERIFY(smallQueue->getThreadChannelOutput(0).getNumMessages() == 4);
+	smallQueue->releaseThreadInput();
+
+	// Destroying the queue forgets the channel of the destroying thread.
+	TEST_VERIFY(messageQueue->pushMessage(message, MessageType::Message1));
+}
+
+void channelRegistryTest() {
+	TEST_ENTER;
+
+	acquireTest();
+	readyChannelReclaimTest();
+	threadPushTest();
+}
+
+} // namespace ChannelRegistryTest
+
+namespace SharedChannelTest {
+
+struct SharedChannelTraits : LWMessageQueue::DefaultTraits {
+	static constexpr uint32_t sharedChannelSize = 4;
+};
+
+struct SharedBlockingWaitTraits : LWMessageQueue::DefaultTraits {
+	static constexpr uint32_t sharedChannelSize = 64;
+	static constexpr bool enableBlockingWait = true;
+};
+
+void pushPopTest() {
+	using MessageQueue = LWMessageQueue::LWMessageQueue<4, 1, MessageUnion, MessageType, SharedChannelTraits>;
+	std::unique_ptr<MessageQueue> messageQueue(new MessageQueue());
+
+	MessageQueue::SharedChannelInput sharedInput = messageQueue->getSharedChannelInput();
+	MessageQueue::SharedChannelOutput sharedOutput = messageQueue->getSharedChannelOutput();
+	TEST_VERIFY(sharedOutput.getNumMessages() == 0);
+
+	// Wrap around the slots a few times.
+	Message1 message;
+	uint32_t expectedValue = 0;
+	for (uint32_t i = 0; i < 10; ++i) {
+		message.value = i * 2;
+		sharedInput.pushMessage(message, MessageType::Message1);
+		message.value = i * 2 + 1;
+		TEST_VERIFY(sharedInput.tryPushMessage(message, MessageType::Message1));
+		TEST_VERIFY(sharedOutput.getNumMessages() == 2);
+
+		MessageQueue::MessageContainer messageContainer = sharedOutput.popMessage();
+		TEST_VERIFY(messageContainer.getType() == MessageType::Message1);
+		TEST_VERIFY(messageContainer.getMessage<Message1>().value == expectedValue++);
+		TEST_VERIFY(sharedOutput.drain([&expectedValue](const MessageQueue::MessageContainer& inMessage) {
+			TEST_VERIFY(inMessage.getMessage<Message1>().value == expectedValue++);
+		}, 4) == 1);
+	}
+
+	for (uint32_t i = 0; i < 4; ++i) {
+		message.value = i;
+		TEST_VERIFY(sharedInput.tryPushMessage(message, MessageType::Message1));
+	}
+	TEST_VERIFY(!sharedInput.tryPushMessage(message, MessageType::Message1));
+	TEST_VERIFY(sharedOutput.getNumMessages() == 4);
+
+	MessageQueue::MessageContainer messageContainers[4];
+	TEST_VERIFY(sharedOutput.popMessages(messageContainers, 3) == 3);
+	TEST_VERIFY(messageContainers[2].getMessage<Message1>().value == 2);
+	TEST_VERIFY(sharedInput.tryPushMessage(message, MessageType::Message1));
+	TEST_VERIFY(sharedOutput.popMessages(messageContainers, 4) == 2);
+
+	// The per thread channels are independent of the shared channel.
+	messageQueue->getThreadChannelInput(0).pushMessage(message, MessageType::Message1);
+	TEST_VERIFY(sharedOutput.getNumMessages() == 0);
+	TEST_VERIFY(messageQueue->getThreadChannelOutput(0).getNumMessages() == 1);
+}
+
+void multiProducerTest() {
+	using MessageQueue = LWMessageQueue::LWMessageQueue<4, 1, MessageUnion, MessageType, SharedBlockingWaitTraits>;
+	std::unique_ptr<MessageQueue> messageQueue(new MessageQueue());
+
+	// More producers than slots, so that producers wait for claimed slots to be freed.
+	const uint32_t numThreads = 8;
+	const uint32_t numMessages = 5000;
+	std::vector<std::thread> inputThreads;
+	for (uint32_t thread = 0; thread < numThreads; ++thread) {
+		inputThreads.emplace_back([&messageQueue, thread]() {
+			MessageQueue::SharedChannelInput sharedInput = messageQueue->getSharedChannelInput();
+			Message2 message;
+			message.charValue = static_cast<char>(thread);
+			for (uint32_t i = 0; i < numMessages; ++i) {
+				message.uintValue = i;
+				if ((i & 1) == 0) {
+					sharedInput.pushMessage(message, MessageType::Message2);
+				} else {
+					while (!sharedInput.tryPushMessage(message, MessageType::Message2)) {
+						std::this_thread::yield();
+					}
+				}
+			}
+		});
+	}
+
+	// Messages of one producer arrive in order.
+	MessageQueue::SharedChannelOutput sharedOutput = messageQueue->getSharedChannelOutput();
+	std::vector<uint32_t> expectedValues(numThreads, 0);
+	uint32_t numReceived = 0;
+	while (numReceived < numThreads * numMessages) {
+		messageQueue->waitForMessages(std::chrono::milliseconds(100));
+		numReceived += sharedOutput.drain([&expectedValues](const MessageQueue::MessageContainer& inMessage) {
+			const Message2& message = inMessage.getMessage<Message2>();
+			TEST_VERIFY(message.uintValue == expectedValues[message.charValue]);
+			++expectedValues[message.charValue];
+		}, 64);
+	}
+
+	for (std::thread& inputThread : inputThreads) {
+		inputThread.join();
+	}
+	TEST_VERIFY(sharedOutput.getNumMessages() == 0);
+}
+
+void sharedChannelTest() {
+	TEST_ENTER;
+
+	pushPopTest();
+	multiProducerTest();
+}
+
+} // namespace SharedChannelTest
+
+namespace ConsumerGroupTest {
+
+void stealTest() {
+	using MessageQueue = LWMessageQueue::LWMessageQueue<8, 4, MessageUnion, MessageType>;
+	std::unique_ptr<MessageQueue> messageQueue(new MessageQueue());
+
+	MessageQueue::ConsumerGroupOutput firstOutput = messageQueue->getConsumerGroupOutput(0, 2);
+	MessageQueue::ConsumerGroupOutput secondOutput = messageQueue->getConsumerGroupOutput(1, 2);
+	TEST_VERIFY(firstOutput.drain([](const MessageQueue::MessageContainer&) {}, 8) == 0);
+
+	Message1 message;
+	for (uint32_t i = 0; i < 6; ++i) {
+		message.value = i;
+		messageQueue->getThreadChannelInput(1).pushMessage(message, MessageType::Message1);
+		messageQueue->getThreadChannelInput(3).pushMessage(message, MessageType::Message1);
+	}
+	messageQueue->getThreadChannelInput(2).pushMessage(message, MessageType::Message1);
+
+	// Consumer 0 owns channels 0 and 2. With work of its own, it does not steal.
+	TEST_VERIFY(firstOutput.drain([](const MessageQueue::MessageContainer&) {}, 8) == 1);
+
+	// Idle, it steals the channel with the largest backlog, and continues where the last reader stopped.
+	uint32_t expectedValue = 0;
+	auto verifyOrder = [&expectedValue](const MessageQueue::MessageContainer& inMessage) {
+		TEST_VERIFY(inMessage.getMessage<Message1>().value == expectedValue);
+		++expectedValue;
+	};
+	TEST_VERIFY(secondOutput.drain([](const MessageQueue::MessageContainer&) {}, 2) == 4);
+	TEST_VERIFY(messageQueue->getThreadChannelOutput(3).getNumMessages() == 4);
+	expectedValue = 2;
+	TEST_VERIFY(firstOutput.drain(verifyOrder, 3) == 3);
+	TEST_VERIFY(messageQueue->getThreadChannelOutput(1).getNumMessages() == 1);
+	expectedValue = 2;
+	TEST_VERIFY(firstOutput.drain(verifyOrder, 8) == 4);
+	TEST_VERIFY(secondOutput.drain([](const MessageQueue::MessageContainer&) {}, 8) == 1);
+	TEST_VERIFY(secondOutput.drain([](const MessageQueue::MessageContainer&) {}, 8) == 0);
+	TEST_VERIFY(secondOutput.getConsumer() == 1);
+}
+
+void skewedLoadTest() {
+	using MessageQueue = LWMessageQueue::LWMessageQueue<256, 4, MessageUnion, MessageType>;
+	std::unique_ptr<MessageQueue> messageQueue(new MessageQueue());
+
+	// Consumer 0 owns channels 0 and 3, and channel 0 carries most of the load.
+	const uint32_t numChannels = 4;
+	const uint32_t numConsumers = 3;
+	const uint32_t numMessages[numChannels] = {40000, 2000, 2000, 2000};
+	std::vector<std::thread> inputThreads;
+	for (uint32_t channel = 0; channel < numChannels; ++channel) {
+		inputThreads.emplace_back([&messageQueue, &numMessages, channel]() {
+			MessageQueue::ThreadChannelInput channelInput = messageQueue->getThreadChannelInput(channel);
+			Message2 message;
+			message.charValue = static_cast<char>(channel);
+			for (uint32_t i = 0; i < numMessages[channel]; ++i) {
+				message.uintValue = i;
+				while (!channelInput.tryPushMessage(message, MessageType::Message2)) {
+					std::this_thread::yield();
+				}
+			}
+		});
+	}
+
+	// Only one consumer reads a channel at a time, and the token hands the channel over, so plain counters per 
+	// channel are enough to check the order.
+	uint32_t expectedValues[numChannels] = {};
+	std::atomic<uint32_t> numReceived{0};
+	uint32_t numReceivedPerConsumer[numConsumers] = {};
+	const uint32_t numTotal = numMessages[0] + numMessages[1] + numMessages[2] + numMessages[3];
+	std::vector<std::thread> outputThreads;
+	for (uint32_t consumer = 0; consumer < numConsumers; ++consumer) {
+		outputThreads.emplace_back([&, consumer]() {
+			MessageQueue::ConsumerGroupOutput groupOutput = messageQueue->getConsumerGroupOutput(consumer, numConsumers);
+			while (numReceived.load(std::memory_order_relaxed) < numTotal) {
+				const uint32_t numDrained = groupOutput.drain([&expectedValues](const MessageQueue::MessageContainer& inMessage) {
+					const Message2& message = inMessage.getMessage<Message2>();
+					const uint32_t channel = static_cast<uint32_t>(message.charValue);
+					TEST_VERIFY(message.uintValue == expectedValues[channel]);
+					++expectedValues[channel];
+				}, 32);
+				if (numDrained == 0) {
+					std::this_thread::yield();
+				} else if (consumer == 0) {
+					// A slow consumer, that the others should help.
+					std::this_thread::sleep_for(std::chrono::microseconds(50));
+				}
+				numReceivedPerConsumer[consumer] += numDrained;
+				numReceived.fetch_add(numDrained, std::memory_order_relaxed);
+			}
+		});
+	}
+
+	for (std::thread& inputThread : inputThreads) {
+		inputThread.join();
+	}
+	for (std::thread& outputThread : outputThreads) {
+		outputThread.join();
+	}
+	TEST_VERIFY(numReceived.load() == numTotal);
+	for (uint32_t channel = 0; channel < numChannels; ++channel) {
+		TEST_VERIFY(expectedValues[channel] == numMessages[channel]);
+	}
+	TEST_VERIFY(numReceivedPerConsumer[0] < numMessages[0] + numMessages[3]);
+	std::cout << "   Messages per consumer " << numReceivedPerConsumer[0] << ", " << numReceivedPerConsumer[1] << 
+		", " << numReceivedPerConsumer[2] << std::endl;
+}
+
+void consumerGroupTest() {
+	TEST_ENTER;
+
+	stealTest();
+	skewedLoadTest();
+}
+
+} // namespace ConsumerGroupTest
+
+namespace BroadcastQueueTest {
+
+struct BlockTraits : LWMessageQueue::DefaultTraits {
+	static constexpr LWMessageQueue::OverflowPolicy overflowPolicy = LWMessageQueue::OverflowPolicy::Block;
+};
+
+void broadcastTest() {
+	using BroadcastQueue = LWMessageQueue::LWBroadcastQueue<4, 2, MessageUnion, MessageType>;
+	std::unique_ptr<BroadcastQueue> broadcastQueue(new BroadcastQueue());
+
+	BroadcastQueue::BroadcastInput input = broadcastQueue->getInput();
+	BroadcastQueue::BroadcastOutput firstOutput = broadcastQueue->getOutput(0);
+	BroadcastQueue::BroadcastOutput secondOutput = broadcastQueue->getOutput(1);
+	TEST_VERIFY(firstOutput.getNumMessages() == 0);
+
+	Message1 message;
+	for (uint32_t i = 0; i < 4; ++i) {
+		message.value = i;
+		TEST_VERIFY(input.tryPushMessage(message, MessageType::Message1));
+	}
+	TEST_VERIFY(input.isFull());
+	TEST_VERIFY(!input.tryPushMessage(message, MessageType::Message1));
+
+	// Both outputs read the same slot.
+	TEST_VERIFY(firstOutput.getNumMessages() == 4 && secondOutput.getNumMessages() == 4);
+	TEST_VERIFY(&firstOutput.peek() == &secondOutput.peek());
+
+	// The slowest output holds back the input.
+	uint32_t expectedValue = 0;
+	TEST_VERIFY(firstOutput.drain([&expectedValue](const BroadcastQueue::MessageContainer& inMessage) {
+		TEST_VERIFY(inMessage.getType() == MessageType::Message1);
+		TEST_VERIFY(inMessage.getMessage<Message1>().value == expectedValue++);
+	}, 8) == 4);
+	TEST_VERIFY(input.isFull());
+	TEST_VERIFY(secondOutput.popMessage().getMessage<Message1>().value == 0);
+	TEST_VERIFY(!input.isFull());
+	TEST_VERIFY(secondOutput.popMessage().getMessage<Message1>().value == 1);
+
+	message.value = 4;
+	input.pushMessage(message, MessageType::Message1);
+	input.reserve<Message2>(MessageType::Message2).uintValue = 5;
+	TEST_VERIFY(firstOutput.getNumMessages() == 1);
+	input.publish();
+	TEST_VERIFY(firstOutput.getNumMessages() == 2 && secondOutput.getNumMessages() == 4);
+	TEST_VERIFY(secondOutput.peek().getMessage<Message1>().value == 2);
+	secondOutput.release(3);
+	TEST_VERIFY(secondOutput.peek().getType() == MessageType::Message2);
+	TEST_VERIFY(secondOutput.peek().getMessage<Message2>().uintValue == 5);
+}
+
+void multiThreadBroadcastTest() {
+	using BroadcastQueue = LWMessageQueue::LWBroadcastQueue<64, 3, MessageUnion, MessageType, BlockTraits>;
+	std::unique_ptr<BroadcastQueue> broadcastQueue(new BroadcastQueue());
+
+	const uint32_t numMessages = 100000;
+	std::vector<std::thread> outputThreads;
+	for (uint32_t consumer = 0; consumer < BroadcastQueue::getNumConsumers(); ++consumer) {
+		outputThreads.emplace_back([&broadcastQueue, consumer]() {
+			BroadcastQueue::BroadcastOutput output = broadcastQueue->getOutput(consumer);
+			uint32_t expectedValue = 0;
+			while (expectedValue < numMessages) {
+				const uint32_t numDrained = output.drain([&expectedValue](const BroadcastQueue::MessageContainer& inMessage) {
+					TEST_VERIFY(inMessage.getMessage<Message1>().value == expectedValue);
+					++expectedValue;
+				}, 16);
+				if (numDrained == 0) {
+					std::this_thread::yield();
+				}
+			}
+		});
+	}
+
+	BroadcastQueue::BroadcastInput input = broadcastQueue->getInput();
+	Message1 message;
+	for (uint32_t i = 0; i < numMessages; ++i) {
+		message.value = i;
+		input.pushMessage(message, MessageType::Message1);
+	}
+
+	for (std::thread& outputThread : outputThreads) {
+		outputThread.join();
+	}
+	TEST_VERIFY(broadcastQueue->getOutput(2).getNumMessages() == 0);
+}
+
+void broadcastQueueTest() {
+	TEST_ENTER;
+
+	broadcastTest();
+	multiThreadBroadcastTest();
+}
+
+} // namespace BroadcastQueueTest
+
+namespace TypedMessagesTest {
+
+struct Ping {
+	uint32_t sequence;
+};
+
+struct Quote {
+	double price;
+	uint32_t quantity;
+};
+
+struct Text {
+	char text[20];
+};
+
+using MessageList = LWMessageQueue::Messages<Ping, Quote, Text>;
+
+struct SharedChannelTraits : LWMessageQueue::DefaultTraits {
+	static constexpr uint32_t sharedChannelSize = 4;
+};
+
+void typedMessagesTest() {
+	TEST_ENTER;
+
+	using MessageQueue = LWMessageQueue::LWMessageQueue<8, 1, MessageList>;
+	static_assert(std::is_same<decltype(std::declval<MessageQueue::MessageContainer>().getType()), uint8_t>::value,
+		"Tags of a short Messages<> list should be one byte.");
+	// The tag padded to the alignment of Quote, followed by the 20 bytes of Text padded to 24.
+	static_assert(sizeof(MessageQueue::MessageContainer) == 8 + 24, "Unexpected MessageContainer size.");
+	static_assert(MessageQueue::getMessageType<Quote>() == 1, "Tags should be the index in the Messages<> list.");
+	std::unique_ptr<MessageQueue> messageQueue(new MessageQueue());
+
+	MessageQueue::ThreadChannelInput channelInput = messageQueue->getThreadChannelInput(0);
+	MessageQueue::ThreadChannelOutput channelOutput = messageQueue->getThreadChannelOutput(0);
+	channelInput.pushMessage(Ping{1});
+	TEST_VERIFY(channelInput.tryPushMessage(Quote{2.5, 3}));
+	TEST_VERIFY(channelInput.stageMessage(Ping{2}));
+	Text& text = channelInput.reserve<Text>();
+	text.text[0] = 'x';
+	channelInput.publish();
+	TEST_VERIFY(channelOutput.getNumMessages() == 4);
+
+	MessageQueue::MessageContainer messageContainer = channelOutput.popMessage();
+	TEST_VERIFY(messageContainer.getType() == MessageQueue::getMessageType<Ping>());
+	TEST_VERIFY(messageContainer.getMessage<Ping>().sequence == 1);
+
+	// One overload per type, picked through the tag.
+	uint32_t pingSum = 0;
+	double quoteValue = 0.0;
+	char firstChar = 0;
+	auto visitor = LWMessageQueue::Overloaded{
+		[&pingSum](const Ping& inPing) { pingSum += inPing.sequence; },
+		[&quoteValue](const Quote& inQuote) { quoteValue += inQuote.price * inQuote.quantity; },
+		[&firstChar](const Text& inText) { firstChar = inText.text[0]; }
+	};
+	channelOutput.peek().visit(visitor);
+	TEST_VERIFY(quoteValue == 7.5);
+	TEST_VERIFY(channelOutput.dispatch(visitor, 8) == 3);
+	TEST_VERIFY(pingSum == 2 && quoteValue == 15.0 && firstChar == 'x');
+
+	// The queue level and shared channel pushes derive the tag as well.
+	using SharedQueue = LWMessageQueue::LWMessageQueue<8, 1, MessageList, LWMessageQueue::MessageTag<MessageList>, 
+		SharedChannelTraits>;
+	std::unique_ptr<SharedQueue> sharedQueue(new SharedQueue());
+	sharedQueue->getSharedChannelInput().pushMessage(Quote{1.0, 1});
+	TEST_VERIFY(sharedQueue->getSharedChannelInput().tryPushMessage(Text{}));
+	TEST_VERIFY(sharedQueue->pushMessage(Ping{5}));
+	TEST_VERIFY(sharedQueue->getSharedChannelOutput().popMessage().getType() == SharedQueue::getMessageType<Quote>());
+	TEST_VERIFY(sharedQueue->getSharedChannelOutput().popMessage().getType() == SharedQueue::getMessageType<Text>());
+	TEST_VERIFY(sharedQueue->forEachAcquiredChannel([&sharedQueue](const uint32_t inChannel) {
+		TEST_VERIFY(sharedQueue->getThreadChannelOutput(inChannel).dispatch(LWMessageQueue::Overloaded{
+			[](const Ping& inPing) { TEST_VERIFY(inPing.sequence == 5); },
+			[](const auto&) { TEST_VERIFY(false); }
+		}, 8) == 1);
+	}) == 1);
+	sharedQueue->releaseThreadInput();
+}
+
+} // namespace TypedMessagesTest
+
+namespace PriorityDrainTest {
+
+using MessageQueue = LWMessageQueue::LWMessageQueue<16, 3, MessageUnion, MessageType>;
+
+void pushValues(MessageQueue& inMessageQueue, const uint32_t inChannel, const uint32_t inNumMessages) {
+	MessageQueue::ThreadChannelInput channelInput = inMessageQueue.getThreadChannelInput(inChannel);
+	for (uint32_t i = 0; i < inNumMessages; ++i) {
+		Message1 message;
+		message.value = inChannel * 100 + i;
+		channelInput.pushMessage(message, MessageType::Message1);
+	}
+}
+
+std::vector<uint32_t> drainValues(MessageQueue& inMessageQueue, const uint32_t inBudget) {
+	std::vector<uint32_t> values;
+	const uint32_t numMessages = inMessageQueue.drain([&values](const MessageQueue::MessageContainer& inMessage) {
+		values.push_back(inMessage.getMessage<Message1>().value);
+	}, inBudget);
+	TEST_VERIFY(numMessages == values.size());
+	return values;
+}
+
+void priorityDrainTest() {
+	TEST_ENTER;
+
+	std::unique_ptr<MessageQueue> messageQueue(new MessageQueue());
+
+	// Default lanes and weights, round-robin in batches of defaultChannelWeight.
+	pushValues(*messageQueue, 0, 2);
+	pushValues(*messageQueue, 1, 1);
+	TEST_VERIFY(drainValues(*messageQueue, 16) == std::vector<uint32_t>({0, 1, 100}));
+	TEST_VERIFY(drainValues(*messageQueue, 16).empty());
+
+	// Channel 2 carries control messages in the highest lane, channels 0 and 1 share lane 1 at weights 3 and 1.
+	messageQueue->setChannelPriority(0, 1, 3);
+	messageQueue->setChannelPriority(1, 1, 1);
+	pushValues(*messageQueue, 0, 8);
+	pushValues(*messageQueue, 1, 8);
+	pushValues(*messageQueue, 2, 2);
+	TEST_VERIFY(drainValues(*messageQueue, 6) == std::vector<uint32_t>({200, 201, 0, 1, 2, 100}));
+
+	// A round cut short by the budget is resumed, without a new quantum.
+	TEST_VERIFY(drainValues(*messageQueue, 2) == std::vector<uint32_t>({3, 4}));
+	TEST_VERIFY(drainValues(*messageQueue, 3) == std::vector<uint32_t>({5, 101, 6}));
+
+	// Control messages go first regardless of the bulk backlog.
+	pushValues(*messageQueue, 2, 1);
+	TEST_VERIFY(drainValues(*messageQueue, 1) == std::vector<uint32_t>({200}));
+
+	// An emptied channel leaves its share to the others.
+	TEST_VERIFY(drainValues(*messageQueue, 16) == std::vector<uint32_t>({7, 102, 103, 104, 105, 106, 107}));
+	TEST_VERIFY(drainValues(*messageQueue, 16).empty());
+}
+
+} // namespace PriorityDrainTest
+
+namespace StatsTest {
+
+struct StatsTraits : LWMessageQueue::DefaultTraits {
+	static constexpr bool enableStats = true;
+};
+
+using MessageQueue = LWMessageQueue::LWMessageQueue<8, 2, MessageUnion, MessageType, StatsTraits>;
+
+// The counters live in the producer and consumer cache lines, and take no space when disabled.
+static_assert(sizeof(LWMessageQueue::Internal::ProducerStats<false>) == 1, "Disabled stats must be empty.");
+static_assert(MessageQueue::ChannelLayout::channelSize == 
+	LWMessageQueue::LWMessageQueue<8, 2, MessageUnion, MessageType>::ChannelLayout::channelSize,
+	"Stats must fit in the cache lines of the channel.");
+
+struct WaitStatsTraits : StatsTraits {
+	static constexpr bool enableBlockingWait = true;
+};
+
+// Only the public read paths count reads. Waiting for messages probes the channels without counting.
+void probeTest() {
+	using WaitQueue = LWMessageQueue::LWMessageQueue<8, 2, MessageUnion, MessageType, WaitStatsTraits>;
+	std::unique_ptr<WaitQueue> messageQueue(new WaitQueue());
+	Message1 message;
+	message.value = 1;
+
+	TEST_VERIFY(!messageQueue->waitForMessages(std::chrono::milliseconds(0)));
+	WaitQueue::ThreadChannelInput channelInput = messageQueue->getThreadChannelInput(0);
+	for (uint32_t i = 0; i < 8; ++i) {
+		channelInput.pushMessage(message, MessageType::Message1);
+	}
+	TEST_VERIFY(messageQueue->waitForMessages(std::chrono::milliseconds(0)));
+
+	WaitQueue::ChannelStats stats[2];
+	TEST_VERIFY(messageQueue->snapshotStats(stats, 2) == 2);
+	TEST_VERIFY(stats[0].numConsumerStalls == 0 && stats[1].numConsumerStalls == 0);
+	TEST_VERIFY(stats[0].numNearFull == 0 && stats[0].highWaterMark == 0);
+
+	TEST_VERIFY(messageQueue->getThreadChannelOutput(0).getNumMessages() == 8);
+	TEST_VERIFY(messageQueue->snapshotStats(stats, 2) == 2);
+	TEST_VERIFY(stats[0].numNearFull == 1 && stats[0].highWaterMark == 8);
+}
+
+void statsTest() {
+	TEST_ENTER;
+
+	std::unique_ptr<MessageQueue> messageQueue(new MessageQueue());
+	MessageQueue::ThreadChannelInput channelInput = messageQueue->getThreadChannelInput(0);
+	MessageQueue::ThreadChannelOutput channelOutput = messageQueue->getThreadChannelOutput(0);
+	Message1 message;
+	message.value = 1;
+
+	// An empty read is a stall.
+	TEST_VERIFY(channelOutput.getNumMessages() == 0);
+
+	// Fill the channel, then fail to push two more.
+	for (uint32_t i = 0; i < 8; ++i) {
+		channelInput.pushMessage(message, MessageType::Message1);
+	}
+	TEST_VERIFY(!channelInput.tryPushMessage(message, MessageType::Message1));
+	TEST_VERIFY(!channelInput.tryPushMessage(message, MessageType::Message1));
+
+	// A full read is near full and sets the high water mark, a read of one is neither.
+	TEST_VERIFY(channelOutput.getNumMessages() == 8);
+	for (uint32_t i = 0; i < 7; ++i) {
+		channelOutput.popMessage();
+	}
+	TEST_VERIFY(channelOutput.getNumMessages() == 1);
+	TEST_VERIFY(channelOutput.drain([](const MessageQueue::MessageContainer&) {}, 8) == 1);
+
+	MessageQueue::ChannelStats stats[3];
+	TEST_VERIFY(messageQueue->snapshotStats(stats, 3) == 2);
+	TEST_VERIFY(stats[0].numPushes == 8);
+	TEST_VERIFY(stats[0].numFullPushes == 2);
+	TEST_VERIFY(stats[0].numPops == 8);
+	TEST_VERIFY(stats[0].numNearFull == 1);
+	TEST_VERIFY(stats[0].numConsumerStalls == 1);
+	TEST_VERIFY(stats[0].highWaterMark == 8);
+	TEST_VERIFY(stats[1].numPushes == 0 && stats[1].numPops == 0 && stats[1].highWaterMark == 0);
+
+	TEST_VERIFY(messageQueue->snapshotStats(stats, 1) == 1);
+
+	probeTest();
+}
+
+} // namespace StatsTest
+
+namespace LatencyTraceTest {
+
+struct TraceTraits : LWMessageQueue::DefaultTraits {
+	static constexpr uint32_t traceSampleInterval = 4;
+};
+
+using MessageQueue = LWMessageQueue::LWMessageQueue<16, 2, MessageUnion, MessageType, TraceTraits>;
+using Histogram = LWMessageQueue::Internal::LatencyHistogram<64, true>;
+
+// The push time is only stored when tracing.
+static_assert(sizeof(MessageQueue::MessageContainer) == 
+	sizeof(LWMessageQueue::LWMessageQueue<16, 2, MessageUnion, MessageType>::MessageContainer) + sizeof(uint64_t),
+	"Tracing must add only the push time to a message container.");
+
+void histogramTest() {
+	TEST_ENTER;
+
+	// Every value falls in a bucket that holds it, and the previous bucket does not. Above the linear buckets, a 
+	// bucket spans at most an eighth of its lowest value.
+	const uint64_t values[] = {0, 1, 7, 8, 9, 15, 16, 17, 100, 1000, 123456, 1ull << 40, (1ull << 40) + 1, ~0ull};
+	for (const uint64_t value : values) {
+		const uint32_t bucket = Histogram::bucketOf(value);
+		TEST_VERIFY(bucket < Histogram::numBuckets);
+		TEST_VERIFY(Histogram::bucketMax(bucket) >= value);
+		TEST_VERIFY(bucket == 0 || Histogram::bucketMax(bucket - 1) < value);
+		TEST_VERIFY(Histogram::bucketMax(bucket) - value <= value / 8);
+	}
+	TEST_VERIFY(Histogram::bucketOf(~0ull) == Histogram::numBuckets - 1);
+}
+
+void latencyTraceTest() {
+	TEST_ENTER;
+
+	histogramTest();
+
+	std::unique_ptr<MessageQueue> messageQueue(new MessageQueue());
+	MessageQueue::ThreadChannelInput channelInput = messageQueue->getThreadChannelInput(0);
+	MessageQueue::ThreadChannelOutput channelOutput = messageQueue->getThreadChannelOutput(0);
+	Message1 message;
+	message.value = 1;
+
+	// Messages 0 and 4 are sampled, and wait at least 2 ms.
+	for (uint32_t i = 0; i < 8; ++i) {
+		channelInput.pushMessage(message, MessageType::Message1);
+	}
+	std::this_thread::sleep_for(std::chrono::milliseconds(2));
+	TEST_VERIFY(channelOutput.getNumMessages() == 8);
+	channelOutput.popMessage();
+	TEST_VERIFY(channelOutput.drain([](const MessageQueue::MessageContainer&) {}, 8) == 7);
+
+	const MessageQueue::LatencyPercentiles percentiles = messageQueue->getLatencyPercentiles(0);
+	TEST_VERIFY(percentiles.numSamples == 2);
+	TEST_VERIFY(percentiles.p50 >= 2000000);
+	TEST_VERIFY(percentiles.p50 <= percentiles.p99 && percentiles.p99 <= percentiles.max);
+	TEST_VERIFY(messageQueue->getLatencyPercentiles(1).numSamples == 0);
+
+	// Only channels with samples are dumped.
+	std::ostringstream dump;
+	messageQueue->dumpLatencyPercentiles(dump);
+	const std::string lines = dump.str();
+	TEST_VERIFY(lines.find("channel,samples,p50_ns,p90_ns,p99_ns,p999_ns,max_ns\n0,2,") == 0);
+	TEST_VERIFY(std::count(lines.begin(), lines.end(), '\n') == 2);
+}
+
+} // namespace LatencyTraceTest
+
+#if defined(__linux__)
+namespace SharedMemoryTest {
+
+using SharedMemoryQueue = LWMessageQueue::LWSharedMemoryQueue<64, 2, MessageUnion, MessageType>;
+using OtherSharedMemoryQueue = LWMessageQueue::LWSharedMemoryQueue<128, 2, MessageUnion, MessageType>;
+
+static constexpr uint32_t numMessages = 10000;
+
+// Runs in the child process. Attaches on its own, at whatever address the mapping gets, and pushes values on 
+// channel 1. Returns the exit status.
+int pushFromChild(const std::string& inName, const int inFileDescriptor, const void* inParentQueue) {
+	SharedMemoryQueue sharedMemoryQueue;
+	const bool attached = inName.empty() ? sharedMemoryQueue.attach(inFileDescriptor) : 
+		sharedMemoryQueue.attach(inName.c_str());
+	if (!attached || sharedMemoryQueue.getQueue() == inParentQueue) {
+		return 1;
+	}
+
+	SharedMemoryQueue::MessageQueue::ThreadChannelInput channelInput = sharedMemoryQueue.getQueue()->getThreadChannelInput(1);
+	for (uint32_t i = 0; i < numMessages; ++i) {
+		Message1 message;
+		message.value = i;
+		while (!channelInput.tryPushMessage(message, MessageType::Message1)) {
+			std::this_thread::yield();
+		}
+	}
+	sharedMemoryQueue.detach();
+	return 0;
+}
+
+// Forks a producer, and receives its messages in order.
+void receiveFromChild(SharedMemoryQueue& ioSharedMemoryQueue, const std::string& inName) {
+	const pid_t child = fork();
+	TEST_VERIFY(child >= 0);
+	if (child == 0) {
+		_exit(pushFromChild(inName, ioSharedMemoryQueue.getFileDescriptor(), ioSharedMemoryQueue.getQueue()));
+	}
+
+	SharedMemoryQueue::MessageQueue::ThreadChannelOutput channelOutput = 
+		ioSharedMemoryQueue.getQueue()->getThreadChannelOutput(1);
+	uint32_t expectedValue = 0;
+	while (expectedValue < numMessages) {
+		if (channelOutput.getNumMessages() == 0) {
+			std::this_thread::yield();
+			continue;
+		}
+		const SharedMemoryQueue::MessageQueue::MessageContainer message = channelOutput.popMessage();
+		TEST_VERIFY(message.getType() == MessageType::Message1);
+		TEST_VERIFY(message.getMessage<Message1>().value == expectedValue);
+		++expectedValue;
+	}
+
+	int status = 0;
+	TEST_VERIFY(waitpid(child, &status, 0) == child);
+	TEST_VERIFY(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+}
+
+void sharedMemoryTest() {
+	TEST_ENTER;
+
+	const std::string name = "/LWMessageQueueTest." + std::to_string(getpid());
+	{
+		SharedMemoryQueue sharedMemoryQueue;
+		TEST_VERIFY(!sharedMemoryQueue.attach(name.c_str()));
+		TEST_VERIFY(sharedMemoryQueue.create(name.c_str()));
+		TEST_VERIFY(sharedMemoryQueue.getQueue() != nullptr);
+
+		// Another queue type is refused.
+		OtherSharedMemoryQueue otherSharedMemoryQueue;
+		TEST_VERIFY(!otherSharedMemoryQueue.attach(name.c_str()));
+		TEST_VERIFY(errno == EPROTO);
+		TEST_VERIFY(otherSharedMemoryQueue.getQueue() == nullptr);
+
+		// The same name can not be created twice.
+		SharedMemoryQueue secondSharedMemoryQueue;
+		TEST_VERIFY(!secondSharedMemoryQueue.create(name.c_str()));
+
+		receiveFromChild(sharedMemoryQueue, name);
+	}
+
+	// The creator removed the name when detaching.
+	SharedMemoryQueue sharedMemoryQueue;
+	TEST_VERIFY(!sharedMemoryQueue.attach(name.c_str()));
+
+	TEST_VERIFY(sharedMemoryQueue.createAnonymous());
+	receiveFromChild(sharedMemoryQueue, std::string());
+}
+
+} // namespace SharedMemoryTest
+#endif
 
-struct Message1 {
-	uint32_t value;
-};
+#if defined(__linux__)
+namespace RecorderTest {
 
-struct Message2 {
-	char charValue;
-	uint32_t uintValue;
-};
+using MessageQueue = LWMessageQueue::LWMessageQueue<64, 3, MessageUnion, MessageType>;
+using SmallMessageQueue = LWMessageQueue::LWMessageQueue<64, 2, MessageUnion, MessageType>;
+using DynamicQueue = LWMessageQueue::LWMessageQueue<LWMessageQueue::dynamicExtent, LWMessageQueue::dynamicExtent, 
+	MessageUnion, MessageType>;
 
-struct Message3 {
-	char* stringRef;
-	uint32_t uintValue;
-	double doubleValue;
+// Pops every pending message of every channel, recording it.
+uint32_t popAndRecord(MessageQueue& inMessageQueue, LWMessageQueue::LWMessageRecorder<MessageQueue>& ioRecorder) {
+	uint32_t numMessages = 0;
+	for (uint32_t channel = 0; channel < inMessageQueue.getNumChannels(); ++channel) {
+		MessageQueue::ThreadChannelOutput channelOutput = inMessageQueue.getThreadChannelOutput(channel);
+		while (channelOutput.getNumMessages() != 0) {
+			TEST_VERIFY(ioRecorder.record(channel, channelOutput.popMessage()));
+			++numMessages;
+		}
+	}
+	return numMessages;
+}
+
+// A runtime sized queue replays a recording of the same type with fewer channels, skipping the missing ones.
+void dynamicReplayTest() {
+	const std::string path = "/tmp/LWMessageQueueTest." + std::to_string(getpid()) + ".dynamic.rec";
+	DynamicQueue messageQueue(64, 3);
+	LWMessageQueue::LWMessageRecorder<DynamicQueue> recorder;
+	TEST_VERIFY(recorder.open(path.c_str(), sysconf(_SC_PAGESIZE)));
+	Message1 message;
+	for (uint32_t channel = 0; channel < 3; ++channel) {
+		message.value = channel;
+		messageQueue.getThreadChannelInput(channel).pushMessage(message, MessageType::Message1);
+		TEST_VERIFY(recorder.record(channel, messageQueue.getThreadChannelOutput(channel).popMessage()));
+	}
+	recorder.close();
+
+	DynamicQueue smallQueue(64, 2);
+	LWMessageQueue::LWMessageReplayer<DynamicQueue> replayer;
+	TEST_VERIFY(replayer.open(path.c_str()));
+	TEST_VERIFY(replayer.replay(smallQueue, 0.0) == 2);
+	for (uint32_t channel = 0; channel < 2; ++channel) {
+		TEST_VERIFY(smallQueue.getThreadChannelOutput(channel).getNumMessages() == 1);
+		TEST_VERIFY(smallQueue.getThreadChannelOutput(channel).popMessage().getMessage<Message1>().value == channel);
+	}
+	unlink(path.c_str());
+}
+
+void recorderTest() {
+	TEST_ENTER;
+
+	const std::string path = "/tmp/LWMessageQueueTest." + std::to_string(getpid()) + ".rec";
+	std::unique_ptr<MessageQueue> messageQueue(new MessageQueue());
+
+	// Record 1000 messages in windows of one page, so that records cross window boundaries, then a last message
+	// 10 ms later.
+	LWMessageQueue::LWMessageRecorder<MessageQueue> recorder;
+	TEST_VERIFY(recorder.open(path.c_str(), sysconf(_SC_PAGESIZE)));
+	for (uint32_t i = 0; i < 1000; ++i) {
+		Message1 message;
+		message.value = i;
+		messageQueue->getThreadChannelInput(i % 3).pushMessage(message, MessageType::Message1);
+		if (i % 48 == 47) {
+			popAndRecord(*messageQueue, recorder);
+		}
+	}
+	popAndRecord(*messageQueue, recorder);
+	std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	Message2 lastMessage;
+	lastMessage.charValue = 'x';
+	lastMessage.uintValue = 1000;
+	messageQueue->getThreadChannelInput(2).pushMessage(lastMessage, MessageType::Message2);
+	TEST_VERIFY(popAndRecord(*messageQueue, recorder) == 1);
+	TEST_VERIFY(recorder.getNumRecords() == 1001);
+	TEST_VERIFY(recorder.close());
+
+	// The file is cut to the recorded messages.
+	struct stat fileStatus;
+	TEST_VERIFY(stat(path.c_str(), &fileStatus) == 0);
+	TEST_VERIFY(static_cast<size_t>(fileStatus.st_size) == 
+		LWMessageQueue::Internal::Recording<MessageQueue::MessageContainer>::recordsOffset + 
+		1001 * sizeof(LWMessageQueue::Internal::Recording<MessageQueue::MessageContainer>::Record));
+
+	// A replay as fast as possible delivers every message to its channel, in order.
+	LWMessageQueue::LWMessageReplayer<MessageQueue> replayer;
+	TEST_VERIFY(replayer.open(path.c_str()));
+	TEST_VERIFY(replayer.getNumRecords() == 1001);
+	std::unique_ptr<MessageQueue> replayQueue(new MessageQueue());
+	std::thread replayThread([&replayer, &replayQueue]() { replayer.replay(*replayQueue, 0.0); });
+	uint32_t nextValue[3] = {0, 1, 2};
+	uint32_t numReceived = 0;
+	while (numReceived < 1001) {
+		for (uint32_t channel = 0; channel < 3; ++channel) {
+			MessageQueue::ThreadChannelOutput channelOutput = replayQueue->getThreadChannelOutput(channel);
+			while (channelOutput.getNumMessages() != 0) {
+				const MessageQueue::MessageContainer message = channelOutput.popMessage();
+				if (message.getType() == MessageType::Message2) {
+					TEST_VERIFY(channel == 2 && message.getMessage<Message2>().uintValue == 1000);
+				} else {
+					TEST_VERIFY(message.getMessage<Message1>().value == nextValue[channel]);
+					nextValue[channel] += 3;
+				}
+				++numReceived;
+			}
+		}
+		std::this_thread::yield();
+	}
+	replayThread.join();
+
+	// At the recorded pace the last message comes at least 10 ms after the first, and twice as fast at least 5 ms.
+	for (const double speed : {1.0, 2.0}) {
+		std::unique_ptr<MessageQueue> pacedQueue(new MessageQueue());
+		const std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+		std::thread pacedThread([&replayer, &pacedQueue, speed]() { replayer.replay(*pacedQueue, speed); });
+		uint32_t numPaced = 0;
+		while (numPaced < 1001) {
+			for (uint32_t channel = 0; channel < 3; ++channel) {
+				MessageQueue::ThreadChannelOutput channelOutput = pacedQueue->getThreadChannelOutput(channel);
+				numPaced += channelOutput.drain([](const MessageQueue::MessageContainer&) {}, 64);
+			}
+			std::this_thread::yield();
+		}
+		pacedThread.join();
+		const std::chrono::steady_clock::duration elapsed = std::chrono::steady_clock::now() - startTime;
+		TEST_VERIFY(elapsed >= std::chrono::microseconds(static_cast<int64_t>(10000 / speed)));
+	}
+
+	// A queue type with a different layout does not open the recording.
+	LWMessageQueue::LWMessageReplayer<SmallMessageQueue> smallReplayer;
+	TEST_VERIFY(!smallReplayer.open(path.c_str()) && errno == EPROTO);
+
+	unlink(path.c_str());
+	dynamicReplayTest();
+}
+
+} // namespace RecorderTest
+#endif
+
+namespace ScheduledDeliveryTest {
+
+struct ScheduleTraits : LWMessageQueue::DefaultTraits {
+	static constexpr uint32_t scheduledMessageCapacity = 40;
 };
 
-union MessageUnion {
-	Message1 message1;
-	Message2 message2;
-	Message3 message3;
+using MessageQueue = LWMessageQueue::LWMessageQueue<16, 2, MessageUnion, MessageType, ScheduleTraits>;
+using TimerWheel = LWMessageQueue::Internal::TimerWheel<uint32_t, 1024, 2>;
+
+static_assert(sizeof(MessageQueue::MessageContainer) == 
+	sizeof(LWMessageQueue::LWMessageQueue<16, 2, MessageUnion, MessageType>::MessageContainer) + sizeof(uint64_t),
+	"Scheduled delivery must add only the delivery time to a message container.");
+
+// An element is due once the tick of the time reaches the tick of its deadline, rounded up.
+bool isDue(const uint64_t inDeadline, const uint64_t inNow) {
+	return ((inDeadline + 1023) >> TimerWheel::tickShift) <= (inNow >> TimerWheel::tickShift);
+}
+
+void timerWheelTest() {
+	TEST_ENTER;
+
+	std::unique_ptr<TimerWheel> timerWheel(new TimerWheel());
+	const uint64_t startTime = 5000000000000ull;
+	timerWheel->advance(startTime);
+
+	// Deadlines on every level and beyond the wheel.
+	const uint64_t delays[] = {5000, 100000, 200000, 10000000, 3000000000ull, 1800000000000ull};
+	for (uint32_t element = 0; element < 6; ++element) {
+		TEST_VERIFY(timerWheel->insert(element % 2, startTime + delays[element], element));
+	}
+	TEST_VERIFY(timerWheel->insert(0, startTime - 1000, 100));
+	TEST_VERIFY(timerWheel->getNumDue(0) == 1 && timerWheel->frontDue(0) == 100);
+	timerWheel->popDue(0);
+
+	for (uint32_t element = 0; element < 6; ++element) {
+		const uint32_t channel = element % 2;
+		timerWheel->advance(startTime + delays[element] - 2048);
+		TEST_VERIFY(timerWheel->getNumDue(channel) == 0);
+		timerWheel->advance(startTime + delays[element] + 1024);
+		TEST_VERIFY(timerWheel->getNumDue(channel) == 1 && timerWheel->frontDue(channel) == element);
+		timerWheel->popDue(channel);
+	}
+	TEST_VERIFY(timerWheel->isIdle());
+
+	// Random deadlines and steps. Every element is due exactly when its deadline has passed, and the pool is 
+	// reused.
+	uint64_t seed = 12345;
+	const auto random = [&seed](const uint64_t inRange) {
+		seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+		return (seed >> 33) % inRange;
+	};
+	uint64_t now = startTime + delays[5];
+	std::vector<uint64_t> deadlines(1024);
+	for (uint32_t round = 0; round < 4; ++round) {
+		for (uint32_t element = 0; element < 1024; ++element) {
+			deadlines[element] = now + random(uint64_t(1) << (10 + random(32)));
+			TEST_VERIFY(timerWheel->insert(element % 2, deadlines[element], element));
+		}
+		TEST_VERIFY(!timerWheel->insert(0, now + 1000000, 0));
+
+		uint32_t numDue = 0;
+		while (numDue < 1024) {
+			now += random(uint64_t(1) << (4 + random(36)));
+			timerWheel->advance(now);
+			for (uint32_t channel = 0; channel < 2; ++channel) {
+				uint64_t lastDeadline = 0;
+				while (timerWheel->getNumDue(channel) != 0) {
+					const uint32_t element = timerWheel->frontDue(channel);
+					TEST_VERIFY(isDue(deadlines[element], now));
+					TEST_VERIFY((deadlines[element] >> 10) + 1 >= (lastDeadline >> 10));
+					lastDeadline = deadlines[element];
+					deadlines[element] = ~uint64_t(0);
+					timerWheel->popDue(channel);
+					++numDue;
+				}
+			}
+			for (uint32_t element = 0; element < 1024; ++element) {
+				TEST_VERIFY(!isDue(deadlines[element], now) || deadlines[element] == ~uint64_t(0));
+			}
+		}
+		TEST_VERIFY(timerWheel->isIdle());
+	}
+}
+
+std::vector<uint32_t> popValues(MessageQueue& inMessageQueue) {
+	MessageQueue::ThreadChannelOutput channelOutput = inMessageQueue.getThreadChannelOutput(0);
+	std::vector<uint32_t> values;
+	const uint32_t numMessages = channelOutput.collectScheduled();
+	TEST_VERIFY(static_cast<const MessageQueue::ThreadChannelOutput&>(channelOutput).getNumMessages() == numMessages);
+	for (uint32_t i = 0; i < numMessages; ++i) {
+		values.push_back(channelOutput.popMessage().getMessage<Message1>().value);
+	}
+	return values;
+}
+
+std::vector<uint32_t> drainValues(MessageQueue& inMessageQueue) {
+	std::vector<uint32_t> values;
+	inMessageQueue.getThreadChannelOutput(0).drain([&values](const MessageQueue::MessageContainer& inMessage) {
+		values.push_back(inMessage.getMessage<Message1>().value);
+	}, 64);
+	return values;
+}
+
+// A released channel is not handed to the next owner while a scheduled message of it waits in the timing wheel.
+void reclaimTest() {
+	std::unique_ptr<MessageQueue> messageQueue(new MessageQueue());
+	Message1 message;
+	message.value = 1;
+	{
+		MessageQueue::AcquiredInput acquiredInput = messageQueue->acquireInput();
+		TEST_VERIFY(acquiredInput.getChannel() == 0);
+		acquiredInput.getInput().pushMessageAfter(message, MessageType::Message1, std::chrono::milliseconds(200));
+	}
+
+	std::vector<uint32_t> values;
+	const auto drainChannel = [&messageQueue, &values](const uint32_t inChannel) {
+		messageQueue->getThreadChannelOutput(inChannel).drain([&values](const MessageQueue::MessageContainer& inMessage) {
+			values.push_back(inMessage.getMessage<Message1>().value);
+		}, 16);
+	};
+	TEST_VERIFY(messageQueue->forEachAcquiredChannel(drainChannel) == 1);
+	TEST_VERIFY(values.empty());
+	TEST_VERIFY(messageQueue->acquireInput().getChannel() == 1);
+
+	while (values.empty()) {
+		messageQueue->forEachAcquiredChannel(drainChannel);
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	TEST_VERIFY(values == std::vector<uint32_t>({1}));
+	TEST_VERIFY(messageQueue->acquireInput().getChannel() == 0);
+}
+
+void scheduledDeliveryTest() {
+	TEST_ENTER;
+
+	timerWheelTest();
+	reclaimTest();
+
+	std::unique_ptr<MessageQueue> messageQueue(new MessageQueue());
+	MessageQueue::ThreadChannelInput channelInput = messageQueue->getThreadChannelInput(0);
+	Message1 message;
+
+	// Immediate messages and messages already due keep their order, later ones are held back.
+	const std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+	message.value = 1;
+	channelInput.pushMessage(message, MessageType::Message1);
+	message.value = 2;
+	channelInput.pushMessageAfter(message, MessageType::Message1, std::chrono::milliseconds(200));
+	message.value = 3;
+	channelInput.pushMessage(message, MessageType::Message1);
+	message.value = 4;
+	channelInput.pushMessageAt(message, MessageType::Message1, startTime - std::chrono::seconds(1));
+	TEST_VERIFY(popValues(*messageQueue) == std::vector<uint32_t>({1, 3, 4}));
+	TEST_VERIFY(popValues(*messageQueue).empty());
+
+	// Held messages free their slots, so the channel can be filled while they wait.
+	for (uint32_t i = 0; i < 16; ++i) {
+		message.value = 10 + i;
+		channelInput.pushMessageAt(message, MessageType::Message1, startTime + std::chrono::milliseconds(300));
+	}
+	TEST_VERIFY(drainValues(*messageQueue).empty());
+	for (uint32_t i = 0; i < 16; ++i) {
+		message.value = 100 + i;
+		channelInput.pushMessage(message, MessageType::Message1);
+	}
+	TEST_VERIFY(drainValues(*messageQueue).size() == 16);
+
+	// Due messages come out in deadline order, those with the same deadline in push order. The checks that 
+	// nothing is due yet stay well before the first deadline, so that a slow run does not fail them.
+	while (std::chrono::steady_clock::now() < startTime + std::chrono::milliseconds(100)) {
+		TEST_VERIFY(popValues(*messageQueue).empty());
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	std::this_thread::sleep_until(startTime + std::chrono::milliseconds(310));
+	message.value = 50;
+	channelInput.pushMessage(message, MessageType::Message1);
+	const std::vector<uint32_t> values = drainValues(*messageQueue);
+	TEST_VERIFY(values.size() == 18 && values[0] == 2 && values[1] == 10 && values[16] == 25 && values[17] == 50);
+
+	// When the timing wheel is full, the channel holds the rest back, in order, until there is room.
+	for (uint32_t i = 0; i < 48; ++i) {
+		message.value = 200 + i;
+		channelInput.pushMessageAfter(message, MessageType::Message1, std::chrono::milliseconds(200 + i / 16));
+		if (i % 16 == 15) {
+			TEST_VERIFY(popValues(*messageQueue).empty());
+		}
+	}
+	for (uint32_t i = 0; i < 8; ++i) {
+		message.value = 300 + i;
+		channelInput.pushMessage(message, MessageType::Message1);
+	}
+	TEST_VERIFY(channelInput.isFull());
+	TEST_VERIFY(popValues(*messageQueue).empty());
+	std::this_thread::sleep_for(std::chrono::milliseconds(210));
+	std::vector<uint32_t> heldValues;
+	while (heldValues.size() < 56) {
+		const std::vector<uint32_t> newValues = drainValues(*messageQueue);
+		heldValues.insert(heldValues.end(), newValues.begin(), newValues.end());
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	TEST_VERIFY(heldValues.size() == 56 && std::is_sorted(heldValues.begin(), heldValues.end()));
+
+	// Held messages between immediate ones are skipped by the reads, and their slots go back to the producer
+	// once the reads pass them.
+	for (uint32_t i = 0; i < 16; ++i) {
+		message.value = 400 + i;
+		if (i % 2 == 0) {
+			channelInput.pushMessage(message, MessageType::Message1);
+		} else {
+			channelInput.pushMessageAfter(message, MessageType::Message1, std::chrono::milliseconds(200));
+		}
+	}
+	TEST_VERIFY(channelInput.isFull());
+	MessageQueue::ThreadChannelOutput channelOutput = messageQueue->getThreadChannelOutput(0);
+	MessageQueue::MessageContainer messages[16];
+	TEST_VERIFY(channelOutput.getNumMessages() == 0);
+	TEST_VERIFY(channelOutput.collectScheduled() == 8);
+	TEST_VERIFY(channelOutput.getNumMessages() == 8);
+	TEST_VERIFY(channelOutput.popMessages(messages, 3) == 3 && messages[2].getMessage<Message1>().value == 404);
+	TEST_VERIFY(channelOutput.popMessage().getMessage<Message1>().value == 406);
+	TEST_VERIFY(channelOutput.popMessages(messages, 16) == 4 && messages[3].getMessage<Message1>().value == 414);
+	TEST_VERIFY(!channelInput.isFull());
+	for (uint32_t i = 0; i < 16; ++i) {
+		message.value = 500 + i;
+		channelInput.pushMessage(message, MessageType::Message1);
+	}
+	TEST_VERIFY(drainValues(*messageQueue).size() == 16);
+	std::this_thread::sleep_for(std::chrono::milliseconds(210));
+	heldValues.clear();
+	while (heldValues.size() < 8) {
+		const std::vector<uint32_t> newValues = drainValues(*messageQueue);
+		heldValues.insert(heldValues.end(), newValues.begin(), newValues.end());
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	TEST_VERIFY(heldValues == std::vector<uint32_t>({401, 403, 405, 407, 409, 411, 413, 415}));
+}
+
+} // namespace ScheduledDeliveryTest
+
+namespace ConflatingQueueTest {
+
+using ConflatingQueue = LWMessageQueue::LWConflatingQueue<4, 2, MessageUnion, MessageType>;
+
+std::vector<std::pair<uint64_t, uint32_t>> drainValues(ConflatingQueue::ConflatingOutput& inOutput) {
+	std::vector<std::pair<uint64_t, uint32_t>> values;
+	inOutput.drain([&values](const ConflatingQueue::MessageContainer& inMessage) {
+		values.emplace_back(inMessage.getKey(), inMessage.getMessage<Message1>().value);
+	}, 16);
+	return values;
+}
+
+void conflationTest() {
+	std::unique_ptr<ConflatingQueue> conflatingQueue(new ConflatingQueue());
+	ConflatingQueue::ConflatingInput input = conflatingQueue->getInput(0);
+	ConflatingQueue::ConflatingOutput output = conflatingQueue->getOutput(0);
+	TEST_VERIFY(output.getNumMessages() == 0);
+	TEST_VERIFY(drainValues(output).empty());
+
+	// Later messages replace pending ones, and keys keep the order they first became pending in.
+	Message1 message;
+	const uint64_t keys[] = {7, 3, 7, 9, 7, 3};
+	for (uint32_t i = 0; i < 6; ++i) {
+		message.value = i;
+		input.pushMessage(keys[i], message, MessageType::Message1);
+	}
+	TEST_VERIFY(output.getNumMessages() == 3 && input.getNumKeys() == 3);
+	typedef std::vector<std::pair<uint64_t, uint32_t>> Values;
+	TEST_VERIFY(drainValues(output) == Values({{7, 4}, {3, 5}, {9, 3}}));
+
+	// A read key is pending again on its next push. Once SIZE keys are in use, a new key takes the slot of a key
+	// that has been read, here 7, and can not be pushed while all keys are pending.
+	message.value = 10;
+	input.pushMessage(9, message, MessageType::Message1);
+	TEST_VERIFY(input.tryPushMessage(1, message, MessageType::Message1));
+	TEST_VERIFY(input.tryPushMessage(2, message, MessageType::Message1));
+	message.value = 11;
+	TEST_VERIFY(input.tryPushMessage(3, message, MessageType::Message1));
+	TEST_VERIFY(!input.tryPushMessage(5, message, MessageType::Message1));
+	TEST_VERIFY(input.getNumKeys() == 4);
+
+	TEST_VERIFY(output.drain([](const ConflatingQueue::MessageContainer&) {}, 2) == 2);
+	TEST_VERIFY(drainValues(output) == Values({{2, 10}, {3, 11}}));
+
+	// Any number of keys go through the channel, as long as their messages are read.
+	for (uint64_t key = 100; key < 200; ++key) {
+		message.value = static_cast<uint32_t>(key);
+		TEST_VERIFY(input.tryPushMessage(key, message, MessageType::Message1));
+		TEST_VERIFY(drainValues(output) == Values({{key, static_cast<uint32_t>(key)}}));
+	}
+	TEST_VERIFY(input.getNumKeys() == 4);
+	message.value = 7;
+	input.pushMessage(7, message, MessageType::Message1);
+	TEST_VERIFY(drainValues(output) == Values({{7, 7}}));
+
+	// Each channel has its own keys.
+	TEST_VERIFY(conflatingQueue->getInput(1).tryPushMessage(2, message, MessageType::Message1));
+	TEST_VERIFY(output.getNumMessages() == 0 && conflatingQueue->getOutput(1).getNumMessages() == 1);
+}
+
+// With more keys than slots, pushMessage() waits for the output thread to read keys and free their slots.
+void multiThreadConflationTest(const uint32_t inNumKeys) {
+	using ThreadQueue = LWMessageQueue::LWConflatingQueue<64, 1, MessageUnion, MessageType>;
+	std::unique_ptr<ThreadQueue> conflatingQueue(new ThreadQueue());
+
+	const uint32_t numKeys = inNumKeys;
+	const uint32_t numMessages = 400000;
+	std::atomic<bool> done{false};
+	bool inOrder = true;
+	bool uniqueKeys = true;
+	uint32_t numRead = 0;
+	std::vector<uint32_t> lastValues(numKeys, 0);
+
+	std::thread outputThread([&]() {
+		ThreadQueue::ConflatingOutput output = conflatingQueue->getOutput(0);
+		std::vector<uint32_t> drainOfKey(numKeys, 0);
+		for (uint32_t drain = 1; ; ++drain) {
+			const bool finished = done.load(std::memory_order_acquire);
+			const uint32_t numDrained = output.drain([&](const ThreadQueue::MessageContainer& inMessage) {
+				const uint64_t key = inMessage.getKey();
+				const uint32_t value = inMessage.getMessage<Message1>().value;
+				inOrder = inOrder && (value % numKeys == key) && (value + 1 > lastValues[key]);
+				uniqueKeys = uniqueKeys && (drainOfKey[key] != drain);
+				drainOfKey[key] = drain;
+				lastValues[key] = value + 1;
+			}, numKeys);
+			numRead += numDrained;
+			if (finished && numDrained == 0) {
+				break;
+			}
+			if (numDrained == 0) {
+				std::this_thread::yield();
+			}
+		}
+	});
+
+	ThreadQueue::ConflatingInput input = conflatingQueue->getInput(0);
+	Message1 message;
+	for (uint32_t i = 0; i < numMessages; ++i) {
+		message.value = i;
+		input.pushMessage(i % numKeys, message, MessageType::Message1);
+	}
+	done.store(true, std::memory_order_release);
+	outputThread.join();
+	std::cout << "   Conflating channel delivered " << numRead << " of " << numMessages << " messages" << std::endl;
+
+	// Every key ends with its last message, and each drain saw a key at most once.
+	TEST_VERIFY(inOrder && uniqueKeys);
+	TEST_VERIFY(numRead >= numKeys && numRead <= numMessages);
+	for (uint32_t key = 0; key < numKeys; ++key) {
+		TEST_VERIFY(lastValues[key] == numMessages - numKeys + key + 1);
+	}
+}
+
+void conflatingQueueTest() {
+	TEST_ENTER;
+
+	conflationTest();
+	multiThreadConflationTest(40);
+	multiThreadConflationTest(200);
+}
+
+} // namespace ConflatingQueueTest
+
+#if defined(__linux__)
+namespace EventFdTest {
+
+struct EventFdTraits : LWMessageQueue::DefaultTraits {
+	static constexpr bool enableEventFd = true;
 };
 
-enum class MessageType {
-	Message1,
-	Message2,
-	Message3
+struct EventFdReadyBitmapTraits : LWMessageQueue::DefaultTraits {
+	static constexpr bool enableEventFd = true;
+	static constexpr bool enableReadyBitmap = true;
 };
 
-} // namespace
+/** Wait on an epoll set for up to inTimeoutMs. @return Number of ready descriptors. */
+int waitForEvents(const int inEpollFd, const int inTimeoutMs) {
+	struct epoll_event events[2];
+	return epoll_wait(inEpollFd, events, 2, inTimeoutMs);
+}
+
+template<typename TRAITS, typename MessageQueue>
+uint32_t drainChannels(MessageQueue& inMessageQueue) {
+	uint32_t numMessages = 0;
+	const auto drainChannel = [&inMessageQueue, &numMessages](const uint32_t inChannel) {
+		numMessages += inMessageQueue.getThreadChannelOutput(inChannel).drain(
+			[](const typename MessageQueue::MessageContainer&) {}, 16);
+	};
+	if constexpr (TRAITS::enableReadyBitmap) {
+		inMessageQueue.forEachReadyChannel(drainChannel);
+	} else {
+		for (uint32_t channel = 0; channel < inMessageQueue.getNumChannels(); ++channel) {
+			drainChannel(channel);
+		}
+	}
+	return numMessages;
+}
+
+template<typename TRAITS>
+void armTest() {
+	using MessageQueue = LWMessageQueue::LWMessageQueue<16, 4, MessageUnion, MessageType, TRAITS>;
+	std::unique_ptr<MessageQueue> messageQueue(new MessageQueue());
+
+	const int epollFd = epoll_create1(EPOLL_CLOEXEC);
+	struct epoll_event event = {};
+	event.events = EPOLLIN;
+	TEST_VERIFY(epoll_ctl(epollFd, EPOLL_CTL_ADD, messageQueue->getEventFd(), &event) == 0);
+
+	// Not readable until armed and published to.
+	Message1 message;
+	message.value = 1;
+	messageQueue->getThreadChannelInput(1).pushMessage(message, MessageType::Message1);
+	TEST_VERIFY(waitForEvents(epollFd, 0) == 0);
+	TEST_VERIFY(!messageQueue->armEventFd());
+	TEST_VERIFY(drainChannels<TRAITS>(*messageQueue) == 1);
+	TEST_VERIFY(messageQueue->armEventFd());
+	TEST_VERIFY(waitForEvents(epollFd, 0) == 0);
+
+	// Only the first publish signals.
+	for (uint32_t channel = 0; channel < 4; ++channel) {
+		messageQueue->getThreadChannelInput(channel).pushMessage(message, MessageType::Message1);
+	}
+	TEST_VERIFY(waitForEvents(epollFd, 0) == 1);
+	uint64_t count = 0;
+	TEST_VERIFY(read(messageQueue->getEventFd(), &count, sizeof(count)) == sizeof(count) && count == 1);
+	TEST_VERIFY(waitForEvents(epollFd, 0) == 0);
+
+	// Arming again resets readiness left by the last signal.
+	messageQueue->getThreadChannelInput(2).pushMessage(message, MessageType::Message1);
+	TEST_VERIFY(drainChannels<TRAITS>(*messageQueue) == 5);
+	TEST_VERIFY(messageQueue->armEventFd());
+	TEST_VERIFY(waitForEvents(epollFd, 0) == 0);
+	messageQueue->getThreadChannelInput(3).pushMessage(message, MessageType::Message1);
+	TEST_VERIFY(waitForEvents(epollFd, 0) == 1);
+	TEST_VERIFY(drainChannels<TRAITS>(*messageQueue) == 1);
+	TEST_VERIFY(messageQueue->armEventFd());
+	TEST_VERIFY(waitForEvents(epollFd, 0) == 0);
+
+	close(epollFd);
+}
+
+template<typename TRAITS>
+void epollWaitTest() {
+	using MessageQueue = LWMessageQueue::LWMessageQueue<16, 4, MessageUnion, MessageType, TRAITS>;
+	std::unique_ptr<MessageQueue> messageQueue(new MessageQueue());
+
+	// A pipe stands in for a socket serviced by the same output thread.
+	int pipeFds[2];
+	TEST_VERIFY(pipe(pipeFds) == 0);
+	const int epollFd = epoll_create1(EPOLL_CLOEXEC);
+	struct epoll_event event = {};
+	event.events = EPOLLIN;
+	event.data.fd = messageQueue->getEventFd();
+	TEST_VERIFY(epoll_ctl(epollFd, EPOLL_CTL_ADD, messageQueue->getEventFd(), &event) == 0);
+	event.data.fd = pipeFds[0];
+	TEST_VERIFY(epoll_ctl(epollFd, EPOLL_CTL_ADD, pipeFds[0], &event) == 0);
+
+	const uint32_t numBursts = 20;
+	const uint32_t burstSize = 8;
+	std::thread inputThread([&messageQueue, &pipeFds]() {
+		typename MessageQueue::ThreadChannelInput channelInput = messageQueue->getThreadChannelInput(3);
+		Message1 message;
+		for (uint32_t burst = 0; burst < numBursts; ++burst) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(2));
+			for (uint32_t i = 0; i < burstSize; ++i) {
+				while (channelInput.isFull()) {
+					std::this_thread::yield();
+				}
+				message.value = i;
+				channelInput.pushMessage(message, MessageType::Message1);
+			}
+		}
+		const char byte = 0;
+		TEST_VERIFY(write(pipeFds[1], &byte, 1) == 1);
+	});
+
+	uint32_t receivedMessages = 0;
+	uint32_t numTimeouts = 0;
+	bool pipeReadable = false;
+	while (receivedMessages < numBursts * burstSize || !pipeReadable) {
+		receivedMessages += drainChannels<TRAITS>(*messageQueue);
+		if (!messageQueue->armEventFd()) {
+			continue;
+		}
+		struct epoll_event events[2];
+		const int numEvents = epoll_wait(epollFd, events, 2, 10000);
+		numTimeouts += (numEvents == 0) ? 1 : 0;
+		for (int i = 0; i < numEvents; ++i) {
+			pipeReadable = pipeReadable || (events[i].data.fd == pipeFds[0]);
+		}
+	}
+	inputThread.join();
+
+	TEST_VERIFY(receivedMessages == numBursts * burstSize);
+	TEST_VERIFY(numTimeouts == 0);
+	close(epollFd);
+	close(pipeFds[0]);
+	close(pipeFds[1]);
+}
+
+// Without a free descriptor for the eventfd, construction throws instead of leaving the queue without one.
+void creationFailureTest() {
+	using MessageQueue = LWMessageQueue::LWMessageQueue<16, 4, MessageUnion, MessageType, EventFdTraits>;
+	static_assert(!std::is_nothrow_default_constructible<MessageQueue>::value, "Creating the eventfd may throw.");
+
+	struct rlimit limit;
+	TEST_VERIFY(getrlimit(RLIMIT_NOFILE, &limit) == 0);
+	struct rlimit noDescriptors = limit;
+	noDescriptors.rlim_cur = 0;
+	TEST_VERIFY(setrlimit(RLIMIT_NOFILE, &noDescriptors) == 0);
+	int error = 0;
+	try {
+		MessageQueue messageQueue;
+	}
+	catch (const std::system_error& inError) {
+		error = inError.code().value();
+	}
+	TEST_VERIFY(setrlimit(RLIMIT_NOFILE, &limit) == 0);
+	TEST_VERIFY(error == EMFILE);
+}
+
+void eventFdTest() {
+	TEST_ENTER;
+
+	creationFailureTest();
+	armTest<EventFdTraits>();
+	epollWaitTest<EventFdTraits>();
+	armTest<EventFdReadyBitmapTraits>();
+	epollWaitTest<EventFdReadyBitmapTraits>();
+}
+
+} // namespace EventFdTest
+#endif
+
+namespace LayoutTest {
+
+// Every block of a channel must start on a cache line boundary and end before the next block starts, and the 
+// channel stride must be a whole number of cache lines. Then no cache line is shared between the producer state, 
+// the consumer state and the message ring of one channel, or between two adjacent channels.
+template<typename LAYOUT>
+constexpr bool isCacheLineIsolated() {
+	return (LAYOUT::channelAlignment % LAYOUT::cacheLineSize == 0) &&
+		(LAYOUT::channelSize % LAYOUT::cacheLineSize == 0) &&
+		(LAYOUT::producerOffset % LAYOUT::cacheLineSize == 0) &&
+		(LAYOUT::consumerOffset % LAYOUT::cacheLineSize == 0) &&
+		(LAYOUT::elementsOffset % LAYOUT::cacheLineSize == 0) &&
+		(LAYOUT::producerOffset + LAYOUT::producerSize <= LAYOUT::consumerOffset) &&
+		(LAYOUT::consumerOffset + LAYOUT::consumerSize <= LAYOUT::elementsOffset) &&
+		(LAYOUT::elementsOffset + LAYOUT::elementsSize <= LAYOUT::channelSize);
+}
+
+template<uint32_t SIZE, typename MESSAGE, typename TRAITS>
+constexpr bool isQueueCacheLineIsolated() {
+	using MessageQueue = LWMessageQueue::LWMessageQueue<SIZE, 3, MESSAGE, MessageType, TRAITS>;
+	return isCacheLineIsolated<typename MessageQueue::ChannelLayout>() &&
+		(sizeof(MessageQueue) >= MessageQueue::ChannelLayout::channelSize * 3);
+}
+
+template<typename MESSAGE>
+constexpr bool isCacheLineIsolatedForAllTraits() {
+	return isQueueCacheLineIsolated<1, MESSAGE, LWMessageQueue::DefaultTraits>() &&
+		isQueueCacheLineIsolated<16, MESSAGE, LWMessageQueue::DefaultTraits>() &&
+		isQueueCacheLineIsolated<1, MESSAGE, LWMessageQueue::CacheLine128Traits>() &&
+		isQueueCacheLineIsolated<16, MESSAGE, LWMessageQueue::CacheLine128Traits>();
+}
+
+static_assert(isCacheLineIsolatedForAllTraits<MessageUnion>(), "MessageUnion channel layout shares cache lines.");
+static_assert(isCacheLineIsolatedForAllTraits<SizedMessageUnion<1>>(), "1 byte channel layout shares cache lines.");
+static_assert(isCacheLineIsolatedForAllTraits<SizedMessageUnion<7>>(), "7 byte channel layout shares cache lines.");
+static_assert(isCacheLineIsolatedForAllTraits<SizedMessageUnion<60>>(), "60 byte channel layout shares cache lines.");
+static_assert(isCacheLineIsolatedForAllTraits<SizedMessageUnion<64>>(), "64 byte channel layout shares cache lines.");
+static_assert(isCacheLineIsolatedForAllTraits<SizedMessageUnion<129>>(), "129 byte channel layout shares cache lines.");
+static_assert(isCacheLineIsolatedForAllTraits<SizedMessageUnion<1000>>(), "1000 byte channel layout shares cache lines.");
+
+void channelLayoutTest() {
+	TEST_ENTER;
+
+	using MessageQueue = LWMessageQueue::LWMessageQueue<2, 4, MessageUnion, MessageType, LWMessageQueue::CacheLine128Traits>;
+	std::unique_ptr<MessageQueue> messageQueue(new MessageQueue());
+
+	// Heap allocated queues must honour the channel alignment.
+	TEST_VERIFY(reinterpret_cast<uintptr_t>(messageQueue.get()) % MessageQueue::ChannelLayout::channelAlignment == 0);
+}
+
+} // namespace LayoutTest
 
 void pushMessageTest() {
 	TEST_ENTER;
@@ -117,6 +2592,34 @@ void isFullTest() {
 	TEST_VERIFY(!channel1Input.isFull());
 }
 
+void wrapAroundTest() {
+	TEST_ENTER;
+
+	using MessageQueue = LWMessageQueue::LWMessageQueue<4, 1, MessageUnion, MessageType>;
+	std::unique_ptr<MessageQueue> messageQueue(new MessageQueue());
+
+	MessageQueue::ThreadChannelOutput channelOutput = messageQueue->getThreadChannelOutput(0);
+	MessageQueue::ThreadChannelInput channelInput = messageQueue->getThreadChannelInput(0);
+
+	Message1 message;
+	uint32_t expectedValue = 0;
+	for (uint32_t round = 0; round < 10; ++round) {
+		for (uint32_t i = 0; i < 3; ++i) {
+			message.value = round * 3 + i;
+			channelInput.pushMessage(message, MessageType::Message1);
+		}
+		TEST_VERIFY(channelOutput.getNumMessages() == 3);
+		TEST_VERIFY(!channelInput.isFull());
+
+		for (uint32_t i = 0; i < 3; ++i) {
+			MessageQueue::MessageContainer messageContainer = channelOutput.popMessage();
+			TEST_VERIFY(messageContainer.getMessage<Message1>().value == expectedValue);
+			++expectedValue;
+		}
+		TEST_VERIFY(channelOutput.getNumMessages() == 0);
+	}
+}
+
 namespace MultiThreadTest {
 
 const uint32_t queueSize = 1048576;
@@ -136,7 +2639,7 @@ void inputThreadEntry(MessageQueue::ThreadChannelInput inThreadChannelInput, con
 	}
 }
 
-void verifyMessage(MessageQueue::MessageContainer&& inMessageContainer, const uint32_t inChannelIndex) {
+void verifyMessage(const MessageQueue::MessageContainer& inMessageContainer, const uint32_t inChannelIndex) {
 	switch (inMessageContainer.getType()) {
 	case MessageType::Message1:
 		{
@@ -183,6 +2686,31 @@ void outputThreadEntry(std::shared_ptr<MessageQueue> inMessageQueue, const uint3
 	}
 }
 
+void outputThreadDrainEntry(std::shared_ptr<MessageQueue> inMessageQueue, const uint32_t inQueueSize, const uint32_t inNumInputThreads) {
+	try {
+		std::vector<MessageQueue::ThreadChannelOutput> channelOutputs;
+		channelOutputs.reserve(inNumInputThreads);
+
+		for (uint32_t channelIndex = 0; channelIndex < inNumInputThreads; ++channelIndex) {
+			channelOutputs.push_back(inMessageQueue->getThreadChannelOutput(channelIndex));
+		}
+
+		const uint32_t totalMessages = inQueueSize * inNumInputThreads;
+		uint32_t receivedMessages = 0;
+
+		while (receivedMessages < totalMessages) {
+			for (uint32_t channelIndex = 0; channelIndex < inNumInputThreads; ++channelIndex) {
+				receivedMessages += channelOutputs[channelIndex].drain([channelIndex](const MessageQueue::MessageContainer& inMessageContainer) {
+					verifyMessage(inMessageContainer, channelIndex);
+				}, inQueueSize);
+			}
+		}
+		std::cout << "   Output thread received " << receivedMessages << " messages" << std::endl;
+	} catch (const TestFailure& exception) {
+		std::cout << "Test failed: " << exception.getInfo() << std::endl;
+	}
+}
+
 void multiThreadTest() {
 	TEST_ENTER;
 
@@ -203,6 +2731,26 @@ void multiThreadTest() {
 	outputThread->join();
 }
 
+void multiThreadDrainTest() {
+	TEST_ENTER;
+
+	std::shared_ptr<MessageQueue> messageQueue(new MessageQueue());
+
+	std::vector<std::unique_ptr<std::thread>> inputThreads;
+	inputThreads.reserve(numInputThreads);
+
+	for (uint32_t channelIndex = 0; channelIndex < numInputThreads; ++channelIndex) {
+		inputThreads.emplace_back(new std::thread(inputThreadEntry, messageQueue->getThreadChannelInput(channelIndex), queueSize, channelIndex));
+	}
+
+	std::unique_ptr<std::thread> outputThread(new std::thread(outputThreadDrainEntry, messageQueue, queueSize, numInputThreads));
+
+	for (auto& inputThread : inputThreads) {
+		inputThread->join();
+	}
+	outputThread->join();
+}
+
 } // namespace MultiThreadTest
 
 int main(int, char**) {
@@ -210,7 +2758,38 @@ int main(int, char**) {
 		pushMessageTest();
 		popMessageTest();
 		isFullTest();
+		wrapAroundTest();
+		popMessagesTest();
+		drainTest();
+		stageMessageTest();
+		reserveMessageTest();
+		peekMessageTest();
+		ReadyChannelTest::readyChannelTest();
+		BlockingWaitTest::blockingWaitTest();
+		OverflowPolicyTest::overflowPolicyTest();
+		RecordQueueTest::recordQueueTest();
+		DynamicQueueTest::dynamicQueueTest();
+		ChannelRegistryTest::channelRegistryTest();
+		SharedChannelTest::sharedChannelTest();
+		ConsumerGroupTest::consumerGroupTest();
+		BroadcastQueueTest::broadcastQueueTest();
+		TypedMessagesTest::typedMessagesTest();
+		PriorityDrainTest::priorityDrainTest();
+		StatsTest::statsTest();
+		LatencyTraceTest::latencyTraceTest();
+#if defined(__linux__)
+		SharedMemoryTest::sharedMemoryTest();
+		RecorderTest::recorderTest();
+#endif
+		ScheduledDeliveryTest::scheduledDeliveryTest();
+		ConflatingQueueTest::conflatingQueueTest();
+#if defined(__linux__)
+		EventFdTest::eventFdTest();
+#endif
+		LayoutTest::channelLayoutTest();
 		MultiThreadTest::multiThreadTest();
+		MultiThreadTest::multiThreadDrainTest();
+		ReadyChannelTest::multiThreadReadyChannelTest();
 	}
 	catch (const TestFailure& exception) {
 		std::cout << "Test failed: " << exception.getInfo() << std::endl;